@@ -1,88 +1,375 @@
 #include <stdio.h>
+#include <string.h>
 #include <hardware/i2c.h>
 
 #include "husb238.h"
+#include "husb238_arbiter.h"
+#include "husb238_hal.h"
+#include "husb238_log.h"
+#include "husb238_trace.h"
 
 
-// 0: dont say anything
-// 1: only say errors
-// 2: verbose debug output
-#define HUSB238_VERBOSE 0
+//
+// 1 for timeouts, 0 for blocking
+//
+// When running i2c in blocking mode, communications sometimes freezes
+// with the data line held low.  Power cycling the HUSB238 un-freezes it.
+//
+
+#define I2C_TIMEOUT 1
+
+//
+// Per-device driver state.
+//
+// Every HUSB238 lives at address 0x08, so without a mux there's one per
+// bus.  With a mux, the device the driver is talking to on a bus is the
+// one on the mux channel that was last selected with
+// husb238_port_select().  Devices are looked up by (bus, mux, channel).
+//
+
+#ifndef HUSB238_MAX_DEVICES
+#define HUSB238_MAX_DEVICES (16)
+#endif
+
+#ifndef HUSB238_MAX_BUSES
+#define HUSB238_MAX_BUSES (4)
+#endif
 
-#define HUSB238_ERROR(fmt, args...) if (HUSB238_VERBOSE >= 1) { printf(fmt, ## args); }
-#define HUSB238_PRINT(fmt, args...) if (HUSB238_VERBOSE >= 2) { printf(fmt, ## args); }
+// Registers that only change on attach, GET_SRC_CAP, HARD_RESET, or
+// when we write them: SRC_PDO_5V through SRC_PDO_20V, and SRC_PDO.
+#define HUSB238_CACHEABLE_REGS (0x01fc)
 
-#define HUSB238_I2C_SLAVE_ADDRESS (0x08)
+typedef struct {
+    i2c_inst_t * i2c;
+    uint8_t mux_addr;
+    uint8_t mux_channel;
 
-#define HUSB238_I2C_REG_PD_STATUS0  (0x00)
-#define HUSB238_I2C_REG_PD_STATUS1  (0x01)
-#define HUSB238_I2C_REG_SRC_PDO_5V  (0x02)
-#define HUSB238_I2C_REG_SRC_PDO_9V  (0x03)
-#define HUSB238_I2C_REG_SRC_PDO_12V (0x04)
-#define HUSB238_I2C_REG_SRC_PDO_15V (0x05)
-#define HUSB238_I2C_REG_SRC_PDO_18V (0x06)
-#define HUSB238_I2C_REG_SRC_PDO_20V (0x07)
-#define HUSB238_I2C_REG_SRC_PDO     (0x08)
-#define HUSB238_I2C_REG_GO_COMMAND  (0x09)
+    husb238_config_t config;
 
-#define HUSB238_CMD_HARD_RESET  (0x10)
-#define HUSB238_CMD_GET_SRC_CAP (0x04)
-#define HUSB238_CMD_SELECT_PDO  (0x01)
+    bool cache_enabled;
+    uint16_t cache_valid;  // Bitmask of register addresses.
+    uint8_t cache[HUSB238_I2C_REG_GO_COMMAND + 1];
+    bool command_pending;  // SELECT_PDO or GET_SRC_CAP not finished yet.
+    int attached;          // ATTACH bit last seen in PD_STATUS1, -1 if unknown.
+    husb238_cache_stats_t cache_stats;
 
+    husb238_bus_stats_t bus_stats;
+} husb238_device_t;
 
-// This is the active voltage, indexed by the PD_SRC_VOLTAGE field of
-// register PD_STATUS0.
-static int husb238_pd_src_voltage[] = {
-    -1, // no PD voltage attached
-    5, 9, 12, 15, 18, 20
-};
+static husb238_device_t husb238_devices[HUSB238_MAX_DEVICES];
 
-// This is the max current, indexed by the PD_SRC_CURRENT field of
-// register PD_STATUS0.
-static float husb238_pd_src_current[] = {
-    0.5, 0.7,
-    1.0, 1.25, 1.5, 1.75,
-    2.0, 2.25, 2.5, 2.75,
-    3.0, 3.25, 3.5,
-    4.0, 4.5,
-    5.0
-};
+
+// What we last routed each bus to.
+typedef struct {
+    i2c_inst_t * i2c;
+    bool known;            // False until the first select, and after a failed mux write.
+    uint8_t mux_addr;      // HUSB238_NO_MUX, or the mux with a channel enabled.
+    uint8_t mux_channel;
+    uint64_t idle_us;      // End of the gap after the last transfer.
+    husb238_arbiter_t * arbiter;  // Shares the bus with other devices, if not NULL.
+    uint8_t priority;             // husb238_bus_priority_t of our transactions.
+} husb238_bus_t;
+
+static husb238_bus_t husb238_buses[HUSB238_MAX_BUSES];
+
+
+static husb238_bus_t * husb238_bus(i2c_inst_t * i2c, bool create) {
+    husb238_bus_t * unused = NULL;
+
+    for (int i = 0; i < HUSB238_MAX_BUSES; ++i) {
+        if (husb238_buses[i].i2c == i2c) {
+            return &husb238_buses[i];
+        }
+        if (unused == NULL && husb238_buses[i].i2c == NULL) {
+            unused = &husb238_buses[i];
+        }
+    }
+
+    if (!create || unused == NULL) {
+        return NULL;
+    }
+    *unused = {};
+    unused->i2c = i2c;
+    return unused;
+}
+
+
+// Returns the state for the currently selected device on `i2c`,
+// optionally allocating it.  Returns NULL if there is none (or no room
+// for a new one).
+static husb238_device_t * husb238_device(i2c_inst_t * i2c, bool create) {
+    husb238_device_t * unused = NULL;
+    husb238_device_t * sibling = NULL;
+    uint8_t mux_addr = HUSB238_NO_MUX;
+    uint8_t mux_channel = 0;
+
+    husb238_bus_t * bus = husb238_bus(i2c, false);
+    if (bus != NULL && bus->known) {
+        mux_addr = bus->mux_addr;
+        mux_channel = bus->mux_channel;
+    }
+
+    for (int i = 0; i < HUSB238_MAX_DEVICES; ++i) {
+        husb238_device_t * dev = &husb238_devices[i];
+        if (dev->i2c == i2c) {
+            if (dev->mux_addr == mux_addr && dev->mux_channel == mux_channel) {
+                return dev;
+            }
+            sibling = dev;
+        }
+        if (unused == NULL && dev->i2c == NULL) {
+            unused = dev;
+        }
+    }
+
+    if (!create || unused == NULL) {
+        return NULL;
+    }
+    *unused = {};
+    unused->i2c = i2c;
+    unused->mux_addr = mux_addr;
+    unused->mux_channel = mux_channel;
+    if (sibling != NULL) {
+        // Same bus, so same baudrate.
+        unused->config = sibling->config;
+    } else {
+        unused->config.baudrate = HUSB238_DEFAULT_BAUDRATE;
+        unused->config.gap_us = HUSB238_DEFAULT_GAP_US;
+    }
+    unused->attached = -1;
+    return unused;
+}
+
+
+static husb238_config_t const * husb238_config(i2c_inst_t * i2c) {
+    static husb238_config_t const default_config = {
+        .baudrate = HUSB238_DEFAULT_BAUDRATE,
+        .gap_us = HUSB238_DEFAULT_GAP_US,
+    };
+    husb238_device_t * dev = husb238_device(i2c, false);
+    return dev ? &dev->config : &default_config;
+}
+
+
+// Timeout for an i2c transfer of `len` bytes (plus the address byte),
+// or 0 to block forever.
+static uint husb238_i2c_timeout_us(i2c_inst_t * i2c, size_t len) {
+#if I2C_TIMEOUT
+    // At 100 kHz a bit is 10 µs nominal, 12 µs actual (measured), so
+    // allow 1.3 nominal bit times.  A byte is 8 bits plus the Ack/Nack
+    // bit, and we allow twice that.
+    uint baudrate = husb238_config(i2c)->baudrate;
+    uint byte_timeout_ns = (1300u * 1000u * 1000u / baudrate) * 9 * 2;
+    return ((len + 1) * byte_timeout_ns + 999) / 1000;
+#else
+    return 0;
+#endif
+}
+
+
+// How long `transfers` transfers carrying `bytes` bytes between them
+// (plus an address byte each) should hold a shared bus, at the 1.3
+// nominal bit times a bit really takes.
+static uint32_t husb238_transaction_us(i2c_inst_t * i2c, size_t bytes, size_t transfers) {
+    uint baudrate = husb238_config(i2c)->baudrate;
+    uint32_t bits = (bytes + transfers) * 9 + transfers * 2;
+    return (bits * 1300u * 1000u / baudrate + 999) / 1000;
+}
+
+
+// Let the bus (and the HUSB238) rest between transfers.  The rest is
+// taken before the next transfer rather than right after this one, so
+// time the caller spends on other things counts towards it.
+static void husb238_transfer_gap(i2c_inst_t * i2c) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    uint gap_us = husb238_config(i2c)->gap_us;
+    if (gap_us == 0) {
+        return;
+    }
+
+    husb238_bus_t * bus = husb238_bus(i2c, true);
+    if (bus == NULL) {
+        hal->sleep_us(gap_us);
+        return;
+    }
+    bus->idle_us = hal->time_us() + gap_us;
+}
+
+
+// Wait out whatever is left of the gap after the last transfer.
+static void husb238_transfer_wait(i2c_inst_t * i2c) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    uint64_t now = hal->time_us();
+    uint64_t idle_us = husb238_bus_idle_us(i2c);
+
+    if (idle_us > now) {
+        hal->sleep_us(idle_us - now);
+    }
+}
+
+
+uint64_t husb238_bus_idle_us(i2c_inst_t * i2c) {
+    husb238_bus_t * bus = husb238_bus(i2c, false);
+    return bus != NULL ? bus->idle_us : 0;
+}
+
+
+// Hold the bus for a transaction expected to take `duration_us`, if
+// it's shared.  Called after waiting out the gap, so the gap isn't
+// spent holding the bus.
+static void husb238_bus_acquire(i2c_inst_t * i2c, uint32_t duration_us) {
+    husb238_bus_t * bus = husb238_bus(i2c, false);
+    if (bus != NULL && bus->arbiter != NULL) {
+        husb238_arbiter_acquire(bus->arbiter, (husb238_bus_priority_t)bus->priority, duration_us);
+    }
+}
+
+
+static void husb238_bus_release(i2c_inst_t * i2c) {
+    husb238_bus_t * bus = husb238_bus(i2c, false);
+    if (bus != NULL && bus->arbiter != NULL) {
+        husb238_arbiter_release(bus->arbiter);
+    }
+}
+
+
+int husb238_set_bus_arbiter(i2c_inst_t * i2c, husb238_arbiter_t * arb, husb238_bus_priority_t priority) {
+    husb238_bus_t * bus = husb238_bus(i2c, arb != NULL);
+    if (bus == NULL) {
+        return arb != NULL ? PICO_ERROR_INSUFFICIENT_RESOURCES : PICO_OK;
+    }
+    bus->arbiter = arb;
+    bus->priority = priority;
+    return PICO_OK;
+}
+
+
+// All the driver's I2C transfers go through these two, so they can be
+// traced.  `reg` is the register the transfer addresses, for the trace.
+// A write with `nostop` set keeps the bus for a repeated start, so it
+// isn't followed by a gap.
+static int husb238_i2c_write(i2c_inst_t * i2c, uint8_t addr, uint8_t reg, uint8_t const * src, size_t len, bool nostop) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    husb238_transfer_wait(i2c);
+    uint64_t start_us = hal->time_us();
+    int r = husb238_get_bus_hal(i2c)->i2c_write(i2c, addr, src, len, nostop, husb238_i2c_timeout_us(i2c, len));
+    husb238_trace_transfer(start_us, hal->time_us() - start_us, addr, reg, HUSB238_TRACE_WRITE, len, r);
+    if (!nostop || r < PICO_OK) {
+        husb238_transfer_gap(i2c);
+    }
+    return r;
+}
+
+
+static int husb238_i2c_read(i2c_inst_t * i2c, uint8_t addr, uint8_t reg, uint8_t * dst, size_t len) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    husb238_transfer_wait(i2c);
+    uint64_t start_us = hal->time_us();
+    int r = husb238_get_bus_hal(i2c)->i2c_read(i2c, addr, dst, len, false, husb238_i2c_timeout_us(i2c, len));
+    husb238_trace_transfer(start_us, hal->time_us() - start_us, addr, reg, HUSB238_TRACE_READ, len, r);
+    husb238_transfer_gap(i2c);
+    return r;
+}
 
 
 //
-// 1 for timeouts, 0 for blocking
+// Called after attempt number `attempt` (counting from 0) of a
+// transaction failed with `r`.  Returns true if the transaction should
+// be tried again, after recovering the bus if it looks hung.
 //
-// When running i2c in blocking mode, communications sometimes freezes
-// with the data line held low.  Power cycling the HUSB238 un-freezes it.
+// A Nack comes back quickly and means nobody answered.  A timeout at
+// our (tight) timeouts means the bus stopped moving, which is what a
+// target holding SDA low looks like, so that's when to clock it out.
 //
+static bool husb238_retry(i2c_inst_t * i2c, int r, uint attempt) {
+    husb238_device_t * dev = husb238_device(i2c, false);
+    if (dev == NULL || attempt >= dev->config.retries) {
+        return false;
+    }
 
-#define I2C_TIMEOUT 1
+    husb238_hal_t const * hal = husb238_get_hal();
+    husb238_hal_t const * bus_hal = husb238_get_bus_hal(i2c);
+    husb238_bus_stats_t * stats = &dev->bus_stats;
+    stats->retries++;
+
+    if (r == PICO_ERROR_TIMEOUT && dev->config.bus_recovery && bus_hal->bus_recover != NULL) {
+        uint64_t start = hal->time_us();
+        husb238_bus_acquire(i2c, husb238_transaction_us(i2c, 1, 1));
+        int rr = bus_hal->bus_recover(i2c, dev->config.sda_gpio, dev->config.scl_gpio, dev->config.baudrate);
+        husb238_bus_release(i2c);
+        uint32_t elapsed_us = hal->time_us() - start;
+
+        stats->recoveries++;
+        if (rr != PICO_OK) {
+            stats->recovery_failures++;
+        }
+        stats->recovery_us_total += elapsed_us;
+        if (elapsed_us > stats->recovery_us_max) {
+            stats->recovery_us_max = elapsed_us;
+        }
+        HUSB238_ERROR(BUS_RECOVERED, elapsed_us, rr);
+    }
+    return true;
+}
 
-#ifdef I2C_TIMEOUT
-// Running i2c at 100 kHz.  10 µs/bit nominal, 12 µs actual (measured).
-// Call it 13 µs to have some margin.
-static uint const i2c_bit_time_us = 13;
 
-// 8 bits/byte, plus the Ack/Nack bit.
-static uint const i2c_byte_timeout_us = i2c_bit_time_us * 9 * 2;
-#endif
+static void husb238_cache_drop(husb238_device_t * dev) {
+    if (dev != NULL && dev->cache_valid != 0) {
+        dev->cache_valid = 0;
+        dev->cache_stats.invalidations++;
+    }
+}
 
 
-static int husb238_read_pdo(i2c_inst_t * i2c, husb238_pdo_t * pdo) {
-    int r;
-    uint8_t val;
+// Bitmask of register addresses [reg, reg + count).
+static uint16_t husb238_reg_mask(uint8_t reg, size_t count) {
+    if (reg + count > 16) {
+        count = 16 - reg;
+    }
+    return ((1u << count) - 1) << reg;
+}
 
-    r = husb238_read_register(i2c, pdo->reg, &val);
-    if (r != PICO_OK) return r;
 
-    if (val & 0x80) {
-        // SRC PDO detected
-        pdo->max_current = husb238_pdo_max_current(val);
-    } else {
-        pdo->max_current = 0.0;
+void husb238_snapshot_get_contract(husb238_registers_t const * regs, int & volts, float & max_current) {
+    husb238_pd_status0_t s = husb238_decode_pd_status0(regs->pd_status0);
+
+    // -1 V means there's no PD contract.
+    volts = s.mv ? s.mv / 1000 : -1;
+    max_current = husb238_pd_src_ma[s.current_code] / 1000.0f;
+}
+
+
+void husb238_snapshot_get_pdos(husb238_registers_t const * regs, husb238_pdo_t pdos[6]) {
+    for (int i = 0; i < HUSB238_NUM_PDOS; ++i) {
+        husb238_src_pdo_reg_t p = husb238_decode_src_pdo_reg(regs->src_pdos[i]);
+        pdos[i].id = husb238_encode_src_pdo(i);
+        pdos[i].reg = HUSB238_I2C_REG_SRC_PDO_5V + i;
+        pdos[i].volts = husb238_pdo_index_mv(i) / 1000.0f;
+        pdos[i].max_current = p.max_ma / 1000.0f;
     }
+}
 
-    return 0;
+
+void husb238_snapshot_get_contract_mv_ma(husb238_registers_t const * regs, uint16_t * mv, uint16_t * ma) {
+    husb238_pd_status0_t s = husb238_decode_pd_status0(regs->pd_status0);
+    *mv = s.mv;
+    *ma = s.ma;
+}
+
+
+void husb238_snapshot_get_pdos_fixed(husb238_registers_t const * regs, husb238_pdo_fixed_t pdos[6]) {
+    for (int i = 0; i < HUSB238_NUM_PDOS; ++i) {
+        pdos[i].id = husb238_encode_src_pdo(i);
+        pdos[i].reg = HUSB238_I2C_REG_SRC_PDO_5V + i;
+        pdos[i].mv = husb238_pdo_index_mv(i);
+        pdos[i].max_ma = husb238_decode_src_pdo_reg(regs->src_pdos[i]).max_ma;
+    }
+}
+
+
+int husb238_snapshot_get_current_pdo(husb238_registers_t const * regs) {
+    // The PDO select field, even if it doesn't name a known PDO.
+    return regs->src_pdo & 0xf0;
 }
 
 
@@ -90,370 +377,1040 @@ static int husb238_read_pdo(i2c_inst_t * i2c, husb238_pdo_t * pdo) {
 // Returns PICO_OK if it worked, something else on error.
 int husb238_get_contract(i2c_inst_t * i2c, int & volts, float & max_current) {
     int r;
-    uint8_t val;
+    husb238_registers_t regs;
 
-    r = husb238_read_pd_status0(i2c, &val);
+    r = husb238_read_pd_status0(i2c, &regs.pd_status0);
     if (r != PICO_OK) {
         return r;
     }
 
-    int voltage_index = val >> 4;
-    volts = husb238_pd_src_voltage[voltage_index];
+    husb238_snapshot_get_contract(&regs, volts, max_current);
+    return PICO_OK;
+}
 
-    int current_index = val & 0x0f;
-    max_current = husb238_pd_src_current[current_index];
 
+int husb238_get_contract_mv_ma(i2c_inst_t * i2c, uint16_t * mv, uint16_t * ma) {
+    int r;
+    husb238_registers_t regs;
+
+    r = husb238_read_pd_status0(i2c, &regs.pd_status0);
+    if (r != PICO_OK) {
+        return r;
+    }
+
+    husb238_snapshot_get_contract_mv_ma(&regs, mv, ma);
+    return PICO_OK;
+}
+
+
+int husb238_get_pdos_fixed(i2c_inst_t * i2c, husb238_pdo_fixed_t pdos[6]) {
+    int r;
+    husb238_registers_t regs;
+
+    r = husb238_read_registers(i2c, HUSB238_I2C_REG_SRC_PDO_5V, regs.src_pdos, sizeof(regs.src_pdos));
+    if (r != PICO_OK) {
+        HUSB238_ERROR(READ_PDOS_FAILED);
+        return r;
+    }
+
+    husb238_snapshot_get_pdos_fixed(&regs, pdos);
     return PICO_OK;
 }
 
 
-// Read all the SRC_PDO registers from the HUSB238, populate the `pdos`
-// argument with the data.
+// Read all the SRC_PDO registers from the HUSB238 in one burst,
+// populate the `pdos` argument with the data.
 // Returns PICO_OK if all went well.
 int husb238_get_pdos(i2c_inst_t * i2c, husb238_pdo_t pdos[6]) {
     int r;
+    husb238_registers_t regs;
+    uint64_t start_us = husb238_get_hal()->time_us();
 
-    pdos[0] = { HUSB238_SRC_PDO_5V,  HUSB238_I2C_REG_SRC_PDO_5V,   5.0, 0.0 };
-    pdos[1] = { HUSB238_SRC_PDO_9V,  HUSB238_I2C_REG_SRC_PDO_9V,   9.0, 0.0 };
-    pdos[2] = { HUSB238_SRC_PDO_12V, HUSB238_I2C_REG_SRC_PDO_12V, 12.0, 0.0 };
-    pdos[3] = { HUSB238_SRC_PDO_15V, HUSB238_I2C_REG_SRC_PDO_15V, 15.0, 0.0 };
-    pdos[4] = { HUSB238_SRC_PDO_18V, HUSB238_I2C_REG_SRC_PDO_18V, 18.0, 0.0 };
-    pdos[5] = { HUSB238_SRC_PDO_20V, HUSB238_I2C_REG_SRC_PDO_20V, 20.0, 0.0 };
-
-    for (int i = 0; i < 6; ++i) {
-        r = husb238_read_pdo(i2c, &pdos[i]);
-        if (r != PICO_OK) {
-            HUSB238_ERROR("error reading PDO %d from HUSB238\n", i);
-            return r;
-        }
+    r = husb238_read_registers(i2c, HUSB238_I2C_REG_SRC_PDO_5V, regs.src_pdos, sizeof(regs.src_pdos));
+    husb238_trace_op(HUSB238_OP_GET_PDOS, husb238_get_hal()->time_us() - start_us);
+    if (r != PICO_OK) {
+        HUSB238_ERROR(READ_PDOS_FAILED);
+        return r;
     }
 
+    husb238_snapshot_get_pdos(&regs, pdos);
     return PICO_OK;
 }
 
 
 int husb238_get_current_pdo(i2c_inst_t * i2c, int * pdo) {
     int r;
-    uint8_t val;
+    husb238_registers_t regs;
 
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_SRC_PDO, &val);
+    r = husb238_read_register(i2c, HUSB238_I2C_REG_SRC_PDO, &regs.src_pdo);
     if (r != PICO_OK) {
         *pdo = HUSB238_SRC_PDO_NONE;
         return r;
     }
-    *pdo = val & 0xf0;
+    *pdo = husb238_snapshot_get_current_pdo(&regs);
     return PICO_OK;
 }
 
 
 bool husb238_connected(i2c_inst_t * i2c) {
     uint8_t in_data;
+    int r;
 
-#if I2C_TIMEOUT // timeout
-    int r = i2c_read_timeout_us(
-        i2c,
-        HUSB238_I2C_SLAVE_ADDRESS,
-        &in_data,
-        sizeof(in_data),
-        false,
-        (sizeof(in_data) + 1) * i2c_byte_timeout_us
-    );
-#else
-    int r = i2c_read_blocking(
-        i2c,
-        HUSB238_I2C_SLAVE_ADDRESS,
-        &in_data,
-        sizeof(in_data),
-        false
-    );
-#endif
-    sleep_us(100);
+    for (uint attempt = 0; ; ++attempt) {
+        husb238_transfer_wait(i2c);
+        husb238_bus_acquire(i2c, husb238_transaction_us(i2c, sizeof(in_data), 1));
+        r = husb238_i2c_read(i2c, HUSB238_I2C_SLAVE_ADDRESS, HUSB238_TRACE_NO_REG, &in_data, sizeof(in_data));
+        husb238_bus_release(i2c);
+        if (r >= PICO_OK || !husb238_retry(i2c, r, attempt)) break;
+    }
 
     if (r < PICO_OK) {
         if (r == PICO_ERROR_TIMEOUT) {
-            HUSB238_ERROR("timeout reading addr Ack from HUSB238\n");
+            HUSB238_ERROR(PROBE_TIMEOUT);
         } else {
-            HUSB238_ERROR("unknown error reading addr Ack from HUSB238\n");
+            HUSB238_ERROR(PROBE_FAILED);
         }
-        HUSB238_ERROR("HUSB238 not responding\n");
+        HUSB238_ERROR(NOT_RESPONDING);
+        husb238_cache_drop(husb238_device(i2c, false));
         return false;
     } else {
-        HUSB238_PRINT("HUSB238 found!\n");
+        HUSB238_PRINT(FOUND);
         return true;
     }
 }
 
 
-int husb238_read_register(i2c_inst_t * i2c, uint8_t reg, uint8_t * val) {
+static int husb238_bus_read_registers_held(i2c_inst_t * i2c, uint8_t reg, uint8_t * vals, size_t count, bool restart) {
     int r;
     uint8_t out_data[] = { reg };
-    uint8_t in_data[1];
-
-#if I2C_TIMEOUT
-    r = i2c_write_timeout_us(
-        i2c,
-        HUSB238_I2C_SLAVE_ADDRESS,
-        out_data,
-        sizeof(out_data),
-        false,
-        (sizeof(out_data) + 1) * i2c_byte_timeout_us
-    );
-#else
-    r = i2c_write_blocking(
-        i2c,
-        HUSB238_I2C_SLAVE_ADDRESS,
-        out_data,
-        sizeof(out_data),
-        false
-    );
-#endif
-    sleep_us(100);
 
+    r = husb238_i2c_write(i2c, HUSB238_I2C_SLAVE_ADDRESS, reg, out_data, sizeof(out_data), restart);
     if (r < (int)sizeof(out_data)) {
         if (r == PICO_ERROR_TIMEOUT) {
-            HUSB238_ERROR("timeout writing register address 0x%02x to HUSB238\n", reg);
+            HUSB238_ERROR(REG_ADDR_TIMEOUT, reg);
         } else if (r < PICO_OK) {
-            HUSB238_ERROR("unknown error writing register address 0x%02x to HUSB238\n", reg);
+            HUSB238_ERROR(REG_ADDR_FAILED, reg);
         } else {
-            HUSB238_ERROR("short write of register address 0x%02x to HUSB238: %d bytes instead of %u\n", reg, r, sizeof(out_data));
+            HUSB238_ERROR(REG_ADDR_SHORT, reg, r, sizeof(out_data));
             r = PICO_ERROR_GENERIC;
         }
         return r;
     }
-    HUSB238_PRINT("wrote register address 0x%02x\n", out_data[0]);
-
-#if I2C_TIMEOUT
-    r = i2c_read_timeout_us(
-        i2c,
-        HUSB238_I2C_SLAVE_ADDRESS,
-        in_data,
-        sizeof(in_data),
-        false,
-        (sizeof(in_data) + 1) * i2c_byte_timeout_us
-    );
-#else
-    r = i2c_read_blocking(
-        i2c,
-        HUSB238_I2C_SLAVE_ADDRESS,
-        in_data,
-        sizeof(in_data),
-        false
-    );
-#endif
-    sleep_us(100);
+    HUSB238_PRINT(REG_ADDR_WRITTEN, out_data[0]);
 
-    if (r != sizeof(in_data)) {
+    // The HUSB238 auto-increments the register address, so one read
+    // returns `count` consecutive registers starting at `reg`.
+    r = husb238_i2c_read(i2c, HUSB238_I2C_SLAVE_ADDRESS, reg, vals, count);
+    if (r != (int)count) {
         if (r == PICO_ERROR_TIMEOUT) {
-            HUSB238_ERROR("timeout reading register 0x%02x data from HUSB238\n", reg);
+            HUSB238_ERROR(READ_TIMEOUT, reg);
         } else if (r < PICO_OK) {
-            HUSB238_ERROR("unknown error reading register 0x%02x data from HUSB238\n", reg);
+            HUSB238_ERROR(READ_FAILED, reg);
         } else{
-            HUSB238_ERROR("short read of register 0x%02x data from HUSB238: %d instead of %u\n", reg, r, sizeof(in_data));
+            HUSB238_ERROR(READ_SHORT, reg, r, count);
             r = PICO_ERROR_GENERIC;
         }
         return r;
     }
 
-#if HUSB238_VERBOSE >= 2
-    for (size_t i = 0; i < sizeof(in_data); ++i) {
-        printf("    0x%02x\n", in_data[i]);
+    return PICO_OK;
+}
+
+
+// The address write and the data read are one transaction on a shared
+// bus, so nothing can move the register pointer in between.
+static int husb238_bus_read_registers_once(i2c_inst_t * i2c, uint8_t reg, uint8_t * vals, size_t count) {
+    husb238_config_t const * config = husb238_config(i2c);
+
+    // With repeated starts the read follows the register address write
+    // without a STOP in between, or a gap.
+    bool restart = config->repeated_start;
+    uint32_t duration_us = husb238_transaction_us(i2c, 1 + count, 2) + (restart ? 0 : config->gap_us);
+
+    husb238_transfer_wait(i2c);
+    husb238_bus_acquire(i2c, duration_us);
+    int r = husb238_bus_read_registers_held(i2c, reg, vals, count, restart);
+    husb238_bus_release(i2c);
+    return r;
+}
+
+
+static int husb238_bus_read_registers(i2c_inst_t * i2c, uint8_t reg, uint8_t * vals, size_t count) {
+    int r;
+
+    for (uint attempt = 0; ; ++attempt) {
+        r = husb238_bus_read_registers_once(i2c, reg, vals, count);
+        if (r == PICO_OK || !husb238_retry(i2c, r, attempt)) break;
     }
-#endif
-    *val = in_data[0];
+    return r;
+}
+
+
+// Update what we know about the device from freshly read registers
+// [reg, reg + count), and fill the cache from them if they're
+// trustworthy.
+static void husb238_observe(husb238_device_t * dev, uint8_t reg, uint8_t const * vals, size_t count) {
+    uint16_t mask = husb238_reg_mask(reg, count);
+
+    if (mask & (1 << HUSB238_I2C_REG_PD_STATUS1)) {
+        husb238_pd_status1_t status1 = husb238_decode_pd_status1(vals[HUSB238_I2C_REG_PD_STATUS1 - reg]);
+        int attached = status1.attached ? 1 : 0;
+        if (attached != dev->attached) {
+            // A source was plugged in or unplugged, its PDOs are no
+            // longer what we have cached.
+            husb238_cache_drop(dev);
+            dev->attached = attached;
+        }
+        if (status1.pd_response != HUSB238_PD_RESPONSE_NONE) {
+            dev->command_pending = false;
+        }
+    }
+
+    // The SRC_PDO registers are only trustworthy once the HUSB238 has a
+    // contract with the source, and isn't in the middle of a command
+    // that may change them.
+    bool fill = dev->cache_enabled && !dev->command_pending && dev->attached == 1;
+    if (mask & (1 << HUSB238_I2C_REG_PD_STATUS0)) {
+        fill = fill && husb238_decode_pd_status0(vals[HUSB238_I2C_REG_PD_STATUS0 - reg]).mv != 0;
+    } else {
+        fill = false;
+    }
+    if (fill) {
+        for (size_t i = 0; i < count; ++i) {
+            dev->cache[reg + i] = vals[i];
+        }
+        dev->cache_valid |= mask & HUSB238_CACHEABLE_REGS;
+    }
+}
+
+
+int husb238_read_registers(i2c_inst_t * i2c, uint8_t reg, uint8_t * vals, size_t count) {
+    husb238_device_t * dev = husb238_device(i2c, false);
+    uint16_t mask = husb238_reg_mask(reg, count);
+    int r;
+
+    if (dev == NULL) {
+        return husb238_bus_read_registers(i2c, reg, vals, count);
+    }
+
+    if (dev->cache_enabled && (mask & HUSB238_CACHEABLE_REGS) == mask) {
+        if ((dev->cache_valid & mask) == mask) {
+            dev->cache_stats.hits++;
+            for (size_t i = 0; i < count; ++i) {
+                vals[i] = dev->cache[reg + i];
+            }
+            return PICO_OK;
+        }
+
+        // Miss.  Read the whole register file (still one transfer) so
+        // the status registers can vouch for the PDO registers before
+        // they go in the cache.
+        dev->cache_stats.misses++;
+        husb238_registers_t regs;
+        r = husb238_bus_read_registers(i2c, HUSB238_I2C_REG_PD_STATUS0, (uint8_t *)&regs, sizeof(regs));
+        if (r != PICO_OK) {
+            husb238_cache_drop(dev);
+            return r;
+        }
+        husb238_observe(dev, HUSB238_I2C_REG_PD_STATUS0, (uint8_t *)&regs, sizeof(regs));
+        for (size_t i = 0; i < count; ++i) {
+            vals[i] = ((uint8_t *)&regs)[reg + i];
+        }
+        return PICO_OK;
+    }
+
+    r = husb238_bus_read_registers(i2c, reg, vals, count);
+    if (r != PICO_OK) {
+        husb238_cache_drop(dev);
+        return r;
+    }
+    husb238_observe(dev, reg, vals, count);
     return PICO_OK;
 }
 
 
-int husb238_write_register(i2c_inst_t * i2c, uint8_t reg, uint8_t val) {
+int husb238_read_register(i2c_inst_t * i2c, uint8_t reg, uint8_t * val) {
+    uint64_t start_us = husb238_get_hal()->time_us();
+    int r = husb238_read_registers(i2c, reg, val, 1);
+    husb238_trace_op(HUSB238_OP_READ_REGISTER, husb238_get_hal()->time_us() - start_us);
+    return r;
+}
+
+
+int husb238_read_snapshot(i2c_inst_t * i2c, husb238_registers_t * regs) {
+    static_assert(sizeof(husb238_registers_t) == HUSB238_I2C_REG_GO_COMMAND + 1);
+    return husb238_read_registers(i2c, HUSB238_I2C_REG_PD_STATUS0, (uint8_t *)regs, sizeof(*regs));
+}
+
+
+// Write `count` consecutive registers starting at `reg` in one transfer.
+static int husb238_write_registers_once(i2c_inst_t * i2c, uint8_t reg, uint8_t const * vals, size_t count) {
     int r;
-    uint8_t out_data[] = { reg, val };
+    uint8_t out_data[1 + HUSB238_I2C_REG_GO_COMMAND + 1];
 
-#if I2C_TIMEOUT
-    r = i2c_write_timeout_us(
-        i2c,
-        HUSB238_I2C_SLAVE_ADDRESS,
-        out_data,
-        sizeof(out_data),
-        false,
-        (sizeof(out_data) + 1) * i2c_byte_timeout_us
-    );
-#else
-    r = i2c_write_blocking(
-        i2c,
-        HUSB238_I2C_SLAVE_ADDRESS,
-        out_data,
-        sizeof(out_data),
-        false
-    );
-#endif
-    sleep_us(100);
+    out_data[0] = reg;
+    memcpy(&out_data[1], vals, count);
+    husb238_transfer_wait(i2c);
+    husb238_bus_acquire(i2c, husb238_transaction_us(i2c, 1 + count, 1));
+    r = husb238_i2c_write(i2c, HUSB238_I2C_SLAVE_ADDRESS, reg, out_data, 1 + count, false);
+    husb238_bus_release(i2c);
 
     if (r < PICO_OK) {
         if (r == PICO_ERROR_TIMEOUT) {
-            HUSB238_ERROR("timeout writing register on HUSB238\n");
+            HUSB238_ERROR(WRITE_TIMEOUT, reg);
         } else {
-            HUSB238_ERROR("unknown error writing register on HUSB238\n");
+            HUSB238_ERROR(WRITE_FAILED, reg);
         }
         return r;
     }
-    if (r != sizeof(out_data)) {
-        HUSB238_ERROR("short write to register 0x%02x on HUSB238 (data 0x%02x): %d\n", reg, val, r);
+    if (r != (int)(1 + count)) {
+        HUSB238_ERROR(WRITE_SHORT, reg, vals[0], r);
         return PICO_ERROR_GENERIC;
     }
-    HUSB238_PRINT("wrote 0x%02x to register address 0x%02x\n", out_data[1], out_data[0]);
+    for (size_t i = 0; i < count; ++i) {
+        HUSB238_PRINT(WRITTEN, vals[i], reg + i);
+    }
     return PICO_OK;
 }
 
 
-int husb238_reset(i2c_inst_t * i2c) {
+static int husb238_write_registers(i2c_inst_t * i2c, uint8_t reg, uint8_t const * vals, size_t count) {
+    int r;
+    bool go = husb238_reg_mask(reg, count) & (1 << HUSB238_I2C_REG_GO_COMMAND);
+
+    // Writing SRC_PDO or issuing any command (SELECT_PDO, GET_SRC_CAP,
+    // HARD_RESET) may change the cached registers.
+    husb238_device_t * dev = husb238_device(i2c, false);
+    if (dev != NULL) {
+        husb238_cache_drop(dev);
+        if (go) {
+            uint8_t command = vals[HUSB238_I2C_REG_GO_COMMAND - reg];
+            dev->command_pending = (command != HUSB238_CMD_HARD_RESET);
+        }
+    }
+
+    // A command write that failed may still have reached the chip, and
+    // sending it again would issue the command twice: leave it to the
+    // caller.
+    for (uint attempt = 0; ; ++attempt) {
+        r = husb238_write_registers_once(i2c, reg, vals, count);
+        if (r == PICO_OK || go || !husb238_retry(i2c, r, attempt)) break;
+    }
+    return r;
+}
+
+
+int husb238_write_register(i2c_inst_t * i2c, uint8_t reg, uint8_t val) {
+    uint64_t start_us = husb238_get_hal()->time_us();
+    int r = husb238_write_registers(i2c, reg, &val, 1);
+    husb238_trace_op(HUSB238_OP_WRITE_REGISTER, husb238_get_hal()->time_us() - start_us);
+    return r;
+}
+
+
+void husb238_batch_init(husb238_batch_t * batch) {
+    batch->count = 0;
+}
+
+
+static int husb238_batch_add(husb238_batch_t * batch, bool write, uint8_t reg, uint8_t val) {
+    if (reg > HUSB238_I2C_REG_GO_COMMAND) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+    if (batch->count >= HUSB238_BATCH_MAX_OPS) {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+    husb238_batch_op_t * op = &batch->ops[batch->count];
+    op->write = write;
+    op->reg = reg;
+    op->val = val;
+    op->result = PICO_ERROR_NO_DATA;
+    return batch->count++;
+}
+
+
+int husb238_batch_write(husb238_batch_t * batch, uint8_t reg, uint8_t val) {
+    return husb238_batch_add(batch, true, reg, val);
+}
+
+
+int husb238_batch_read(husb238_batch_t * batch, uint8_t reg) {
+    return husb238_batch_add(batch, false, reg, 0);
+}
+
+
+//
+// Run ops [first, last] of a batch as one transfer (plus a register
+// address write for reads).  Writes must address consecutive registers
+// in order; reads may come in any order, and are served from one read
+// of the registers they span.
+//
+static int husb238_batch_transfer(i2c_inst_t * i2c, husb238_batch_t * batch, size_t first, size_t last) {
+    husb238_batch_op_t * ops = batch->ops;
+    uint8_t vals[HUSB238_I2C_REG_GO_COMMAND + 1];
+    uint8_t lo = ops[first].reg;
+    uint8_t hi = ops[first].reg;
+    int r;
+
+    for (size_t i = first; i <= last; ++i) {
+        lo = ops[i].reg < lo ? ops[i].reg : lo;
+        hi = ops[i].reg > hi ? ops[i].reg : hi;
+    }
+
+    if (ops[first].write) {
+        for (size_t i = first; i <= last; ++i) {
+            vals[ops[i].reg - lo] = ops[i].val;
+        }
+        r = husb238_write_registers(i2c, lo, vals, hi - lo + 1);
+    } else {
+        r = husb238_read_registers(i2c, lo, vals, hi - lo + 1);
+    }
+
+    for (size_t i = first; i <= last; ++i) {
+        if (r == PICO_OK && !ops[i].write) {
+            ops[i].val = vals[ops[i].reg - lo];
+        }
+        ops[i].result = r;
+    }
+    return r;
+}
+
+
+int husb238_batch_run(i2c_inst_t * i2c, husb238_batch_t * batch) {
+    husb238_batch_op_t * ops = batch->ops;
+    size_t first = 0;
+
+    for (size_t i = 0; i < batch->count; ++i) {
+        ops[i].result = PICO_ERROR_NO_DATA;
+    }
+
+    while (first < batch->count) {
+        // Extend the run while the next op can share its transfer: the
+        // next register up for writes, any register for reads.
+        size_t last = first;
+        while (last + 1 < batch->count && ops[last + 1].write == ops[first].write
+            && (!ops[first].write || ops[last + 1].reg == ops[last].reg + 1)) {
+            last++;
+        }
+
+        int r = husb238_batch_transfer(i2c, batch, first, last);
+        if (r != PICO_OK) {
+            // Later ops may depend on this one (a command on the
+            // SRC_PDO it wrote, say), so they don't run.
+            return r;
+        }
+        first = last + 1;
+    }
+    return PICO_OK;
+}
+
+
+static husb238_reset_stats_t husb238_reset_stats = {};
+
+
+static void husb238_record_reset(uint32_t elapsed_us, bool timeout) {
+    husb238_reset_stats_t * stats = &husb238_reset_stats;
+
+    husb238_trace_op(HUSB238_OP_RESET, elapsed_us);
+    if (timeout) {
+        stats->timeouts++;
+        return;
+    }
+
+    if (stats->resets == 0 || elapsed_us < stats->min_us) {
+        stats->min_us = elapsed_us;
+    }
+    if (elapsed_us > stats->max_us) {
+        stats->max_us = elapsed_us;
+    }
+    stats->resets++;
+    stats->last_us = elapsed_us;
+    stats->total_us += elapsed_us;
+
+    uint32_t bucket = elapsed_us / (HUSB238_RESET_HISTOGRAM_BUCKET_MS * 1000);
+    if (bucket >= HUSB238_RESET_HISTOGRAM_BUCKETS) {
+        bucket = HUSB238_RESET_HISTOGRAM_BUCKETS - 1;
+    }
+    stats->histogram[bucket]++;
+}
+
+
+// Whether the HUSB238 answers on the bus, is attached, and has a
+// USB-PD contract with the source.
+typedef struct {
+    bool connected;
+    bool attached;
+    bool contract;
+} husb238_reset_state_t;
+
+static husb238_reset_state_t husb238_reset_state(i2c_inst_t * i2c) {
+    husb238_reset_state_t state = {};
+    uint8_t status[2];
+
+    if (!husb238_connected(i2c)) {
+        return state;
+    }
+    if (husb238_read_registers(i2c, HUSB238_I2C_REG_PD_STATUS0, status, sizeof(status)) != PICO_OK) {
+        return state;
+    }
+    state.connected = true;
+    state.attached = husb238_attached(status[1]);
+    state.contract = husb238_decode_pd_status0(status[0]).mv != 0;
+    return state;
+}
+
+
+int husb238_reset_begin(i2c_inst_t * i2c, husb238_reset_t * op, husb238_reset_config_t const * config) {
+    static husb238_reset_config_t const default_config = {
+        .deadline_ms = HUSB238_RESET_DEADLINE_MS,
+        .backoff_min_us = 1000,
+        .backoff_max_us = 50 * 1000,
+        .down_window_us = HUSB238_RESET_DOWN_WINDOW_US,
+        .wait_for_contract = false,
+    };
+
+    op->config = config != NULL ? *config : default_config;
+    if (op->config.down_window_us == 0) {
+        op->config.down_window_us = HUSB238_RESET_DOWN_WINDOW_US;
+    }
+    op->busy = false;
+    op->elapsed_us = 0;
+
     int r = husb238_write_register(i2c, HUSB238_I2C_REG_GO_COMMAND, HUSB238_CMD_HARD_RESET);
     if (r != PICO_OK) {
         return r;
     }
 
-    // It takes the HUSB238 about 1500 ms to come out of reset.  1000 ms
-    // is not enough.
-    sleep_ms(1500);
+    op->busy = true;
+    op->down = false;
+    op->start_us = husb238_get_hal()->time_us();
+    op->next_us = op->start_us;
+    op->backoff_us = op->config.backoff_min_us;
+    return PICO_OK;
+}
+
+
+static void husb238_reset_back_off(husb238_reset_t * op) {
+    op->backoff_us *= 2;
+    if (op->backoff_us > op->config.backoff_max_us) {
+        op->backoff_us = op->config.backoff_max_us;
+    }
+}
+
+
+int husb238_reset_poll(i2c_inst_t * i2c, husb238_reset_t * op) {
+    husb238_hal_t const * hal = husb238_get_hal();
+
+    if (!op->busy) {
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+
+    // The HUSB238 keeps answering with its old state until the source
+    // acts on the hard reset.  Wait until it's seen to go down (off the
+    // bus, detached, or without a contract); if it never is, there's no
+    // telling whether the reset happened at all.
+    husb238_reset_state_t state = husb238_reset_state(i2c);
+    if (!op->down) {
+        if (state.connected && state.attached && state.contract) {
+            uint64_t now = hal->time_us();
+            if (now >= op->start_us + op->config.down_window_us) {
+                HUSB238_ERROR(RESET_NOT_DOWN, op->config.down_window_us);
+                husb238_trace_op(HUSB238_OP_RESET, now - op->start_us);
+                husb238_reset_stats.not_down++;
+                op->busy = false;
+                return PICO_ERROR_IO;
+            }
+            op->next_us = now + op->backoff_us;
+            husb238_reset_back_off(op);
+            return HUSB238_IN_PROGRESS;
+        }
+        op->down = true;
+        op->backoff_us = op->config.backoff_min_us;
+        op->next_us = hal->time_us() + op->backoff_us;
+        return HUSB238_IN_PROGRESS;
+    }
+
+    // It used to take a fixed 1500 ms sleep for the HUSB238 to come out
+    // of reset, because 1000 ms was sometimes not enough.  Poll with
+    // exponential backoff instead, so we're done as soon as it's back.
+    bool done = state.connected && state.attached && (state.contract || !op->config.wait_for_contract);
+    if (!done) {
+        uint64_t now = hal->time_us();
+        uint64_t deadline = op->start_us + (uint64_t)op->config.deadline_ms * 1000;
+        if (now >= deadline) {
+            HUSB238_ERROR(RESET_TIMEOUT, op->config.deadline_ms);
+            husb238_record_reset(now - op->start_us, true);
+            op->busy = false;
+            return PICO_ERROR_TIMEOUT;
+        }
+        op->next_us = now + (op->backoff_us < deadline - now ? op->backoff_us : deadline - now);
+        husb238_reset_back_off(op);
+        return HUSB238_IN_PROGRESS;
+    }
+
+    op->elapsed_us = hal->time_us() - op->start_us;
+    op->busy = false;
+    husb238_record_reset(op->elapsed_us, false);
+    HUSB238_PRINT(RESET_DONE, op->elapsed_us);
+    return PICO_OK;
+}
+
+
+int husb238_reset_wait(i2c_inst_t * i2c, husb238_reset_config_t const * config, uint32_t * elapsed_us) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    husb238_reset_t op;
+
+    int r = husb238_reset_begin(i2c, &op, config);
+    if (r != PICO_OK) {
+        return r;
+    }
+    while ((r = husb238_reset_poll(i2c, &op)) == HUSB238_IN_PROGRESS) {
+        uint64_t now = hal->time_us();
+        if (op.next_us > now) {
+            hal->sleep_us(op.next_us - now);
+        }
+    }
+    if (r == PICO_OK && elapsed_us != NULL) {
+        *elapsed_us = op.elapsed_us;
+    }
+    return r;
+}
+
+
+int husb238_reset(i2c_inst_t * i2c) {
+    return husb238_reset_wait(i2c, NULL, NULL);
+}
+
+
+void husb238_get_reset_stats(husb238_reset_stats_t * stats) {
+    *stats = husb238_reset_stats;
+}
+
+
+void husb238_clear_reset_stats(void) {
+    husb238_reset_stats = {};
+}
+
+
+// Write the control register of the mux at `mux_addr`.
+static int husb238_mux_write(i2c_inst_t * i2c, uint8_t mux_addr, uint8_t channels) {
+    int r;
+
+    for (uint attempt = 0; ; ++attempt) {
+        husb238_transfer_wait(i2c);
+        husb238_bus_acquire(i2c, husb238_transaction_us(i2c, sizeof(channels), 1));
+        r = husb238_i2c_write(i2c, mux_addr, HUSB238_TRACE_NO_REG, &channels, sizeof(channels), false);
+        husb238_bus_release(i2c);
+        if (r == sizeof(channels) || !husb238_retry(i2c, r, attempt)) break;
+    }
+
+    if (r != sizeof(channels)) {
+        HUSB238_ERROR(MUX_WRITE_FAILED, channels, mux_addr, r);
+        return r < PICO_OK ? r : PICO_ERROR_GENERIC;
+    }
+    return PICO_OK;
+}
+
+
+// Route the bus to `port`.  Sets *switched if any mux had to be
+// written.
+static int husb238_mux_route(husb238_port_t const * port, bool * switched) {
+    int r;
+
+    *switched = false;
+    if (port->mux_addr != HUSB238_NO_MUX && port->mux_channel >= HUSB238_MUX_CHANNELS) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    husb238_bus_t * bus = husb238_bus(port->i2c, true);
+    if (bus == NULL) {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+
+    if (bus->known && bus->mux_addr == port->mux_addr) {
+        if (port->mux_addr == HUSB238_NO_MUX || bus->mux_channel == port->mux_channel) {
+            return PICO_OK;
+        }
+    }
+
+    *switched = true;
+
+    // Only one mux may have a channel enabled, or two HUSB238s would
+    // answer at 0x08 at once.
+    if (bus->known && bus->mux_addr != HUSB238_NO_MUX && bus->mux_addr != port->mux_addr) {
+        bus->known = false;
+        r = husb238_mux_write(port->i2c, bus->mux_addr, 0x00);
+        if (r != PICO_OK) return r;
+    }
+
+    bus->known = false;
+    if (port->mux_addr != HUSB238_NO_MUX) {
+        r = husb238_mux_write(port->i2c, port->mux_addr, 1 << port->mux_channel);
+        if (r != PICO_OK) return r;
+    }
+
+    bus->known = true;
+    bus->mux_addr = port->mux_addr;
+    bus->mux_channel = port->mux_addr == HUSB238_NO_MUX ? 0 : port->mux_channel;
+    return PICO_OK;
+}
+
+
+int husb238_port_select(husb238_port_t const * port) {
+    bool switched;
+    return husb238_mux_route(port, &switched);
+}
+
+
+// Order ports by bus, then mux, then channel, so a scan visits each
+// channel once.
+static bool husb238_port_before(husb238_port_t const * a, husb238_port_t const * b) {
+    if (a->i2c != b->i2c) return (uintptr_t)a->i2c < (uintptr_t)b->i2c;
+    if (a->mux_addr != b->mux_addr) return a->mux_addr < b->mux_addr;
+    return a->mux_channel < b->mux_channel;
+}
+
+
+int husb238_scan(husb238_port_t const ports[], size_t n, husb238_port_status_t status[], husb238_scan_stats_t * stats) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    uint16_t order[HUSB238_SCAN_MAX_PORTS];
+    husb238_scan_stats_t local_stats = {};
+    int result = PICO_OK;
+
+    if (n > HUSB238_SCAN_MAX_PORTS) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // Insertion sort, n is small.
+    for (size_t i = 0; i < n; ++i) {
+        size_t j = i;
+        while (j > 0 && husb238_port_before(&ports[i], &ports[order[j - 1]])) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = i;
+    }
+
+    uint64_t sweep_start = hal->time_us();
+
+    for (size_t i = 0; i < n; ++i) {
+        husb238_port_t const * port = &ports[order[i]];
+        husb238_port_status_t * st = &status[order[i]];
+        bool switched;
+        int r;
+
+        *st = {};
+
+        uint64_t mux_start = hal->time_us();
+        r = husb238_mux_route(port, &switched);
+        if (switched) {
+            local_stats.mux_switches++;
+            local_stats.mux_us += hal->time_us() - mux_start;
+        }
+
+        // One transfer gets everything there is to know about the port.
+        if (r == PICO_OK) {
+            r = husb238_read_snapshot(port->i2c, &st->regs);
+        }
+
+        st->result = r;
+        if (r != PICO_OK) {
+            result = r;
+            continue;
+        }
+
+        st->attached = husb238_attached(st->regs.pd_status1);
+        st->current_pdo = husb238_snapshot_get_current_pdo(&st->regs);
+        husb238_snapshot_get_contract_mv_ma(&st->regs, &st->mv, &st->ma);
+        husb238_snapshot_get_pdos_fixed(&st->regs, st->pdos);
+    }
+
+    local_stats.ports = n;
+    local_stats.sweep_us = hal->time_us() - sweep_start;
+    if (stats != NULL) {
+        *stats = local_stats;
+    }
+    return result;
+}
+
+
+int husb238_configure(i2c_inst_t * i2c, husb238_config_t const * config) {
+    if (config->baudrate == 0) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+    husb238_device_t * dev = husb238_device(i2c, true);
+    if (dev == NULL) {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+    dev->config = *config;
+    return PICO_OK;
+}
+
+
+void husb238_get_config(i2c_inst_t * i2c, husb238_config_t * config) {
+    *config = *husb238_config(i2c);
+}
+
+
+void husb238_get_bus_stats(i2c_inst_t * i2c, husb238_bus_stats_t * stats) {
+    husb238_device_t * dev = husb238_device(i2c, false);
+    if (dev == NULL) {
+        *stats = {};
+        return;
+    }
+    *stats = dev->bus_stats;
+}
+
+
+// Hammer the HUSB238 with `transfers` full register reads, and check
+// they all succeed and agree on the (static) PDO registers.
+// No retries: a transfer that only works the second time means the gap
+// is too short.
+static bool husb238_soak(i2c_inst_t * i2c, uint transfers) {
+    husb238_registers_t reference;
+    husb238_registers_t regs;
+
+    if (husb238_bus_read_registers_once(i2c, HUSB238_I2C_REG_PD_STATUS0, (uint8_t *)&reference, sizeof(reference)) != PICO_OK) {
+        return false;
+    }
+    for (uint i = 0; i < transfers; ++i) {
+        if (husb238_bus_read_registers_once(i2c, HUSB238_I2C_REG_PD_STATUS0, (uint8_t *)&regs, sizeof(regs)) != PICO_OK) {
+            return false;
+        }
+        if (memcmp(regs.src_pdos, reference.src_pdos, sizeof(regs.src_pdos)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int husb238_calibrate_gap(i2c_inst_t * i2c, uint transfers, uint * gap_us) {
+    static uint const candidate_gap_us[] = { 0, 5, 10, 20, 50, 100, 200, 500, 1000 };
+
+    husb238_device_t * dev = husb238_device(i2c, true);
+    if (dev == NULL) {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+    uint original_gap_us = dev->config.gap_us;
+
+    for (size_t i = 0; i < sizeof(candidate_gap_us) / sizeof(candidate_gap_us[0]); ++i) {
+        dev->config.gap_us = candidate_gap_us[i];
+        if (husb238_soak(i2c, transfers)) {
+            HUSB238_PRINT(GAP_CALIBRATED, dev->config.gap_us);
+            if (gap_us != NULL) {
+                *gap_us = dev->config.gap_us;
+            }
+            return PICO_OK;
+        }
+        HUSB238_ERROR(SOAK_FAILED, dev->config.gap_us);
+
+        // Give the bus and the HUSB238 a moment to settle after the
+        // failure before trying a longer gap.
+        husb238_get_hal()->sleep_us(10 * 1000);
+    }
+
+    dev->config.gap_us = original_gap_us;
+    return PICO_ERROR_IO;
+}
+
+
+int husb238_cache_enable(i2c_inst_t * i2c, bool enable) {
+    husb238_device_t * dev = husb238_device(i2c, enable);
+    if (dev == NULL) {
+        return enable ? PICO_ERROR_INSUFFICIENT_RESOURCES : PICO_OK;
+    }
+    husb238_cache_drop(dev);
+    dev->cache_enabled = enable;
     return PICO_OK;
 }
 
 
+void husb238_cache_invalidate(i2c_inst_t * i2c) {
+    husb238_cache_drop(husb238_device(i2c, false));
+}
+
+
+void husb238_get_cache_stats(i2c_inst_t * i2c, husb238_cache_stats_t * stats) {
+    husb238_device_t * dev = husb238_device(i2c, false);
+    if (dev == NULL) {
+        *stats = {};
+        return;
+    }
+    *stats = dev->cache_stats;
+}
+
+
 int husb238_get_src_cap(i2c_inst_t * i2c) {
     return husb238_write_register(i2c, HUSB238_I2C_REG_GO_COMMAND, HUSB238_CMD_GET_SRC_CAP);
 }
 
 
+int husb238_select_pdo_begin(i2c_inst_t * i2c, husb238_select_t * op, int pdo) {
+    int r;
+
+    op->pdo = pdo;
+    op->busy = false;
+    op->pd_response = HUSB238_PD_RESPONSE_NONE;
+    op->latency_us = 0;
+    if (op->timeout_us == 0) {
+        op->timeout_us = HUSB238_SELECT_PDO_TIMEOUT_US;
+    }
+
+    // SRC_PDO and GO_COMMAND are adjacent, so this is one transfer.
+    husb238_batch_t batch;
+    husb238_batch_init(&batch);
+    husb238_batch_write(&batch, HUSB238_I2C_REG_SRC_PDO, pdo);
+    husb238_batch_write(&batch, HUSB238_I2C_REG_GO_COMMAND, HUSB238_CMD_SELECT_PDO);
+
+    // The HUSB238 clears PD_RESPONSE when it accepts the command, and
+    // sets it again when the negotiation with the source finishes (see
+    // husb238_poll()).
+    op->start_us = husb238_get_hal()->time_us();
+    r = husb238_batch_run(i2c, &batch);
+    if (r != PICO_OK) return r;
+
+    op->busy = true;
+    return PICO_OK;
+}
+
+
+// The HUSB238 has reported how a SELECT_PDO went.
+static void husb238_select_done(husb238_select_t * op) {
+    op->busy = false;
+    husb238_trace_op(HUSB238_OP_SELECT_PDO, op->latency_us);
+}
+
+
+int husb238_poll(i2c_inst_t * i2c, husb238_select_t * op) {
+    int r;
+    uint8_t val;
+
+    if (!op->busy) {
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+
+    r = husb238_read_pd_status1(i2c, &val);
+    uint64_t now = husb238_get_hal()->time_us();
+    if (r != PICO_OK) {
+        op->busy = false;
+        return r;
+    }
+
+    op->pd_response = husb238_pd_response(val);
+    op->latency_us = now - op->start_us;
+
+    //
+    // The driver takes the HUSB238 to clear PD_RESPONSE as soon as it
+    // accepts a GO_COMMAND, so no read after the command sees the last
+    // command's outcome.  The datasheet doesn't say either way; this is
+    // the one model of it the whole driver uses, along with the DMA
+    // path, the register cache (husb238_observe()) and the simulator.
+    //
+    switch (op->pd_response) {
+        case HUSB238_PD_RESPONSE_NONE:
+            if (op->latency_us > op->timeout_us) {
+                HUSB238_ERROR(SELECT_TIMEOUT, op->pdo);
+                husb238_select_done(op);
+                return PICO_ERROR_TIMEOUT;
+            }
+            return HUSB238_IN_PROGRESS;
+
+        case HUSB238_PD_RESPONSE_SUCCESS:
+            HUSB238_PRINT(SELECTED, op->pdo, op->latency_us);
+            husb238_select_done(op);
+            return PICO_OK;
+
+        case HUSB238_PD_RESPONSE_TRANSACTION_FAIL:
+            HUSB238_ERROR(SELECT_FAILED, op->pdo);
+            husb238_select_done(op);
+            return PICO_ERROR_IO;
+
+        default:
+            HUSB238_ERROR(SELECT_REJECTED, op->pdo, op->pd_response);
+            husb238_select_done(op);
+            return PICO_ERROR_INVALID_ARG;
+    }
+}
+
+
 // Select the PDO with the specified PDO ID (one of the HUSB238_SRC_PDO_* constants).
 // Returns PICO_OK if all went well, some PICO_* error on failure.
 int husb238_select_pdo(i2c_inst_t * i2c, int pdo) {
     int r;
+    husb238_select_t op = {};
 
-    r = husb238_write_register(i2c, HUSB238_I2C_REG_SRC_PDO, pdo);
+    r = husb238_select_pdo_begin(i2c, &op, pdo);
     if (r != PICO_OK) return r;
 
-    r = husb238_write_register(i2c, HUSB238_I2C_REG_GO_COMMAND, HUSB238_CMD_SELECT_PDO);
-    if (r != PICO_OK) return r;
-
-    // It takes the HUSB238 a little while to update its registers to
-    // match this command.
-    sleep_ms(5);
-
-    return PICO_OK;
+    while ((r = husb238_poll(i2c, &op)) == HUSB238_IN_PROGRESS) {
+        husb238_get_hal()->sleep_us(HUSB238_SELECT_PDO_POLL_US);
+    }
+    return r;
 }
 
 
 float husb238_pdo_max_current(uint8_t pdo) {
-    int detected = pdo & 0x80;
-    if (!detected) {
+    husb238_src_pdo_reg_t p = husb238_decode_src_pdo_reg(pdo);
+    if (!p.detected) {
         return -1.0;
     }
+    return p.max_ma / 1000.0f;
+}
 
-    float max_current[] = {
-        0.50,
-        0.70,
-        1.00,
-        1.25,
-        1.50,
-        1.75,
-        2.00,
-        2.25,
-        2.50,
-        2.75,
-        3.00,
-        3.25,
-        3.50,
-        4.00,
-        4.50,
-        5.00
-    };
 
-    int c = pdo & 0x0f;
-    return max_current[c];
+uint16_t husb238_pdo_max_current_ma(uint8_t pdo) {
+    return husb238_decode_src_pdo_reg(pdo).max_ma;
 }
 
 
-int husb238_dump_registers(i2c_inst_t * i2c) {
+void husb238_print_snapshot(husb238_registers_t const * regs) {
     uint8_t val;
-    int r;
 
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_PD_STATUS0, &val);
-    if (r != PICO_OK) return r;
+    val = regs->pd_status0;
     printf("PD_STATUS0: 0x%02x\n", val);
 
-    int voltage_index = val >> 4;
-    printf("    PD source providing %d V\n", husb238_pd_src_voltage[voltage_index]);
-
-    int current_index = val & 0x0f;
-    printf("    PD source max current %0.2f A\n", husb238_pd_src_current[current_index]);
+    int volts;
+    float max_current;
+    husb238_snapshot_get_contract(regs, volts, max_current);
+    printf("    PD source providing %d V\n", volts);
+    printf("    PD source max current %0.2f A\n", max_current);
 
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_PD_STATUS1, &val);
-    if (r != PICO_OK) return r;
+    val = regs->pd_status1;
     printf("PD_STATUS1: 0x%02x\n", val);
 
-    if (val & 0x80) {
-        printf("    CC_DIR: CC1 is connected to CC, or unattached mode\n");
-    } else {
+    husb238_pd_status1_t status1 = husb238_decode_pd_status1(val);
+    if (status1.cc2) {
         printf("    CC_DIR: CC2 is connected to CC\n");
+    } else {
+        printf("    CC_DIR: CC1 is connected to CC, or unattached mode\n");
     }
 
-    if (val & 0x40) {
-        printf("    ATTACH: unattached mode\n");
-    } else {
+    if (status1.attached) {
         printf("    ATTACH: attached mode\n");
+    } else {
+        printf("    ATTACH: unattached mode\n");
     }
 
-    int pd_response_index = (val & 0x38) >> 3;
-    char const * const pd_response_str[] = {
-        "no response",
-        "success",
-        "(reserved)",
-        "invalid command or argument",
-        "command not supported",
-        "transaction fail, no GoodCRC received after sending",
-        "(reserved)",
-        "(reserved)"
-    };
-    printf("    PD response: %s\n", pd_response_str[pd_response_index]);
+    printf("    PD response: %s\n", husb238_pd_response_str(status1.pd_response));
 
-    if (val & 0x04) {
+    if (status1.contract_5v) {
         printf("    5V contract voltage: 5V\n");
     } else {
         printf("    5V contract voltage: unknown voltage, not 5V\n");
     }
 
-    int current_5v_index = val & 0x03;
-    float current_5v[] = { 0.0, 1.5, 2.4, 3.0 };
-    printf("    5V contract max current: %0.2f A\n", current_5v[current_5v_index]);
-
-
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_SRC_PDO_5V, &val);
-    if (r != PICO_OK) return r;
-    printf("SRC_PDO_5V: 0x%02x (%s, %0.2fA max)\n", val, val & 0x80 ? "detected" : "not detected", husb238_pdo_max_current(val));
-
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_SRC_PDO_9V, &val);
-    if (r != PICO_OK) return r;
-    printf("SRC_PDO_9V: 0x%02x (%s, %0.2fA max)\n", val, val & 0x80 ? "detected" : "not detected", husb238_pdo_max_current(val));
+    printf("    5V contract max current: %0.2f A\n", status1.ma_5v / 1000.0);
 
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_SRC_PDO_12V, &val);
-    if (r != PICO_OK) return r;
-    printf("SRC_PDO_12V: 0x%02x (%s, %0.2fA max)\n", val, val & 0x80 ? "detected" : "not detected", husb238_pdo_max_current(val));
-
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_SRC_PDO_15V, &val);
-    if (r != PICO_OK) return r;
-    printf("SRC_PDO_15V: 0x%02x (%s, %0.2fA max)\n", val, val & 0x80 ? "detected" : "not detected", husb238_pdo_max_current(val));
-
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_SRC_PDO_18V, &val);
-    if (r != PICO_OK) return r;
-    printf("SRC_PDO_18V: 0x%02x (%s, %0.2fA max)\n", val, val & 0x80 ? "detected" : "not detected", husb238_pdo_max_current(val));
-
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_SRC_PDO_20V, &val);
-    if (r != PICO_OK) return r;
-    printf("SRC_PDO_20V: 0x%02x (%s, %0.2fA max)\n", val, val & 0x80 ? "detected" : "not detected", husb238_pdo_max_current(val));
+    char const * const src_pdo_names[] = { "5V", "9V", "12V", "15V", "18V", "20V" };
+    for (int i = 0; i < 6; ++i) {
+        val = regs->src_pdos[i];
+        printf("SRC_PDO_%s: 0x%02x (%s, %0.2fA max)\n", src_pdo_names[i], val, husb238_decode_src_pdo_reg(val).detected ? "detected" : "not detected", husb238_pdo_max_current(val));
+    }
 
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_SRC_PDO, &val);
-    if (r != PICO_OK) return r;
+    val = regs->src_pdo;
     printf("SRC_PDO: 0x%02x\n", val);
-    switch (val & 0xf0) {
+    switch (husb238_snapshot_get_current_pdo(regs)) {
         case HUSB238_SRC_PDO_NONE:
             printf("    no PDO selected\n");
             break;
@@ -480,10 +1437,18 @@ int husb238_dump_registers(i2c_inst_t * i2c) {
             break;
     }
 
-    r = husb238_read_register(i2c, HUSB238_I2C_REG_GO_COMMAND, &val);
+    printf("GO_COMMAND: 0x%02x\n", regs->go_command);
+}
+
+
+int husb238_dump_registers(i2c_inst_t * i2c) {
+    husb238_registers_t regs;
+    int r;
+
+    r = husb238_read_snapshot(i2c, &regs);
     if (r != PICO_OK) return r;
-    printf("GO_COMMAND: 0x%02x\n", val);
 
+    husb238_print_snapshot(&regs);
     return PICO_OK;
 }
 
@@ -0,0 +1,180 @@
+#include <pico/critical_section.h>
+
+#include "husb238_arbiter.h"
+#include "husb238_hal.h"
+
+
+void husb238_arbiter_init(husb238_arbiter_t * arb) {
+    *arb = {};
+    critical_section_init(&arb->lock);
+    arb->stats.since_us = husb238_get_hal()->time_us();
+}
+
+
+void husb238_arbiter_deinit(husb238_arbiter_t * arb) {
+    critical_section_deinit(&arb->lock);
+}
+
+
+//
+// If the reservation keeps `priority` from starting a transaction of
+// `duration_us` at `now`, returns the end of the window it would run
+// into, otherwise 0.  Called with the lock held.
+//
+static uint64_t husb238_arbiter_reserved_until(husb238_arbiter_t * arb, husb238_bus_priority_t priority, uint32_t duration_us, uint64_t now) {
+    if (arb->reserved_len_us == 0 || priority <= arb->reserved_priority) {
+        return 0;
+    }
+
+    uint64_t end_us = arb->reserved_us + arb->reserved_len_us;
+    if (now >= end_us) {
+        if (arb->reserved_period_us == 0) {
+            arb->reserved_len_us = 0;
+            return 0;
+        }
+        uint64_t periods = (now - end_us) / arb->reserved_period_us + 1;
+        arb->reserved_us += periods * arb->reserved_period_us;
+        end_us += periods * arb->reserved_period_us;
+    }
+
+    return now + duration_us > arb->reserved_us ? end_us : 0;
+}
+
+
+//
+// Take the bus for `priority` if it's free, nobody more urgent is
+// waiting for it, and no reservation is in the way.  Sets *until to the
+// end of the reserved window if that's what stopped it.  Called with
+// the lock held.
+//
+static bool husb238_arbiter_grant(husb238_arbiter_t * arb, husb238_bus_priority_t priority, uint32_t duration_us, uint64_t now, uint64_t * until) {
+    *until = 0;
+    if (arb->busy) {
+        return false;
+    }
+    for (int p = 0; p < priority; ++p) {
+        if (arb->waiting[p] != 0) {
+            return false;
+        }
+    }
+    *until = husb238_arbiter_reserved_until(arb, priority, duration_us, now);
+    if (*until != 0) {
+        return false;
+    }
+
+    arb->busy = true;
+    arb->owner = priority;
+    arb->acquired_us = now;
+    arb->declared_us = duration_us;
+    return true;
+}
+
+
+// Account for an acquisition that waited `wait_us`.  Called with the
+// lock held.
+static void husb238_arbiter_acquired(husb238_arbiter_t * arb, husb238_bus_priority_t priority, uint32_t wait_us, bool waited, bool deferred) {
+    husb238_arbiter_class_stats_t * stats = &arb->stats.classes[priority];
+
+    stats->acquisitions++;
+    if (waited) {
+        stats->waits++;
+    }
+    if (deferred) {
+        stats->deferrals++;
+    }
+    stats->wait_us_total += wait_us;
+    if (wait_us > stats->wait_us_max) {
+        stats->wait_us_max = wait_us;
+    }
+}
+
+
+bool husb238_arbiter_try_acquire(husb238_arbiter_t * arb, husb238_bus_priority_t priority, uint32_t duration_us) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    uint64_t until;
+
+    critical_section_enter_blocking(&arb->lock);
+    bool granted = husb238_arbiter_grant(arb, priority, duration_us, hal->time_us(), &until);
+    if (granted) {
+        husb238_arbiter_acquired(arb, priority, 0, false, false);
+    }
+    critical_section_exit(&arb->lock);
+    return granted;
+}
+
+
+void husb238_arbiter_acquire(husb238_arbiter_t * arb, husb238_bus_priority_t priority, uint32_t duration_us) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    uint64_t start_us = hal->time_us();
+    uint64_t now = start_us;
+    uint64_t until;
+    bool deferred = false;
+
+    critical_section_enter_blocking(&arb->lock);
+    if (husb238_arbiter_grant(arb, priority, duration_us, now, &until)) {
+        husb238_arbiter_acquired(arb, priority, 0, false, false);
+        critical_section_exit(&arb->lock);
+        return;
+    }
+
+    arb->waiting[priority]++;
+    do {
+        deferred |= until != 0;
+        critical_section_exit(&arb->lock);
+
+        // Sleep through a reserved window in one go.
+        hal->sleep_us(until > now ? until - now : HUSB238_ARBITER_POLL_US);
+
+        critical_section_enter_blocking(&arb->lock);
+        now = hal->time_us();
+    } while (!husb238_arbiter_grant(arb, priority, duration_us, now, &until));
+    arb->waiting[priority]--;
+
+    husb238_arbiter_acquired(arb, priority, now - start_us, true, deferred);
+    critical_section_exit(&arb->lock);
+}
+
+
+void husb238_arbiter_release(husb238_arbiter_t * arb) {
+    husb238_hal_t const * hal = husb238_get_hal();
+
+    critical_section_enter_blocking(&arb->lock);
+    husb238_arbiter_class_stats_t * stats = &arb->stats.classes[arb->owner];
+    uint32_t hold_us = hal->time_us() - arb->acquired_us;
+
+    stats->hold_us_total += hold_us;
+    if (hold_us > stats->hold_us_max) {
+        stats->hold_us_max = hold_us;
+    }
+    if (arb->declared_us != 0 && hold_us > arb->declared_us) {
+        stats->overruns++;
+    }
+    arb->stats.busy_us += hold_us;
+    arb->busy = false;
+    critical_section_exit(&arb->lock);
+}
+
+
+void husb238_arbiter_reserve(husb238_arbiter_t * arb, husb238_bus_priority_t priority, uint64_t start_us, uint32_t len_us, uint32_t period_us) {
+    critical_section_enter_blocking(&arb->lock);
+    arb->reserved_priority = priority;
+    arb->reserved_us = start_us;
+    arb->reserved_len_us = len_us;
+    arb->reserved_period_us = period_us;
+    critical_section_exit(&arb->lock);
+}
+
+
+void husb238_arbiter_get_stats(husb238_arbiter_t * arb, husb238_arbiter_stats_t * stats) {
+    critical_section_enter_blocking(&arb->lock);
+    *stats = arb->stats;
+    critical_section_exit(&arb->lock);
+}
+
+
+void husb238_arbiter_clear_stats(husb238_arbiter_t * arb) {
+    critical_section_enter_blocking(&arb->lock);
+    arb->stats = {};
+    arb->stats.since_us = husb238_get_hal()->time_us();
+    critical_section_exit(&arb->lock);
+}
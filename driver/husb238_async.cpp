@@ -0,0 +1,143 @@
+#include <pico/stdlib.h>
+
+#include "husb238_async.h"
+#include "husb238_hal.h"
+
+
+static void husb238_async_finish(husb238_async_t * op, int result) {
+    op->result = result;
+    if (op->done != NULL) {
+        op->done(op, result);
+    }
+}
+
+
+// Run the next step no earlier than `at_us`, nor before the bus has
+// had its rest.
+static void husb238_async_schedule(husb238_async_t * op, uint64_t at_us) {
+    uint64_t idle_us = husb238_bus_idle_us(op->i2c);
+    if (idle_us > at_us) {
+        at_us = idle_us;
+    }
+    async_context_add_at_time_worker_at(op->context, &op->worker, from_us_since_boot(at_us));
+}
+
+
+static void husb238_async_step(async_context_t * context, async_at_time_worker_t * worker) {
+    husb238_async_t * op = (husb238_async_t *)worker->user_data;
+    husb238_reset_config_t const * reset_config = op->default_reset_config ? NULL : &op->reset_config;
+    uint64_t next_us = 0;
+    int r;
+
+    if (op->result != HUSB238_IN_PROGRESS) {
+        return;
+    }
+
+    switch (op->kind) {
+        case HUSB238_ASYNC_READ_SNAPSHOT:
+            r = husb238_read_snapshot(op->i2c, op->regs);
+            break;
+
+        case HUSB238_ASYNC_SELECT_PDO:
+            if (!op->started) {
+                r = husb238_select_pdo_begin(op->i2c, &op->select, op->select.pdo);
+                r = (r == PICO_OK) ? HUSB238_IN_PROGRESS : r;
+            } else {
+                r = husb238_poll(op->i2c, &op->select);
+            }
+            next_us = husb238_get_hal()->time_us() + (op->poll_us ? op->poll_us : HUSB238_ASYNC_POLL_US);
+            break;
+
+        default:
+            if (!op->started) {
+                r = husb238_reset_begin(op->i2c, &op->reset, reset_config);
+                r = (r == PICO_OK) ? HUSB238_IN_PROGRESS : r;
+            } else {
+                r = husb238_reset_poll(op->i2c, &op->reset);
+            }
+            next_us = op->reset.next_us;
+            break;
+    }
+    op->started = true;
+
+    if (r == HUSB238_IN_PROGRESS) {
+        husb238_async_schedule(op, next_us);
+        return;
+    }
+    husb238_async_finish(op, r);
+}
+
+
+static int husb238_async_start(async_context_t * context, husb238_async_t * op, i2c_inst_t * i2c, husb238_async_kind_t kind, husb238_async_done_t done) {
+    async_context_acquire_lock_blocking(context);
+    if (op->result == HUSB238_IN_PROGRESS) {
+        async_context_release_lock(context);
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+
+    op->result = HUSB238_IN_PROGRESS;
+    op->context = context;
+    op->i2c = i2c;
+    op->done = done;
+    op->kind = kind;
+    op->started = false;
+    op->worker = {};
+    op->worker.do_work = husb238_async_step;
+    op->worker.user_data = op;
+    husb238_async_schedule(op, 0);
+
+    async_context_release_lock(context);
+    return PICO_OK;
+}
+
+
+int husb238_async_read_snapshot(async_context_t * context, husb238_async_t * op, i2c_inst_t * i2c, husb238_registers_t * regs, husb238_async_done_t done) {
+    if (op->result == HUSB238_IN_PROGRESS) {
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+    op->regs = regs;
+    return husb238_async_start(context, op, i2c, HUSB238_ASYNC_READ_SNAPSHOT, done);
+}
+
+
+int husb238_async_select_pdo(async_context_t * context, husb238_async_t * op, i2c_inst_t * i2c, int pdo, husb238_async_done_t done) {
+    if (op->result == HUSB238_IN_PROGRESS) {
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+    // Keep the caller's timeout, if any.
+    uint32_t timeout_us = op->select.timeout_us;
+    op->select = {};
+    op->select.pdo = pdo;
+    op->select.timeout_us = timeout_us;
+    return husb238_async_start(context, op, i2c, HUSB238_ASYNC_SELECT_PDO, done);
+}
+
+
+int husb238_async_reset(async_context_t * context, husb238_async_t * op, i2c_inst_t * i2c, husb238_reset_config_t const * config, husb238_async_done_t done) {
+    if (op->result == HUSB238_IN_PROGRESS) {
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+    op->reset = {};
+    op->default_reset_config = (config == NULL);
+    if (config != NULL) {
+        op->reset_config = *config;
+    }
+    return husb238_async_start(context, op, i2c, HUSB238_ASYNC_RESET, done);
+}
+
+
+void husb238_async_cancel(husb238_async_t * op) {
+    async_context_t * context = op->context;
+    if (context == NULL) {
+        return;
+    }
+
+    async_context_acquire_lock_blocking(context);
+    if (op->result == HUSB238_IN_PROGRESS) {
+        async_context_remove_at_time_worker(context, &op->worker);
+        op->select.busy = false;
+        op->reset.busy = false;
+        husb238_async_finish(op, PICO_ERROR_TIMEOUT);
+    }
+    async_context_release_lock(context);
+}
@@ -0,0 +1,393 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <hardware/dma.h>
+#include <hardware/i2c.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+#include <pico/time.h>
+
+#include "husb238_dma_i2c.h"
+
+
+// The bus using each I2C peripheral's interrupt.
+static husb238_dma_i2c_t * husb238_dma_buses[NUM_I2CS];
+
+
+static void husb238_dma_i2c_start(husb238_dma_i2c_t * bus);
+
+
+// Finish the running transfer with `result`, and start the next one in
+// the chain, or complete the chain.  Called from interrupt handlers, or
+// with the I2C interrupt masked.
+static void husb238_dma_i2c_finish(husb238_dma_i2c_t * bus, int result) {
+    husb238_dma_i2c_xfer_t * xfer = bus->current;
+
+    xfer->result = result;
+    if (xfer->done != NULL) {
+        xfer->done(xfer->ctx, result);
+    }
+
+    // After a failure the rest of the chain is skipped, with the same
+    // result.
+    while (result != PICO_OK && xfer->next != NULL) {
+        xfer = xfer->next;
+        xfer->result = result;
+        if (xfer->done != NULL) {
+            xfer->done(xfer->ctx, result);
+        }
+    }
+
+    if (xfer->next == NULL) {
+        bus->current = NULL;
+        bus->result = result;
+        __sev();
+        return;
+    }
+
+    bus->current = xfer->next;
+    if (bus->gap_us == 0) {
+        husb238_dma_i2c_start(bus);
+    }
+}
+
+
+static int64_t husb238_dma_i2c_gap_done(alarm_id_t id, void * user_data) {
+    husb238_dma_i2c_t * bus = (husb238_dma_i2c_t *)user_data;
+    bus->alarm = 0;
+    if (bus->current != NULL) {
+        husb238_dma_i2c_start(bus);
+    }
+    return 0;
+}
+
+
+static void husb238_dma_i2c_irq(husb238_dma_i2c_t * bus) {
+    i2c_hw_t * hw = i2c_get_hw(bus->i2c);
+    uint32_t status = hw->intr_stat;
+
+    if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+        // The controller flushes its TX FIFO and sends a STOP.  Stop the
+        // DMA first, so nothing is written until the abort is cleared.
+        dma_channel_abort(bus->tx_dma);
+        dma_channel_abort(bus->rx_dma);
+        (void)hw->clr_tx_abrt;
+        if (bus->current != NULL) {
+            // Like the SDK, a Nack (of the address or of data) is a
+            // generic error.
+            husb238_dma_i2c_finish(bus, PICO_ERROR_GENERIC);
+        }
+    }
+
+    if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
+        (void)hw->clr_stop_det;
+        husb238_dma_i2c_xfer_t * xfer = bus->current;
+        if (xfer != NULL && xfer->result == HUSB238_IN_PROGRESS && bus->alarm == 0) {
+            // The last byte is in the RX FIFO or on its way to memory.
+            while (dma_channel_is_busy(bus->rx_dma) && xfer->read) {
+                tight_loop_contents();
+            }
+            husb238_dma_i2c_finish(bus, PICO_OK);
+            if (bus->current != NULL && bus->gap_us != 0) {
+                bus->alarm = add_alarm_in_us(bus->gap_us, husb238_dma_i2c_gap_done, bus, true);
+                if (bus->alarm < 0) {
+                    // Out of alarms: take the gap here instead.
+                    bus->alarm = 0;
+                    busy_wait_us(bus->gap_us);
+                    husb238_dma_i2c_start(bus);
+                }
+            }
+        }
+    }
+}
+
+
+static void husb238_dma_i2c0_irq(void) {
+    husb238_dma_i2c_irq(husb238_dma_buses[0]);
+}
+
+
+static void husb238_dma_i2c1_irq(void) {
+    husb238_dma_i2c_irq(husb238_dma_buses[1]);
+}
+
+
+// Program the peripheral and the DMA channels for bus->current, and let
+// them go.  The peripheral must be idle.
+static void husb238_dma_i2c_start(husb238_dma_i2c_t * bus) {
+    husb238_dma_i2c_xfer_t * xfer = bus->current;
+    i2c_hw_t * hw = i2c_get_hw(bus->i2c);
+
+    xfer->result = HUSB238_IN_PROGRESS;
+
+    for (size_t i = 0; i < xfer->len; ++i) {
+        uint32_t cmd = xfer->read ? I2C_IC_DATA_CMD_CMD_BITS : xfer->src[i];
+        if (i == xfer->len - 1) {
+            cmd |= I2C_IC_DATA_CMD_STOP_BITS;
+        }
+        bus->cmds[i] = cmd;
+    }
+
+    hw->enable = 0;
+    hw->tar = xfer->addr;
+    hw->enable = 1;
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+
+    dma_channel_config c;
+    uint32_t mask = 1u << bus->tx_dma;
+
+    if (xfer->read) {
+        c = dma_channel_get_default_config(bus->rx_dma);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_dreq(&c, i2c_get_dreq(bus->i2c, false));
+        dma_channel_configure(bus->rx_dma, &c, xfer->dst, &hw->data_cmd, xfer->len, false);
+        mask |= 1u << bus->rx_dma;
+    }
+
+    c = dma_channel_get_default_config(bus->tx_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, i2c_get_dreq(bus->i2c, true));
+    dma_channel_configure(bus->tx_dma, &c, &hw->data_cmd, bus->cmds, xfer->len, false);
+
+    dma_start_channel_mask(mask);
+}
+
+
+int husb238_dma_i2c_submit(husb238_dma_i2c_t * bus, husb238_dma_i2c_xfer_t * xfer) {
+    if (bus->current != NULL) {
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+    for (husb238_dma_i2c_xfer_t * x = xfer; x != NULL; x = x->next) {
+        // The peripheral can't send an address without data.
+        if (x->len == 0 || x->len > HUSB238_DMA_I2C_MAX_LEN) {
+            return PICO_ERROR_INVALID_ARG;
+        }
+        x->result = HUSB238_IN_PROGRESS;
+    }
+
+    husb238_config_t config;
+    husb238_get_config(bus->i2c, &config);
+    bus->gap_us = config.gap_us;
+    bus->result = HUSB238_IN_PROGRESS;
+    bus->current = xfer;
+    husb238_dma_i2c_start(bus);
+    return PICO_OK;
+}
+
+
+int husb238_dma_i2c_result(husb238_dma_i2c_t * bus) {
+    return bus->result;
+}
+
+
+void husb238_dma_i2c_cancel(husb238_dma_i2c_t * bus) {
+    uint irq = I2C0_IRQ + i2c_hw_index(bus->i2c);
+    i2c_hw_t * hw = i2c_get_hw(bus->i2c);
+
+    irq_set_enabled(irq, false);
+    if (bus->alarm != 0) {
+        cancel_alarm(bus->alarm);
+        bus->alarm = 0;
+    }
+    if (bus->current != NULL) {
+        dma_channel_abort(bus->tx_dma);
+        dma_channel_abort(bus->rx_dma);
+        hw->intr_mask = 0;
+        hw->enable = 0;
+        husb238_dma_i2c_finish(bus, PICO_ERROR_TIMEOUT);
+    }
+    irq_set_enabled(irq, true);
+}
+
+
+int husb238_dma_i2c_wait(husb238_dma_i2c_t * bus, uint timeout_us) {
+    absolute_time_t deadline = timeout_us ? make_timeout_time_us(timeout_us) : at_the_end_of_time;
+
+    while (bus->result == HUSB238_IN_PROGRESS) {
+        if (best_effort_wfe_or_timeout(deadline)) {
+            husb238_dma_i2c_cancel(bus);
+            break;
+        }
+    }
+    return bus->result;
+}
+
+
+//
+// The HAL.
+//
+
+static husb238_dma_i2c_t * husb238_dma_bus(i2c_inst_t * i2c) {
+    return husb238_dma_buses[i2c_hw_index(i2c)];
+}
+
+
+static int husb238_dma_i2c_transfer(i2c_inst_t * i2c, husb238_dma_i2c_xfer_t * xfer, uint timeout_us) {
+    husb238_dma_i2c_t * bus = husb238_dma_bus(i2c);
+
+    int r = husb238_dma_i2c_submit(bus, xfer);
+    if (r != PICO_OK) {
+        return r;
+    }
+
+    r = husb238_dma_i2c_wait(bus, timeout_us);
+    if (r != PICO_OK) {
+        return r;
+    }
+    return xfer->len;
+}
+
+
+// Every transfer ends with a STOP, whose interrupt completes it, so
+// `nostop` isn't supported.
+
+static int husb238_dma_i2c_write(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop, uint timeout_us) {
+    if (nostop) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+    husb238_dma_i2c_xfer_t xfer = {};
+    xfer.addr = addr;
+    xfer.src = src;
+    xfer.len = len;
+    return husb238_dma_i2c_transfer(i2c, &xfer, timeout_us);
+}
+
+
+static int husb238_dma_i2c_read(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, uint timeout_us) {
+    if (nostop) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+    husb238_dma_i2c_xfer_t xfer = {};
+    xfer.addr = addr;
+    xfer.read = true;
+    xfer.dst = dst;
+    xfer.len = len;
+    return husb238_dma_i2c_transfer(i2c, &xfer, timeout_us);
+}
+
+
+static int husb238_dma_i2c_bus_recover(i2c_inst_t * i2c, uint sda_gpio, uint scl_gpio, uint baudrate) {
+    return husb238_hal_default.bus_recover(i2c, sda_gpio, scl_gpio, baudrate);
+}
+
+
+husb238_hal_t const husb238_dma_i2c_hal = {
+    .i2c_write   = husb238_dma_i2c_write,
+    .i2c_read    = husb238_dma_i2c_read,
+    .time_us     = time_us_64,
+    .sleep_us    = sleep_us,
+    .bus_recover = husb238_dma_i2c_bus_recover,
+};
+
+
+int husb238_dma_i2c_init(husb238_dma_i2c_t * bus, i2c_inst_t * i2c) {
+    uint index = i2c_hw_index(i2c);
+
+    memset(bus, 0, sizeof(*bus));
+    bus->i2c = i2c;
+    bus->result = PICO_OK;
+
+    if (husb238_dma_buses[index] != NULL) {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+
+    int tx_dma = dma_claim_unused_channel(false);
+    int rx_dma = dma_claim_unused_channel(false);
+    if (tx_dma < 0 || rx_dma < 0 || husb238_set_bus_hal(i2c, &husb238_dma_i2c_hal) != PICO_OK) {
+        if (tx_dma >= 0) dma_channel_unclaim(tx_dma);
+        if (rx_dma >= 0) dma_channel_unclaim(rx_dma);
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+    bus->tx_dma = tx_dma;
+    bus->rx_dma = rx_dma;
+    husb238_dma_buses[index] = bus;
+
+    uint irq = I2C0_IRQ + index;
+    i2c_get_hw(i2c)->intr_mask = 0;
+    irq_set_exclusive_handler(irq, index == 0 ? husb238_dma_i2c0_irq : husb238_dma_i2c1_irq);
+    irq_set_enabled(irq, true);
+    return PICO_OK;
+}
+
+
+void husb238_dma_i2c_deinit(husb238_dma_i2c_t * bus) {
+    uint index = i2c_hw_index(bus->i2c);
+    uint irq = I2C0_IRQ + index;
+
+    husb238_dma_i2c_cancel(bus);
+    irq_set_enabled(irq, false);
+    irq_remove_handler(irq, index == 0 ? husb238_dma_i2c0_irq : husb238_dma_i2c1_irq);
+    i2c_get_hw(bus->i2c)->intr_mask = 0;
+
+    dma_channel_unclaim(bus->tx_dma);
+    dma_channel_unclaim(bus->rx_dma);
+    husb238_set_bus_hal(bus->i2c, NULL);
+    husb238_dma_buses[index] = NULL;
+}
+
+
+//
+// HUSB238 operations.
+//
+
+static husb238_dma_i2c_xfer_t * husb238_dma_op_write(husb238_dma_op_t * op, int i, uint8_t reg, uint8_t val, size_t len) {
+    husb238_dma_i2c_xfer_t * xfer = &op->xfers[i];
+
+    *xfer = {};
+    op->out[i][0] = reg;
+    op->out[i][1] = val;
+    xfer->addr = HUSB238_I2C_SLAVE_ADDRESS;
+    xfer->src = op->out[i];
+    xfer->len = len;
+    return xfer;
+}
+
+
+int husb238_dma_read_registers(husb238_dma_i2c_t * bus, husb238_dma_op_t * op, uint8_t reg, uint8_t * dst, size_t len) {
+    husb238_dma_i2c_xfer_t * write = husb238_dma_op_write(op, 0, reg, 0, 1);
+    husb238_dma_i2c_xfer_t * read = &op->xfers[1];
+
+    *read = {};
+    read->addr = HUSB238_I2C_SLAVE_ADDRESS;
+    read->read = true;
+    read->dst = dst;
+    read->len = len;
+    write->next = read;
+    return husb238_dma_i2c_submit(bus, write);
+}
+
+
+int husb238_dma_read_snapshot(husb238_dma_i2c_t * bus, husb238_dma_op_t * op, husb238_registers_t * regs) {
+    return husb238_dma_read_registers(bus, op, HUSB238_I2C_REG_PD_STATUS0, (uint8_t *)regs, sizeof(*regs));
+}
+
+
+// SRC_PDO and GO_COMMAND are written: the negotiation is in flight.
+static void husb238_dma_select_issued(void * ctx, int result) {
+    husb238_select_t * select = (husb238_select_t *)ctx;
+    select->start_us = time_us_64();
+    select->busy = (result == PICO_OK);
+}
+
+
+int husb238_dma_select_pdo(husb238_dma_i2c_t * bus, husb238_dma_op_t * op, husb238_select_t * select, int pdo) {
+    // SRC_PDO and GO_COMMAND are adjacent, so one write sets both.
+    husb238_dma_i2c_xfer_t * xfer = husb238_dma_op_write(op, 0, HUSB238_I2C_REG_SRC_PDO, pdo, 3);
+    op->out[0][2] = HUSB238_CMD_SELECT_PDO;
+
+    select->pdo = pdo;
+    select->busy = false;
+    select->pd_response = HUSB238_PD_RESPONSE_NONE;
+    select->latency_us = 0;
+    if (select->timeout_us == 0) {
+        select->timeout_us = HUSB238_SELECT_PDO_TIMEOUT_US;
+    }
+
+    xfer->done = husb238_dma_select_issued;
+    xfer->ctx = select;
+    return husb238_dma_i2c_submit(bus, xfer);
+}
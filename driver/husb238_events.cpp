@@ -0,0 +1,175 @@
+#include <hardware/i2c.h>
+
+#include "husb238.h"
+#include "husb238_hal.h"
+#include "husb238_events.h"
+
+
+void husb238_events_init(husb238_events_t * ev, i2c_inst_t * i2c, uint32_t interval_us, uint8_t debounce, husb238_event_callbacks_t const * callbacks) {
+    *ev = {};
+    ev->i2c = i2c;
+    ev->interval_us = interval_us ? interval_us : HUSB238_EVENTS_INTERVAL_US;
+    ev->debounce = debounce ? debounce : HUSB238_EVENTS_DEBOUNCE;
+    if (callbacks != NULL) {
+        ev->callbacks = *callbacks;
+    }
+    ev->candidate_connected = ev->connected;
+    ev->candidate_pd_status1 = ev->pd_status1;
+}
+
+
+// PD_STATUS1 (and whether we could read it at all) settled on a new
+// value.  Find out what else changed, and tell the callbacks.
+static int husb238_events_changed(husb238_events_t * ev, bool connected, uint8_t pd_status1) {
+    husb238_event_callbacks_t const * cb = &ev->callbacks;
+    int events = 0;
+
+    uint8_t old_response = husb238_pd_response(ev->pd_status1);
+    bool was_attached = ev->attached;
+
+    ev->connected = connected;
+    ev->pd_status1 = pd_status1;
+
+    if (!connected || !husb238_attached(pd_status1)) {
+        ev->attached = false;
+        ev->mv = 0;
+        ev->ma = 0;
+        if (was_attached) {
+            if (cb->detached) cb->detached(cb->ctx);
+            events++;
+        }
+        ev->events += events;
+        return PICO_OK;
+    }
+
+    int r = husb238_read_snapshot(ev->i2c, &ev->regs);
+    ev->fetches++;
+    if (r != PICO_OK) {
+        // Try again on the next poll.
+        ev->connected = false;
+        return r;
+    }
+    ev->pd_status1 = ev->regs.pd_status1;
+    ev->attached = true;
+    ev->recheck = false;
+    ev->contract_check_us = husb238_get_hal()->time_us() + HUSB238_EVENTS_CONTRACT_CHECK_US;
+
+    if (!was_attached) {
+        ev->contract_wait_us = husb238_get_hal()->time_us() + HUSB238_EVENTS_CONTRACT_WAIT_US;
+        if (cb->attached) cb->attached(cb->ctx, &ev->regs);
+        events++;
+    }
+
+    uint16_t mv, ma;
+    husb238_snapshot_get_contract_mv_ma(&ev->regs, &mv, &ma);
+    if (mv != ev->mv || ma != ev->ma) {
+        ev->mv = mv;
+        ev->ma = ma;
+        if (cb->contract_changed) cb->contract_changed(cb->ctx, mv, ma);
+        events++;
+    }
+
+    uint8_t response = husb238_pd_response(ev->pd_status1);
+    if (response != old_response
+        && response != HUSB238_PD_RESPONSE_NONE
+        && response != HUSB238_PD_RESPONSE_SUCCESS) {
+        if (cb->negotiation_failed) cb->negotiation_failed(cb->ctx, response);
+        events++;
+    }
+
+    ev->events += events;
+    return PICO_OK;
+}
+
+
+// Read PD_STATUS0 alone, and if the contract isn't what we last saw,
+// read everything.
+static int husb238_events_check_contract(husb238_events_t * ev, bool connected, uint8_t pd_status1, uint64_t now) {
+    ev->contract_check_us = now + HUSB238_EVENTS_CONTRACT_CHECK_US;
+    ev->contract_checks++;
+
+    uint8_t pd_status0;
+    int r = husb238_read_register(ev->i2c, HUSB238_I2C_REG_PD_STATUS0, &pd_status0);
+    if (r != PICO_OK) {
+        // The next PD_STATUS1 poll will tell.
+        return PICO_OK;
+    }
+    husb238_pd_status0_t contract = husb238_decode_pd_status0(pd_status0);
+    if (contract.mv == ev->mv && contract.ma == ev->ma) {
+        return PICO_OK;
+    }
+    ev->candidate_since_us = now;
+    return husb238_events_changed(ev, connected, pd_status1);
+}
+
+
+int husb238_events_poll(husb238_events_t * ev) {
+    husb238_hal_t const * hal = husb238_get_hal();
+
+    uint64_t now = hal->time_us();
+    if (now < ev->next_poll_us) {
+        return PICO_OK;
+    }
+    ev->next_poll_us = now + ev->interval_us;
+
+    uint8_t pd_status1 = 0;
+    bool connected = husb238_read_pd_status1(ev->i2c, &pd_status1) == PICO_OK;
+    ev->polls++;
+
+    // A command (SELECT_PDO, GET_SRC_CAP) briefly clears PD_RESPONSE,
+    // and may leave it as it was, with a new contract or new PDOs.
+    // That's worth a full read even if it doesn't last long enough to
+    // count as a change.
+    if (connected && ev->attached && husb238_pd_response(pd_status1) != husb238_pd_response(ev->pd_status1)) {
+        ev->recheck = true;
+    }
+
+    if (connected == ev->connected && pd_status1 == ev->pd_status1) {
+        // Nothing changed, or a glitch went away before it counted.
+        ev->candidate_polls = 0;
+
+        if (ev->attached && ev->recheck) {
+            ev->recheck = false;
+            ev->candidate_since_us = now;
+            return husb238_events_changed(ev, connected, pd_status1);
+        }
+
+        // Right after attach the PD contract (and the source's PDOs)
+        // arrive without PD_STATUS1 changing, so keep reading the full
+        // register file until there is a contract, or until it's clear
+        // there won't be one.
+        if (ev->attached && ev->mv == 0 && now < ev->contract_wait_us) {
+            ev->candidate_since_us = now;
+            return husb238_events_changed(ev, connected, pd_status1);
+        }
+
+        // A command can also come and go between two polls, so look at
+        // the contract itself now and then.
+        if (ev->attached && now >= ev->contract_check_us) {
+            return husb238_events_check_contract(ev, connected, pd_status1, now);
+        }
+        return PICO_OK;
+    }
+
+    if (ev->candidate_polls == 0
+        || connected != ev->candidate_connected
+        || pd_status1 != ev->candidate_pd_status1) {
+        ev->candidate_connected = connected;
+        ev->candidate_pd_status1 = pd_status1;
+        ev->candidate_polls = 0;
+        ev->candidate_since_us = now;
+    }
+    if (++ev->candidate_polls < ev->debounce) {
+        return PICO_OK;
+    }
+    ev->candidate_polls = 0;
+
+    int r = husb238_events_changed(ev, connected, pd_status1);
+
+    uint32_t latency_us = hal->time_us() - ev->candidate_since_us;
+    ev->last_latency_us = latency_us;
+    if (latency_us > ev->max_latency_us) {
+        ev->max_latency_us = latency_us;
+    }
+    return r;
+}
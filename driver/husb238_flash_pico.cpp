@@ -0,0 +1,46 @@
+#include <string.h>
+
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+
+#include "husb238_flash.h"
+
+
+static int husb238_flash_pico_read(husb238_flash_t const * flash, uint32_t offset, void * dst, size_t len) {
+    memcpy(dst, (uint8_t const *)(XIP_BASE + flash->base + offset), len);
+    return PICO_OK;
+}
+
+
+static int husb238_flash_pico_program(husb238_flash_t const * flash, uint32_t offset, void const * src, size_t len) {
+    uint32_t saved = save_and_disable_interrupts();
+    flash_range_program(flash->base + offset, (uint8_t const *)src, len);
+    restore_interrupts(saved);
+    return PICO_OK;
+}
+
+
+static int husb238_flash_pico_erase(husb238_flash_t const * flash, uint32_t offset) {
+    uint32_t saved = save_and_disable_interrupts();
+    flash_range_erase(flash->base + offset, FLASH_SECTOR_SIZE);
+    restore_interrupts(saved);
+    return PICO_OK;
+}
+
+
+int husb238_flash_pico_init(husb238_flash_t * flash, uint32_t sectors) {
+    if (sectors == 0 || sectors * FLASH_SECTOR_SIZE > PICO_FLASH_SIZE_BYTES) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    *flash = {};
+    flash->sector_size = FLASH_SECTOR_SIZE;
+    flash->page_size = FLASH_PAGE_SIZE;
+    flash->sectors = sectors;
+    flash->read = husb238_flash_pico_read;
+    flash->program = husb238_flash_pico_program;
+    flash->erase = husb238_flash_pico_erase;
+    flash->base = PICO_FLASH_SIZE_BYTES - sectors * FLASH_SECTOR_SIZE;
+    return PICO_OK;
+}
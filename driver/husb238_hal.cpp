@@ -0,0 +1,142 @@
+#include <pico/stdlib.h>
+#include <hardware/i2c.h>
+
+#include "husb238_hal.h"
+
+
+static int husb238_hal_default_i2c_write(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop, uint timeout_us) {
+    if (timeout_us == 0) {
+        return i2c_write_blocking(i2c, addr, src, len, nostop);
+    }
+    return i2c_write_timeout_us(i2c, addr, src, len, nostop, timeout_us);
+}
+
+
+static int husb238_hal_default_i2c_read(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, uint timeout_us) {
+    if (timeout_us == 0) {
+        return i2c_read_blocking(i2c, addr, dst, len, nostop);
+    }
+    return i2c_read_timeout_us(i2c, addr, dst, len, nostop, timeout_us);
+}
+
+
+// Open-drain pin control: drive low, or let the pull-up have it.
+static void husb238_hal_pin_low(uint gpio) {
+    gpio_put(gpio, false);
+    gpio_set_dir(gpio, GPIO_OUT);
+}
+
+
+static void husb238_hal_pin_release(uint gpio) {
+    gpio_set_dir(gpio, GPIO_IN);
+}
+
+
+static int husb238_hal_default_bus_recover(i2c_inst_t * i2c, uint sda_gpio, uint scl_gpio, uint baudrate) {
+    // Half an SCL period, rounded up, and no faster than 100 kHz so a
+    // confused target has a chance to keep up.
+    uint half_period_us = baudrate >= 100 * 1000 ? 5 : (500 * 1000 + baudrate - 1) / baudrate;
+
+    i2c_deinit(i2c);
+
+    gpio_init(sda_gpio);
+    gpio_init(scl_gpio);
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+    husb238_hal_pin_release(sda_gpio);
+    husb238_hal_pin_release(scl_gpio);
+    busy_wait_us(half_period_us);
+
+    // A target stuck mid-byte holds SDA low until it has clocked out
+    // the rest of its byte; nine clocks is always enough.
+    for (int i = 0; i < 9 && !gpio_get(sda_gpio); ++i) {
+        husb238_hal_pin_low(scl_gpio);
+        busy_wait_us(half_period_us);
+        husb238_hal_pin_release(scl_gpio);
+        busy_wait_us(half_period_us);
+    }
+
+    // STOP: SDA rises while SCL is high.
+    husb238_hal_pin_low(scl_gpio);
+    busy_wait_us(half_period_us);
+    husb238_hal_pin_low(sda_gpio);
+    busy_wait_us(half_period_us);
+    husb238_hal_pin_release(scl_gpio);
+    busy_wait_us(half_period_us);
+    husb238_hal_pin_release(sda_gpio);
+    busy_wait_us(half_period_us);
+
+    bool released = gpio_get(sda_gpio) && gpio_get(scl_gpio);
+
+    gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
+    i2c_init(i2c, baudrate);
+
+    return released ? PICO_OK : PICO_ERROR_IO;
+}
+
+
+husb238_hal_t const husb238_hal_default = {
+    .i2c_write   = husb238_hal_default_i2c_write,
+    .i2c_read    = husb238_hal_default_i2c_read,
+    .time_us     = time_us_64,
+    .sleep_us    = sleep_us,
+    .bus_recover = husb238_hal_default_bus_recover,
+};
+
+
+static husb238_hal_t const * husb238_hal = &husb238_hal_default;
+
+
+void husb238_set_hal(husb238_hal_t const * hal) {
+    husb238_hal = hal ? hal : &husb238_hal_default;
+}
+
+
+husb238_hal_t const * husb238_get_hal(void) {
+    return husb238_hal;
+}
+
+
+static struct {
+    i2c_inst_t * i2c;
+    husb238_hal_t const * hal;
+} husb238_bus_hals[HUSB238_MAX_BUS_HALS];
+
+
+int husb238_set_bus_hal(i2c_inst_t * i2c, husb238_hal_t const * hal) {
+    int unused = -1;
+
+    for (int i = 0; i < HUSB238_MAX_BUS_HALS; ++i) {
+        if (husb238_bus_hals[i].i2c == i2c) {
+            husb238_bus_hals[i].hal = hal;
+            if (hal == NULL) {
+                husb238_bus_hals[i].i2c = NULL;
+            }
+            return PICO_OK;
+        }
+        if (unused < 0 && husb238_bus_hals[i].i2c == NULL) {
+            unused = i;
+        }
+    }
+
+    if (hal == NULL) {
+        return PICO_OK;
+    }
+    if (unused < 0) {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+    husb238_bus_hals[unused].i2c = i2c;
+    husb238_bus_hals[unused].hal = hal;
+    return PICO_OK;
+}
+
+
+husb238_hal_t const * husb238_get_bus_hal(i2c_inst_t * i2c) {
+    for (int i = 0; i < HUSB238_MAX_BUS_HALS; ++i) {
+        if (husb238_bus_hals[i].i2c == i2c) {
+            return husb238_bus_hals[i].hal;
+        }
+    }
+    return husb238_hal;
+}
@@ -0,0 +1,111 @@
+#include <atomic>
+#include <stdio.h>
+
+#include <pico/types.h>
+
+#include "husb238_hal.h"
+#include "husb238_log.h"
+#include "husb238_ring.h"
+
+
+static char const * const husb238_log_formats[HUSB238_LOG_COUNT] = {
+#define HUSB238_LOG_FORMAT(id, level, format) format,
+    HUSB238_LOG_EVENTS(HUSB238_LOG_FORMAT)
+#undef HUSB238_LOG_FORMAT
+};
+
+static husb238_spsc_ring<husb238_log_record_t, HUSB238_LOG_RECORDS> husb238_log_ring;
+// As for the trace ring: a running total bumped by the one producer
+// without a read-modify-write, and what the consumer has taken of it.
+static std::atomic<uint32_t> husb238_log_dropped{0};
+static uint32_t husb238_log_dropped_taken = 0;
+static uint husb238_log_level = HUSB238_LOG_LEVEL_ERROR;
+
+
+void husb238_log(husb238_log_id_t id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+    if (id >= HUSB238_LOG_COUNT || husb238_log_levels[id] > husb238_log_level) {
+        return;
+    }
+
+    husb238_log_record_t record = {
+        .time_us = (uint32_t)husb238_get_hal()->time_us(),
+        .id = (uint8_t)id,
+        .reserved = {},
+        .args = { a0, a1, a2, a3 },
+    };
+    if (!husb238_log_ring.push(record)) {
+        husb238_log_dropped.store(husb238_log_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+
+void husb238_log_set_level(uint level) {
+    husb238_log_level = level;
+}
+
+
+char const * husb238_log_format(husb238_log_id_t id) {
+    if (id >= HUSB238_LOG_COUNT) {
+        return "unknown log message";
+    }
+    return husb238_log_formats[id];
+}
+
+
+uint32_t husb238_log_flush(void) {
+    husb238_log_record_t record;
+    uint32_t n = 0;
+
+    uint32_t dropped = husb238_log_take_dropped();
+    if (dropped != 0) {
+        printf("husb238: %lu log messages dropped\n", (unsigned long)dropped);
+    }
+
+    while (husb238_log_ring.pop(record)) {
+        printf("husb238 %10lu: ", (unsigned long)record.time_us);
+        printf(
+            husb238_log_format((husb238_log_id_t)record.id),
+            (unsigned)record.args[0],
+            (unsigned)record.args[1],
+            (unsigned)record.args[2],
+            (unsigned)record.args[3]
+        );
+        printf("\n");
+        n++;
+    }
+    return n;
+}
+
+
+uint32_t husb238_log_dump(void) {
+    husb238_log_record_t record;
+    uint32_t n = 0;
+
+    while (husb238_log_ring.pop(record)) {
+        uint8_t const * bytes = (uint8_t const *)&record;
+        printf("husb238-log:");
+        for (size_t i = 0; i < sizeof(record); ++i) {
+            printf("%02x", bytes[i]);
+        }
+        printf("\n");
+        n++;
+    }
+    return n;
+}
+
+
+uint32_t husb238_log_drain(husb238_log_record_t * records, uint32_t max) {
+    uint32_t n = 0;
+    while (n < max && husb238_log_ring.pop(records[n])) {
+        ++n;
+    }
+    return n;
+}
+
+
+uint32_t husb238_log_take_dropped(void) {
+    uint32_t dropped = husb238_log_dropped.load(std::memory_order_relaxed);
+    uint32_t taken = dropped - husb238_log_dropped_taken;
+    husb238_log_dropped_taken = dropped;
+    return taken;
+}
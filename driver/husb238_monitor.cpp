@@ -0,0 +1,109 @@
+#include <pico/stdlib.h>
+#include <pico/multicore.h>
+#include <hardware/i2c.h>
+
+#include "husb238.h"
+#include "husb238_hal.h"
+#include "husb238_monitor.h"
+
+
+static void husb238_monitor_publish(husb238_monitor_t * mon, husb238_event_type_t type, husb238_status_t const * st) {
+    husb238_event_t event;
+
+    event.type = type;
+    event.time_us = st->time_us;
+    event.mv = st->mv;
+    event.ma = st->ma;
+    memcpy(event.src_pdos, st->regs.src_pdos, sizeof(event.src_pdos));
+
+    if (!mon->events.push(event)) {
+        mon->dropped_events.store(mon->dropped_events.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+
+void husb238_monitor_poll(husb238_monitor_t * mon) {
+    husb238_status_t st = {};
+    husb238_status_t const * last = &mon->last;
+
+    st.time_us = husb238_get_hal()->time_us();
+    if (husb238_read_snapshot(mon->i2c, &st.regs) == PICO_OK) {
+        st.connected = true;
+        st.attached = husb238_attached(st.regs.pd_status1);
+        st.current_pdo = husb238_snapshot_get_current_pdo(&st.regs);
+        husb238_snapshot_get_contract_mv_ma(&st.regs, &st.mv, &st.ma);
+    }
+
+    // A HUSB238 that stopped answering has (as far as we can tell) lost
+    // its source.
+    bool was_attached = last->connected && last->attached;
+    bool is_attached = st.connected && st.attached;
+
+    if (is_attached && !was_attached) {
+        husb238_monitor_publish(mon, HUSB238_EVENT_ATTACHED, &st);
+    } else if (!is_attached && was_attached) {
+        husb238_monitor_publish(mon, HUSB238_EVENT_DETACHED, &st);
+    }
+
+    if (is_attached) {
+        if (st.mv != last->mv || st.ma != last->ma) {
+            husb238_monitor_publish(mon, HUSB238_EVENT_CONTRACT_CHANGED, &st);
+        }
+        if (memcmp(st.regs.src_pdos, last->regs.src_pdos, sizeof(st.regs.src_pdos)) != 0) {
+            husb238_monitor_publish(mon, HUSB238_EVENT_PDOS_CHANGED, &st);
+        }
+    }
+
+    mon->status.write(st);
+    mon->last = st;
+}
+
+
+void husb238_monitor_run(husb238_monitor_t * mon) {
+    uint32_t interval_us = mon->interval_us ? mon->interval_us : HUSB238_MONITOR_INTERVAL_US;
+
+    while (!mon->stop.load(std::memory_order_acquire)) {
+        husb238_monitor_poll(mon);
+        husb238_get_hal()->sleep_us(interval_us);
+    }
+}
+
+
+//
+// Running a monitor on core1.  multicore_launch_core1() takes no
+// argument, so the monitor is handed over through a static.
+//
+
+static husb238_monitor_t * husb238_core1_monitor = NULL;
+static std::atomic<bool> husb238_core1_running{false};
+
+
+static void husb238_monitor_core1_entry(void) {
+    husb238_monitor_run(husb238_core1_monitor);
+    husb238_core1_running.store(false, std::memory_order_release);
+}
+
+
+int husb238_monitor_start(husb238_monitor_t * mon, i2c_inst_t * i2c) {
+    if (husb238_core1_running.load(std::memory_order_acquire)) {
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+
+    mon->i2c = i2c;
+    mon->last = {};
+    mon->stop.store(false, std::memory_order_relaxed);
+
+    husb238_core1_monitor = mon;
+    husb238_core1_running.store(true, std::memory_order_release);
+    multicore_launch_core1(husb238_monitor_core1_entry);
+    return PICO_OK;
+}
+
+
+void husb238_monitor_stop(husb238_monitor_t * mon) {
+    mon->stop.store(true, std::memory_order_release);
+    while (husb238_core1_running.load(std::memory_order_acquire)) {
+        tight_loop_contents();
+    }
+    multicore_reset_core1();
+}
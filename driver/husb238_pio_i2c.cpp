@@ -0,0 +1,454 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/gpio.h>
+#include <hardware/pio.h>
+#include <pico/time.h>
+
+#include "husb238_pio_i2c.h"
+#include "husb238_pio_i2c.pio.h"
+
+
+//
+// Fields of a TX FIFO word, see husb238_pio_i2c.pio.
+//
+#define HUSB238_PIO_ICOUNT_LSB (10)
+#define HUSB238_PIO_FINAL_LSB  (9)
+#define HUSB238_PIO_DATA_LSB   (1)
+#define HUSB238_PIO_NAK_LSB    (0)
+
+// State machine clock cycles per SCL period.
+#define HUSB238_PIO_CYCLES_PER_BIT (32)
+
+
+// The program is loaded into each PIO once, by its first bus.
+static uint husb238_pio_offset[NUM_PIOS];
+static uint husb238_pio_users[NUM_PIOS];
+
+
+static husb238_pio_i2c_t * husb238_pio_bus(i2c_inst_t * i2c) {
+    return (husb238_pio_i2c_t *)i2c;
+}
+
+
+//
+// Command stream building.  Each returns the number of words it wrote.
+//
+
+static uint husb238_pio_put_exec(uint16_t * cmds, uint8_t const * steps, uint n) {
+    cmds[0] = (n - 1) << HUSB238_PIO_ICOUNT_LSB;
+    for (uint i = 0; i < n; ++i) {
+        cmds[1 + i] = husb238_i2c_set_scl_sda_program_instructions[steps[i]];
+    }
+    return 1 + n;
+}
+
+
+static uint husb238_pio_put_start(uint16_t * cmds, bool restart) {
+    static uint8_t const start[] = { HUSB238_I2C_SC1_SD0, HUSB238_I2C_SC0_SD0 };
+    static uint8_t const repstart[] = { HUSB238_I2C_SC0_SD1, HUSB238_I2C_SC1_SD1, HUSB238_I2C_SC1_SD0, HUSB238_I2C_SC0_SD0 };
+
+    if (restart) {
+        return husb238_pio_put_exec(cmds, repstart, sizeof(repstart));
+    }
+    return husb238_pio_put_exec(cmds, start, sizeof(start));
+}
+
+
+static uint husb238_pio_put_stop(uint16_t * cmds) {
+    static uint8_t const stop[] = { HUSB238_I2C_SC0_SD0, HUSB238_I2C_SC1_SD0, HUSB238_I2C_SC1_SD1 };
+    return husb238_pio_put_exec(cmds, stop, sizeof(stop));
+}
+
+
+// `nak` set releases SDA in the Ack slot: the target Acks our writes, or
+// we Nack the last byte of a read.  A Nack on a `final` byte is expected.
+static uint16_t husb238_pio_byte(uint8_t data, bool final, bool nak) {
+    return (final << HUSB238_PIO_FINAL_LSB) | (data << HUSB238_PIO_DATA_LSB) | (nak << HUSB238_PIO_NAK_LSB);
+}
+
+
+static uint husb238_pio_put_write(uint16_t * cmds, uint8_t addr, uint8_t const * src, size_t len) {
+    uint n = 0;
+    cmds[n++] = husb238_pio_byte(addr << 1, false, true);
+    for (size_t i = 0; i < len; ++i) {
+        cmds[n++] = husb238_pio_byte(src[i], i == len - 1, true);
+    }
+    return n;
+}
+
+
+static uint husb238_pio_put_read(uint16_t * cmds, uint8_t addr, size_t len) {
+    uint n = 0;
+    cmds[n++] = husb238_pio_byte((addr << 1) | 1, false, true);
+    for (size_t i = 0; i < len; ++i) {
+        bool last = (i == len - 1);
+        cmds[n++] = husb238_pio_byte(0xff, last, last);
+    }
+    return n;
+}
+
+
+//
+// Running a command stream.
+//
+
+// Set up the DMA channels to feed `n_cmds` words from bus->cmds to the
+// state machine and collect `rx_len` bytes into bus->rx, without
+// starting them.  Returns the mask of channels to start.
+static uint32_t husb238_pio_prepare(husb238_pio_i2c_t * bus, uint n_cmds, uint rx_len, uint rx_skip) {
+    bus->rx_len = rx_len;
+    bus->rx_skip = rx_skip;
+    bus->tail = false;
+
+    dma_channel_config c = dma_channel_get_default_config(bus->tx_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(bus->pio, bus->sm, true));
+    dma_channel_configure(bus->tx_dma, &c, &bus->pio->txf[bus->sm], bus->cmds, n_cmds, false);
+
+    c = dma_channel_get_default_config(bus->rx_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, pio_get_dreq(bus->pio, bus->sm, false));
+    dma_channel_configure(bus->rx_dma, &c, bus->rx, &bus->pio->rxf[bus->sm], rx_len, false);
+
+    return (1u << bus->tx_dma) | (1u << bus->rx_dma);
+}
+
+
+// Whether the stream has finished, and if so *result is PICO_OK or
+// PICO_ERROR_GENERIC for an unexpected Nack.
+//
+// Once both DMA channels are done the last byte has been clocked in,
+// but its Ack and the STOP may still be running.  The TX stall flag is
+// cleared then, and set again when the state machine runs out of
+// commands (it stays set for as long as it's stalled).
+static bool husb238_pio_finished(husb238_pio_i2c_t * bus, int * result) {
+    uint32_t stall = 1u << (PIO_FDEBUG_TXSTALL_LSB + bus->sm);
+
+    if (pio_interrupt_get(bus->pio, bus->sm)) {
+        *result = PICO_ERROR_GENERIC;
+        return true;
+    }
+    if (dma_channel_is_busy(bus->tx_dma) || dma_channel_is_busy(bus->rx_dma)) {
+        return false;
+    }
+    if (!bus->tail) {
+        bus->tail = true;
+        bus->pio->fdebug = stall;
+        return false;
+    }
+    if ((bus->pio->fdebug & stall) == 0) {
+        return false;
+    }
+    *result = PICO_OK;
+    return true;
+}
+
+
+// Stop a stream that failed or timed out, and leave the bus idle: the
+// state machine back at its entry point waiting for a command, and a
+// STOP sent so the target lets go.
+static void husb238_pio_abort(husb238_pio_i2c_t * bus) {
+    static uint8_t const stop[] = { HUSB238_I2C_SC0_SD0, HUSB238_I2C_SC1_SD0, HUSB238_I2C_SC1_SD1 };
+    uint16_t cmds[1 + sizeof(stop)];
+
+    dma_channel_abort(bus->tx_dma);
+    dma_channel_abort(bus->rx_dma);
+    pio_sm_drain_tx_fifo(bus->pio, bus->sm);
+    pio_sm_clear_fifos(bus->pio, bus->sm);
+    pio_sm_exec(bus->pio, bus->sm, pio_encode_jmp(bus->offset + husb238_i2c_offset_entry_point));
+    pio_interrupt_clear(bus->pio, bus->sm);
+
+    uint n = husb238_pio_put_exec(cmds, stop, sizeof(stop));
+    for (uint i = 0; i < n; ++i) {
+        while (pio_sm_is_tx_fifo_full(bus->pio, bus->sm)) {
+            tight_loop_contents();
+        }
+        *(io_rw_16 *)&bus->pio->txf[bus->sm] = cmds[i];
+    }
+    bus->restart = false;
+}
+
+
+// Wait for every bus in `buses` to finish, until `deadline`, aborting
+// the ones that don't.  results[i] is PICO_OK, PICO_ERROR_GENERIC or
+// PICO_ERROR_TIMEOUT.
+static void husb238_pio_wait(husb238_pio_i2c_t * const buses[], size_t n, int results[], uint64_t deadline) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    size_t pending = n;
+    bool done[HUSB238_MAX_BUS_HALS] = {};
+
+    while (pending > 0) {
+        for (size_t i = 0; i < n; ++i) {
+            if (!done[i] && husb238_pio_finished(buses[i], &results[i])) {
+                done[i] = true;
+                pending--;
+            }
+        }
+        if (pending > 0 && hal->time_us() >= deadline) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        if (!done[i]) {
+            results[i] = PICO_ERROR_TIMEOUT;
+        }
+        if (results[i] != PICO_OK) {
+            husb238_pio_abort(buses[i]);
+        }
+    }
+}
+
+
+static uint64_t husb238_pio_deadline(uint timeout_us) {
+    if (timeout_us == 0) {
+        return UINT64_MAX;
+    }
+    return husb238_get_hal()->time_us() + timeout_us;
+}
+
+
+static int husb238_pio_run(husb238_pio_i2c_t * bus, uint n_cmds, size_t len, uint timeout_us) {
+    int r;
+
+    dma_start_channel_mask(husb238_pio_prepare(bus, n_cmds, 1 + len, 1));
+    husb238_pio_wait(&bus, 1, &r, husb238_pio_deadline(timeout_us));
+    return r;
+}
+
+
+//
+// The HAL.
+//
+
+static int husb238_pio_i2c_write(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop, uint timeout_us) {
+    husb238_pio_i2c_t * bus = husb238_pio_bus(i2c);
+    if (len > HUSB238_PIO_I2C_MAX_LEN) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    uint n = husb238_pio_put_start(bus->cmds, bus->restart);
+    n += husb238_pio_put_write(bus->cmds + n, addr, src, len);
+    if (!nostop) {
+        n += husb238_pio_put_stop(bus->cmds + n);
+    }
+
+    int r = husb238_pio_run(bus, n, len, timeout_us);
+    if (r != PICO_OK) {
+        return r;
+    }
+    bus->restart = nostop;
+    return len;
+}
+
+
+static int husb238_pio_i2c_read(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, uint timeout_us) {
+    husb238_pio_i2c_t * bus = husb238_pio_bus(i2c);
+    if (len == 0 || len > HUSB238_PIO_I2C_MAX_LEN) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    uint n = husb238_pio_put_start(bus->cmds, bus->restart);
+    n += husb238_pio_put_read(bus->cmds + n, addr, len);
+    if (!nostop) {
+        n += husb238_pio_put_stop(bus->cmds + n);
+    }
+
+    int r = husb238_pio_run(bus, n, len, timeout_us);
+    if (r != PICO_OK) {
+        return r;
+    }
+    memcpy(dst, bus->rx + bus->rx_skip, len);
+    bus->restart = nostop;
+    return len;
+}
+
+
+husb238_hal_t const husb238_pio_i2c_hal = {
+    .i2c_write   = husb238_pio_i2c_write,
+    .i2c_read    = husb238_pio_i2c_read,
+    .time_us     = time_us_64,
+    .sleep_us    = sleep_us,
+    .bus_recover = NULL,
+};
+
+
+int husb238_pio_i2c_init(husb238_pio_i2c_t * bus, PIO pio, uint sda_gpio, uint baudrate) {
+    uint index = pio_get_index(pio);
+    uint scl_gpio = sda_gpio + 1;
+
+    memset(bus, 0, sizeof(*bus));
+    bus->pio = pio;
+    bus->sda_gpio = sda_gpio;
+    bus->baudrate = baudrate;
+
+    uint buses = 0;
+    for (uint i = 0; i < NUM_PIOS; ++i) {
+        buses += husb238_pio_users[i];
+    }
+    if (buses >= HUSB238_PIO_I2C_MAX_BUSES) {
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+
+    if (husb238_pio_users[index] == 0) {
+        if (!pio_can_add_program(pio, &husb238_i2c_program)) {
+            return PICO_ERROR_INSUFFICIENT_RESOURCES;
+        }
+        husb238_pio_offset[index] = pio_add_program(pio, &husb238_i2c_program);
+    }
+    bus->offset = husb238_pio_offset[index];
+
+    int sm = pio_claim_unused_sm(pio, false);
+    int tx_dma = dma_claim_unused_channel(false);
+    int rx_dma = dma_claim_unused_channel(false);
+    if (sm < 0 || tx_dma < 0 || rx_dma < 0 || husb238_set_bus_hal(&bus->key, &husb238_pio_i2c_hal) != PICO_OK) {
+        if (sm >= 0) pio_sm_unclaim(pio, sm);
+        if (tx_dma >= 0) dma_channel_unclaim(tx_dma);
+        if (rx_dma >= 0) dma_channel_unclaim(rx_dma);
+        if (husb238_pio_users[index] == 0) {
+            pio_remove_program(pio, &husb238_i2c_program, bus->offset);
+        }
+        return PICO_ERROR_INSUFFICIENT_RESOURCES;
+    }
+    husb238_pio_users[index]++;
+    bus->sm = sm;
+    bus->tx_dma = tx_dma;
+    bus->rx_dma = rx_dma;
+
+    pio_sm_config c = husb238_i2c_program_get_default_config(bus->offset);
+    sm_config_set_out_pins(&c, sda_gpio, 1);
+    sm_config_set_set_pins(&c, sda_gpio, 1);
+    sm_config_set_in_pins(&c, sda_gpio);
+    sm_config_set_sideset_pins(&c, scl_gpio);
+    sm_config_set_jmp_pin(&c, sda_gpio);
+    sm_config_set_out_shift(&c, false, true, 16);
+    sm_config_set_in_shift(&c, false, true, 8);
+    sm_config_set_clkdiv(&c, (float)clock_get_hz(clk_sys) / (HUSB238_PIO_CYCLES_PER_BIT * baudrate));
+
+    // Both lines are open drain: the state machine only ever switches
+    // their direction, and the inverted output enable makes a 1 in
+    // pindirs release the line to its pull-up.
+    uint32_t both = (1u << sda_gpio) | (1u << scl_gpio);
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+    pio_sm_set_pins_with_mask(pio, sm, both, both);
+    pio_sm_set_pindirs_with_mask(pio, sm, both, both);
+    pio_gpio_init(pio, sda_gpio);
+    gpio_set_oeover(sda_gpio, GPIO_OVERRIDE_INVERT);
+    pio_gpio_init(pio, scl_gpio);
+    gpio_set_oeover(scl_gpio, GPIO_OVERRIDE_INVERT);
+    pio_sm_set_pins_with_mask(pio, sm, 0, both);
+
+    pio_interrupt_clear(pio, sm);
+    pio_sm_init(pio, sm, bus->offset + husb238_i2c_offset_entry_point, &c);
+    pio_sm_set_enabled(pio, sm, true);
+
+    husb238_config_t config;
+    husb238_get_config(&bus->key, &config);
+    config.baudrate = baudrate;
+    config.bus_recovery = false;
+    return husb238_configure(&bus->key, &config);
+}
+
+
+void husb238_pio_i2c_deinit(husb238_pio_i2c_t * bus) {
+    uint index = pio_get_index(bus->pio);
+
+    husb238_set_bus_hal(&bus->key, NULL);
+    dma_channel_abort(bus->tx_dma);
+    dma_channel_abort(bus->rx_dma);
+    dma_channel_unclaim(bus->tx_dma);
+    dma_channel_unclaim(bus->rx_dma);
+    pio_sm_set_enabled(bus->pio, bus->sm, false);
+    pio_sm_unclaim(bus->pio, bus->sm);
+    gpio_set_oeover(bus->sda_gpio, GPIO_OVERRIDE_NORMAL);
+    gpio_set_oeover(bus->sda_gpio + 1, GPIO_OVERRIDE_NORMAL);
+
+    if (--husb238_pio_users[index] == 0) {
+        pio_remove_program(bus->pio, &husb238_i2c_program, bus->offset);
+    }
+}
+
+
+//
+// Start the same kind of stream on every bus at once and wait for them
+// all.  Buses whose results[i] is already an error are left out.
+//
+static void husb238_pio_sweep_phase(husb238_pio_i2c_t * const buses[], size_t n, int results[], bool read, uint timeout_us) {
+    static uint8_t const reg = HUSB238_I2C_REG_PD_STATUS0;
+    husb238_pio_i2c_t * active[HUSB238_MAX_BUS_HALS];
+    int active_results[HUSB238_MAX_BUS_HALS];
+    size_t n_active = 0;
+    uint32_t mask = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (results[i] != PICO_OK) {
+            continue;
+        }
+        husb238_pio_i2c_t * bus = buses[i];
+        uint k = husb238_pio_put_start(bus->cmds, bus->restart);
+        if (read) {
+            k += husb238_pio_put_read(bus->cmds + k, HUSB238_I2C_SLAVE_ADDRESS, sizeof(husb238_registers_t));
+            mask |= husb238_pio_prepare(bus, k + husb238_pio_put_stop(bus->cmds + k), 1 + sizeof(husb238_registers_t), 1);
+        } else {
+            k += husb238_pio_put_write(bus->cmds + k, HUSB238_I2C_SLAVE_ADDRESS, &reg, 1);
+            mask |= husb238_pio_prepare(bus, k + husb238_pio_put_stop(bus->cmds + k), 2, 2);
+        }
+        active[n_active++] = bus;
+    }
+
+    dma_start_channel_mask(mask);
+    husb238_pio_wait(active, n_active, active_results, husb238_pio_deadline(timeout_us));
+
+    for (size_t i = 0, j = 0; i < n; ++i) {
+        if (results[i] == PICO_OK) {
+            buses[i]->restart = false;
+            results[i] = active_results[j++];
+        }
+    }
+}
+
+
+int husb238_pio_sweep(husb238_pio_i2c_t * const buses[], size_t n, husb238_registers_t regs[], int results[], uint timeout_us) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    uint gap_us = 0;
+    int result = PICO_OK;
+
+    if (n > HUSB238_MAX_BUS_HALS) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        husb238_config_t config;
+        husb238_get_config(&buses[i]->key, &config);
+        if (config.gap_us > gap_us) {
+            gap_us = config.gap_us;
+        }
+        results[i] = PICO_OK;
+    }
+
+    husb238_pio_sweep_phase(buses, n, results, false, timeout_us);
+    if (gap_us != 0) {
+        hal->sleep_us(gap_us);
+    }
+    husb238_pio_sweep_phase(buses, n, results, true, timeout_us);
+    if (gap_us != 0) {
+        hal->sleep_us(gap_us);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        if (results[i] == PICO_OK) {
+            memcpy(&regs[i], buses[i]->rx + buses[i]->rx_skip, sizeof(regs[i]));
+        } else if (result == PICO_OK) {
+            result = results[i];
+        }
+    }
+    return result;
+}
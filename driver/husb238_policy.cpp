@@ -0,0 +1,283 @@
+#include <hardware/i2c.h>
+
+#include "husb238.h"
+#include "husb238_hal.h"
+#include "husb238_log.h"
+#include "husb238_policy.h"
+
+
+static bool husb238_policy_allows(husb238_policy_t const * policy, husb238_pdo_fixed_t const * pdo) {
+    if (pdo->max_ma == 0 || pdo->max_ma < policy->min_ma) {
+        return false;
+    }
+    if (pdo->mv < policy->min_mv) {
+        return false;
+    }
+    if (policy->max_mv != 0 && pdo->mv > policy->max_mv) {
+        return false;
+    }
+    return true;
+}
+
+
+// Position of `mv` in the policy's preferred list, or 6 if it's not
+// there.
+static int husb238_policy_preference(husb238_policy_t const * policy, uint16_t mv) {
+    for (int i = 0; i < 6 && policy->preferred_mv[i] != 0; ++i) {
+        if (policy->preferred_mv[i] == mv) {
+            return i;
+        }
+    }
+    return 6;
+}
+
+
+// True if `a` should be tried before `b`.
+static bool husb238_policy_before(husb238_policy_t const * policy, husb238_pdo_fixed_t const * a, husb238_pdo_fixed_t const * b) {
+    int pa = husb238_policy_preference(policy, a->mv);
+    int pb = husb238_policy_preference(policy, b->mv);
+    if (pa != pb) {
+        return pa < pb;
+    }
+    uint32_t mwa = husb238_pdo_mw(a);
+    uint32_t mwb = husb238_pdo_mw(b);
+    if (mwa != mwb) {
+        return mwa > mwb;
+    }
+    return a->mv < b->mv;
+}
+
+
+// Fill `candidates` with the PDOs the policy allows, best first.
+// Returns how many there are.
+static int husb238_policy_rank(husb238_policy_t const * policy, husb238_pdo_fixed_t const pdos[6], husb238_pdo_fixed_t candidates[6]) {
+    int n = 0;
+
+    for (int i = 0; i < 6; ++i) {
+        if (!husb238_policy_allows(policy, &pdos[i])) {
+            continue;
+        }
+        int j = n++;
+        while (j > 0 && husb238_policy_before(policy, &pdos[i], &candidates[j - 1])) {
+            candidates[j] = candidates[j - 1];
+            --j;
+        }
+        candidates[j] = pdos[i];
+    }
+    return n;
+}
+
+
+// Does the HUSB238 report an attached source, and a contract at the
+// candidate's voltage?
+static bool husb238_policy_in_contract(husb238_registers_t const * regs, husb238_pdo_fixed_t const * pdo) {
+    uint16_t mv, ma;
+
+    if (!husb238_attached(regs->pd_status1)) {
+        return false;
+    }
+    husb238_snapshot_get_contract_mv_ma(regs, &mv, &ma);
+    return mv == pdo->mv;
+}
+
+
+// Select `pdo` and check that the contract followed.  On success
+// *latency_us is how long the HUSB238 took.
+static int husb238_policy_attempt(i2c_inst_t * i2c, husb238_pdo_fixed_t const * pdo, uint32_t timeout_us, uint32_t * latency_us) {
+    husb238_registers_t regs;
+    husb238_select_t op = {};
+    int r;
+
+    op.timeout_us = timeout_us;
+    r = husb238_select_pdo_begin(i2c, &op, pdo->id);
+    if (r == PICO_OK) {
+        while ((r = husb238_poll(i2c, &op)) == HUSB238_IN_PROGRESS) {
+            husb238_get_hal()->sleep_us(HUSB238_SELECT_PDO_POLL_US);
+        }
+    }
+
+    if (r == PICO_OK) {
+        r = husb238_read_snapshot(i2c, &regs);
+    }
+    if (r == PICO_OK && !husb238_policy_in_contract(&regs, pdo)) {
+        HUSB238_ERROR(POLICY_CONTRACT_MISMATCH, pdo->mv);
+        r = PICO_ERROR_GENERIC;
+    }
+    *latency_us = op.latency_us;
+    return r;
+}
+
+
+// Is anything still attached to ask?
+static bool husb238_policy_source_present(i2c_inst_t * i2c) {
+    uint8_t pd_status1;
+    return husb238_read_pd_status1(i2c, &pd_status1) == PICO_OK && husb238_attached(pd_status1);
+}
+
+
+//
+// The negotiation proper, from a snapshot taken at `start_us` with a
+// source attached.  `skip` is a PDO already tried, and attempts already
+// made are counted in *result.
+//
+static int husb238_policy_negotiate(i2c_inst_t * i2c, husb238_policy_t const * policy, husb238_registers_t const * regs, int skip, uint64_t start_us, husb238_negotiation_t * result) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    husb238_pdo_fixed_t pdos[6];
+    husb238_pdo_fixed_t candidates[6];
+    int r;
+
+    husb238_snapshot_get_pdos_fixed(regs, pdos);
+    int n = husb238_policy_rank(policy, pdos, candidates);
+    result->candidates = n;
+    if (n == 0) {
+        HUSB238_ERROR(POLICY_NO_CANDIDATE);
+        return PICO_ERROR_NO_DATA;
+    }
+
+    // Already there?
+    if (husb238_policy_in_contract(regs, &candidates[0])) {
+        result->pdo = candidates[0];
+        result->time_to_contract_us = hal->time_us() - start_us;
+        return PICO_OK;
+    }
+
+    r = result->attempts > 0 ? result->last_error : PICO_ERROR_NO_DATA;
+    for (int i = 0; i < n; ++i) {
+        if (candidates[i].id == skip) {
+            continue;
+        }
+        if (policy->max_attempts != 0 && result->attempts >= policy->max_attempts) {
+            break;
+        }
+        result->attempts++;
+
+        uint32_t latency_us;
+        r = husb238_policy_attempt(i2c, &candidates[i], policy->timeout_us, &latency_us);
+        if (r == PICO_OK) {
+            result->pdo = candidates[i];
+            result->negotiation_us = latency_us;
+            result->time_to_contract_us = hal->time_us() - start_us;
+            HUSB238_PRINT(POLICY_NEGOTIATED, candidates[i].mv, candidates[i].max_ma, result->attempts, result->time_to_contract_us);
+            return PICO_OK;
+        }
+
+        result->last_error = r;
+        if (!husb238_policy_source_present(i2c)) {
+            // The source went away, there's nobody left to ask.
+            break;
+        }
+    }
+
+    return r;
+}
+
+
+int husb238_negotiate(i2c_inst_t * i2c, husb238_policy_t const * policy, husb238_negotiation_t * result) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    uint64_t start_us = hal->time_us();
+    husb238_registers_t regs;
+    int r;
+
+    *result = {};
+
+    r = husb238_read_snapshot(i2c, &regs);
+    if (r != PICO_OK) return r;
+
+    if (!husb238_attached(regs.pd_status1)) {
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+
+    return husb238_policy_negotiate(i2c, policy, &regs, HUSB238_SRC_PDO_NONE, start_us, result);
+}
+
+
+int husb238_negotiate_cached(i2c_inst_t * i2c, husb238_policy_t const * policy, husb238_source_cache_t * cache, husb238_negotiation_t * result) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    uint64_t start_us = hal->time_us();
+    husb238_registers_t regs;
+    husb238_source_entry_t entry;
+    int skip = HUSB238_SRC_PDO_NONE;
+    int r;
+
+    *result = {};
+
+    r = husb238_read_snapshot(i2c, &regs);
+    if (r != PICO_OK) return r;
+
+    if (!husb238_attached(regs.pd_status1)) {
+        return PICO_ERROR_NOT_PERMITTED;
+    }
+
+    uint32_t fingerprint = husb238_source_fingerprint(&regs);
+    bool known = husb238_source_cache_lookup(cache, fingerprint, &entry);
+    if (known) {
+        husb238_pdo_fixed_t pdos[6];
+        husb238_pdo_fixed_t const * pdo = NULL;
+
+        husb238_snapshot_get_pdos_fixed(&regs, pdos);
+        for (int i = 0; i < 6; ++i) {
+            if (pdos[i].id == entry.pdo && husb238_policy_allows(policy, &pdos[i])) {
+                pdo = &pdos[i];
+            }
+        }
+
+        if (pdo != NULL && husb238_policy_in_contract(&regs, pdo)) {
+            result->pdo = *pdo;
+            result->cached = true;
+            result->time_to_contract_us = hal->time_us() - start_us;
+            return PICO_OK;
+        }
+
+        if (pdo != NULL) {
+            uint32_t timeout_us = policy->timeout_us != 0 ? policy->timeout_us : HUSB238_SELECT_PDO_TIMEOUT_US;
+            uint64_t expected_us = (uint64_t)entry.negotiation_us * 4;
+            if (expected_us < HUSB238_CACHED_MIN_TIMEOUT_US) {
+                expected_us = HUSB238_CACHED_MIN_TIMEOUT_US;
+            }
+            if (expected_us < timeout_us) {
+                timeout_us = expected_us;
+            }
+
+            result->attempts++;
+            uint32_t latency_us;
+            r = husb238_policy_attempt(i2c, pdo, timeout_us, &latency_us);
+            if (r == PICO_OK) {
+                result->pdo = *pdo;
+                result->cached = true;
+                result->negotiation_us = latency_us;
+                result->time_to_contract_us = hal->time_us() - start_us;
+                HUSB238_PRINT(POLICY_NEGOTIATED, pdo->mv, pdo->max_ma, result->attempts, result->time_to_contract_us);
+            } else {
+                HUSB238_PRINT(POLICY_CACHED_FAILED, entry.pdo, fingerprint, r);
+                result->last_error = r;
+                skip = entry.pdo;
+                if (policy->max_attempts != 0 && result->attempts >= policy->max_attempts) {
+                    return r;
+                }
+                // The source may have gone, or taken a different contract.
+                if (husb238_read_snapshot(i2c, &regs) != PICO_OK || !husb238_attached(regs.pd_status1)) {
+                    return r;
+                }
+            }
+        }
+    }
+
+    if (!result->cached) {
+        r = husb238_policy_negotiate(i2c, policy, &regs, skip, start_us, result);
+        if (r != PICO_OK) {
+            return r;
+        }
+    }
+
+    // Nothing was sent if the contract was already right; keep the time
+    // from when something was.
+    uint32_t negotiation_us = result->negotiation_us;
+    if (negotiation_us == 0 && known && entry.pdo == result->pdo.id) {
+        negotiation_us = entry.negotiation_us;
+    }
+    int s = husb238_source_cache_store(cache, fingerprint, result->pdo.id, negotiation_us);
+    if (s != PICO_OK) {
+        HUSB238_ERROR(SOURCE_CACHE_FAILED, fingerprint, s);
+    }
+    return PICO_OK;
+}
@@ -0,0 +1,97 @@
+#include "husb238_regs.h"
+
+
+//
+// Compile-time checks of the decoders in husb238_regs.h, over every
+// value of every register.  Nothing here generates code; if this file
+// compiles, the checks passed.
+//
+
+
+static constexpr bool husb238_check_tables(void) {
+    // Contract and PDO currents increase with the code, and stay within
+    // what USB PD allows.
+    for (int i = 1; i < 16; ++i) {
+        if (husb238_pd_src_ma[i] <= husb238_pd_src_ma[i - 1]) return false;
+    }
+    if (husb238_pd_src_ma[0] == 0 || husb238_pd_src_ma[15] > 5000) return false;
+
+    // Defined voltages increase with the code; the rest are "no contract".
+    for (int i = 2; i <= HUSB238_NUM_PDOS; ++i) {
+        if (husb238_pd_src_mv[i] <= husb238_pd_src_mv[i - 1]) return false;
+    }
+    if (husb238_pd_src_mv[0] != 0) return false;
+    for (int i = HUSB238_NUM_PDOS + 1; i < 16; ++i) {
+        if (husb238_pd_src_mv[i] != 0) return false;
+    }
+    return true;
+}
+
+
+static constexpr bool husb238_check_pd_status0(void) {
+    for (int v = 0; v < 256; ++v) {
+        husb238_pd_status0_t s = husb238_decode_pd_status0(v);
+        if (((s.voltage_code << 4) | s.current_code) != v) return false;
+
+        bool defined = s.voltage_code >= 1 && s.voltage_code <= HUSB238_NUM_PDOS;
+        if (defined != (s.mv != 0)) return false;
+        if (defined && s.mv != husb238_pdo_index_mv(s.voltage_code - 1)) return false;
+        if (defined && s.ma != husb238_pd_src_ma[s.current_code]) return false;
+        if (!defined && s.ma != 0) return false;
+    }
+    return true;
+}
+
+
+static constexpr bool husb238_check_pd_status1(void) {
+    for (int v = 0; v < 256; ++v) {
+        husb238_pd_status1_t s = husb238_decode_pd_status1(v);
+        if (husb238_encode_pd_status1(s) != v) return false;
+        if (s.attached != husb238_attached(v)) return false;
+        if (s.pd_response > 7 || s.pd_response != husb238_pd_response(v)) return false;
+        if (s.ma_5v > 3000 || (s.current_5v_code == 0) != (s.ma_5v == 0)) return false;
+        if (husb238_pd_response_str(s.pd_response) == nullptr) return false;
+    }
+    return true;
+}
+
+
+static constexpr bool husb238_check_src_pdo_regs(void) {
+    for (int v = 0; v < 256; ++v) {
+        husb238_src_pdo_reg_t p = husb238_decode_src_pdo_reg(v);
+        if (p.detected != ((v & 0x80) != 0)) return false;
+        if (p.current_code != (v & 0x0f)) return false;
+        if (p.detected && p.max_ma != husb238_pd_src_ma[v & 0x0f]) return false;
+        if (!p.detected && p.max_ma != 0) return false;
+    }
+    return true;
+}
+
+
+static constexpr bool husb238_check_src_pdo(void) {
+    // Every PDO round-trips through its SRC_PDO value and its voltage.
+    for (int i = 0; i < HUSB238_NUM_PDOS; ++i) {
+        if (husb238_decode_src_pdo(husb238_encode_src_pdo(i)) != i) return false;
+        if (husb238_encode_src_pdo_mv(husb238_pdo_index_mv(i)) != husb238_encode_src_pdo(i)) return false;
+    }
+    if (husb238_encode_src_pdo(-1) != HUSB238_SRC_PDO_NONE) return false;
+    if (husb238_encode_src_pdo(HUSB238_NUM_PDOS) != HUSB238_SRC_PDO_NONE) return false;
+    if (husb238_encode_src_pdo_mv(0) != HUSB238_SRC_PDO_NONE) return false;
+
+    // Every register value decodes to a known PDO that encodes back to
+    // its upper nibble, or to none; the lower nibble is ignored.
+    for (int v = 0; v < 256; ++v) {
+        int i = husb238_decode_src_pdo(v);
+        if (i < -1 || i >= HUSB238_NUM_PDOS) return false;
+        if (i >= 0 && husb238_encode_src_pdo(i) != (v & 0xf0)) return false;
+        if (husb238_decode_src_pdo(v & 0xf0) != i) return false;
+    }
+    return husb238_decode_src_pdo(HUSB238_SRC_PDO_NONE) == -1;
+}
+
+
+static_assert(husb238_check_tables(), "HUSB238 decode tables are inconsistent");
+static_assert(husb238_check_pd_status0(), "PD_STATUS0 decoding is wrong");
+static_assert(husb238_check_pd_status1(), "PD_STATUS1 decoding is wrong");
+static_assert(husb238_check_src_pdo_regs(), "SRC_PDO_* decoding is wrong");
+static_assert(husb238_check_src_pdo(), "SRC_PDO encoding or decoding is wrong");
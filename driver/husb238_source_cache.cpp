@@ -0,0 +1,322 @@
+#include <string.h>
+
+#include "husb238_source_cache.h"
+
+
+#define HUSB238_RECORD_ERASED (0xff)
+#define HUSB238_RECORD_HEADER (0x5a)
+#define HUSB238_RECORD_ENTRY (0xa5)
+
+#define HUSB238_FLASH_MAX_PAGE (256)
+
+//
+// The on-flash record.  A header uses `key` for the sector's sequence
+// number and `count` for the entries copied in after it; an entry uses
+// `key` for the fingerprint.
+//
+typedef struct {
+    uint8_t kind;             // HUSB238_RECORD_*.
+    uint8_t pdo;
+    uint16_t count;
+    uint32_t key;
+    uint32_t negotiation_us;
+    uint32_t check;           // FNV-1a of the fields above.
+} husb238_record_t;
+
+static_assert(sizeof(husb238_record_t) == 16);
+
+
+static uint32_t husb238_fnv1a(void const * data, size_t len) {
+    uint8_t const * p = (uint8_t const *)data;
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+uint32_t husb238_source_fingerprint(husb238_registers_t const * regs) {
+    return husb238_fnv1a(regs->src_pdos, sizeof(regs->src_pdos));
+}
+
+
+static uint32_t husb238_record_check(husb238_record_t const * rec) {
+    return husb238_fnv1a(rec, offsetof(husb238_record_t, check));
+}
+
+
+static bool husb238_record_erased(husb238_record_t const * rec) {
+    uint8_t const * p = (uint8_t const *)rec;
+    for (size_t i = 0; i < sizeof(*rec); ++i) {
+        if (p[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static bool husb238_record_valid(husb238_record_t const * rec) {
+    return (rec->kind == HUSB238_RECORD_HEADER || rec->kind == HUSB238_RECORD_ENTRY)
+        && rec->check == husb238_record_check(rec);
+}
+
+
+static int husb238_record_read(husb238_source_cache_t * cache, uint32_t sector, uint32_t offset, husb238_record_t * rec) {
+    husb238_flash_t const * flash = cache->flash;
+    return flash->read(flash, sector * flash->sector_size + offset, rec, sizeof(*rec));
+}
+
+
+// Write `rec` at the end of the sector being written.  The page it's in
+// is programmed with 0xff everywhere else, which leaves the records
+// already there alone.
+static int husb238_record_append(husb238_source_cache_t * cache, husb238_record_t * rec) {
+    husb238_flash_t const * flash = cache->flash;
+    uint8_t page[HUSB238_FLASH_MAX_PAGE];
+    uint32_t sector_offset = cache->sector * flash->sector_size;
+    uint32_t page_offset = cache->write_offset & ~(flash->page_size - 1);
+    int r;
+
+    rec->check = husb238_record_check(rec);
+    memset(page, 0xff, flash->page_size);
+    memcpy(&page[cache->write_offset - page_offset], rec, sizeof(*rec));
+
+    r = flash->program(flash, sector_offset + page_offset, page, flash->page_size);
+    if (r != PICO_OK) {
+        return r;
+    }
+    cache->programs++;
+
+    husb238_record_t readback;
+    r = husb238_record_read(cache, cache->sector, cache->write_offset, &readback);
+    if (r != PICO_OK) {
+        return r;
+    }
+    cache->write_offset += sizeof(*rec);
+    if (memcmp(&readback, rec, sizeof(*rec)) != 0) {
+        return PICO_ERROR_IO;
+    }
+    return PICO_OK;
+}
+
+
+// Erase the next sector round, and fill it with a header and every live
+// entry.
+static int husb238_start_sector(husb238_source_cache_t * cache) {
+    husb238_flash_t const * flash = cache->flash;
+    uint32_t sector = (cache->sector + 1) % flash->sectors;
+    int r;
+
+    r = flash->erase(flash, sector * flash->sector_size);
+    if (r != PICO_OK) {
+        return r;
+    }
+    cache->erases++;
+    cache->sector = sector;
+    cache->sector_seq++;
+    cache->write_offset = 0;
+
+    husb238_record_t header = {
+        .kind = HUSB238_RECORD_HEADER,
+        .count = cache->count,
+        .key = cache->sector_seq,
+    };
+    r = husb238_record_append(cache, &header);
+    if (r != PICO_OK) {
+        return r;
+    }
+
+    // Oldest first, so that replaying the sector stamps them in the same
+    // order.
+    uint32_t after = 0;
+    for (uint8_t n = 0; n < cache->count; ++n) {
+        husb238_source_entry_t const * e = NULL;
+        for (uint8_t i = 0; i < cache->count; ++i) {
+            if (cache->entries[i].stamp > after && (e == NULL || cache->entries[i].stamp < e->stamp)) {
+                e = &cache->entries[i];
+            }
+        }
+        after = e->stamp;
+
+        husb238_record_t rec = {
+            .kind = HUSB238_RECORD_ENTRY,
+            .pdo = e->pdo,
+            .key = e->fingerprint,
+            .negotiation_us = e->negotiation_us,
+        };
+        r = husb238_record_append(cache, &rec);
+        if (r != PICO_OK) {
+            return r;
+        }
+    }
+    return PICO_OK;
+}
+
+
+// Put an entry in the table, in place of one with the same fingerprint
+// or, if the table is full, the one stored longest ago.
+static void husb238_source_cache_put(husb238_source_cache_t * cache, uint32_t fingerprint, uint8_t pdo, uint32_t negotiation_us) {
+    husb238_source_entry_t * slot = NULL;
+
+    for (uint8_t i = 0; i < cache->count; ++i) {
+        if (cache->entries[i].fingerprint == fingerprint) {
+            slot = &cache->entries[i];
+            break;
+        }
+    }
+    if (slot == NULL && cache->count < HUSB238_SOURCE_CACHE_ENTRIES) {
+        slot = &cache->entries[cache->count++];
+    }
+    if (slot == NULL) {
+        slot = &cache->entries[0];
+        for (uint8_t i = 1; i < cache->count; ++i) {
+            if (cache->entries[i].stamp < slot->stamp) {
+                slot = &cache->entries[i];
+            }
+        }
+    }
+
+    slot->fingerprint = fingerprint;
+    slot->pdo = pdo;
+    slot->negotiation_us = negotiation_us;
+    slot->stamp = ++cache->stamp;
+}
+
+
+//
+// Load the table from `sector`.  Returns true if the sector is complete:
+// a valid header followed by at least the entries it says were copied
+// in.  The write position is left after the last record written.
+//
+static bool husb238_replay_sector(husb238_source_cache_t * cache, uint32_t sector) {
+    husb238_flash_t const * flash = cache->flash;
+    husb238_record_t rec;
+    uint32_t entries = 0;
+
+    cache->count = 0;
+    cache->stamp = 0;
+    if (husb238_record_read(cache, sector, 0, &rec) != PICO_OK
+        || !husb238_record_valid(&rec) || rec.kind != HUSB238_RECORD_HEADER) {
+        return false;
+    }
+    uint32_t copied = rec.count;
+    cache->sector = sector;
+    cache->sector_seq = rec.key;
+
+    uint32_t offset;
+    for (offset = sizeof(rec); offset + sizeof(rec) <= flash->sector_size; offset += sizeof(rec)) {
+        if (husb238_record_read(cache, sector, offset, &rec) != PICO_OK || husb238_record_erased(&rec)) {
+            break;
+        }
+        // A torn write is skipped; the next one went in after it.
+        if (husb238_record_valid(&rec) && rec.kind == HUSB238_RECORD_ENTRY) {
+            husb238_source_cache_put(cache, rec.key, rec.pdo, rec.negotiation_us);
+            entries++;
+        }
+    }
+    cache->write_offset = offset;
+    return entries >= copied;
+}
+
+
+int husb238_source_cache_mount(husb238_source_cache_t * cache, husb238_flash_t const * flash) {
+    uint32_t record_size = sizeof(husb238_record_t);
+
+    *cache = {};
+    cache->flash = flash;
+    if (flash->sectors < 2 || flash->page_size > HUSB238_FLASH_MAX_PAGE
+        || flash->page_size % record_size != 0 || flash->sector_size % flash->page_size != 0
+        || flash->sector_size < 2 * (HUSB238_SOURCE_CACHE_ENTRIES + 1) * record_size) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // The newest complete sector.  One left incomplete by a power cut
+    // while it was being started falls back to the one before.
+    uint32_t tried = 0;
+    uint32_t max_seq = 0;
+    while (true) {
+        uint32_t best = flash->sectors;
+        uint32_t best_seq = 0;
+        for (uint32_t s = 0; s < flash->sectors; ++s) {
+            husb238_record_t rec;
+            if (husb238_record_read(cache, s, 0, &rec) != PICO_OK
+                || !husb238_record_valid(&rec) || rec.kind != HUSB238_RECORD_HEADER) {
+                continue;
+            }
+            if (rec.key > max_seq) {
+                max_seq = rec.key;
+            }
+            if ((tried == 0 || rec.key < tried) && rec.key > best_seq) {
+                best = s;
+                best_seq = rec.key;
+            }
+        }
+        if (best == flash->sectors) {
+            break;
+        }
+        if (husb238_replay_sector(cache, best)) {
+            return PICO_OK;
+        }
+        tried = best_seq;
+    }
+
+    // Nothing usable: start over at sector 0, numbered after anything
+    // left in the region so that stale sectors never look newer.
+    cache->count = 0;
+    cache->stamp = 0;
+    cache->sector = flash->sectors - 1;
+    cache->sector_seq = max_seq;
+    return husb238_start_sector(cache);
+}
+
+
+bool husb238_source_cache_lookup(husb238_source_cache_t * cache, uint32_t fingerprint, husb238_source_entry_t * entry) {
+    for (uint8_t i = 0; i < cache->count; ++i) {
+        if (cache->entries[i].fingerprint == fingerprint) {
+            *entry = cache->entries[i];
+            cache->hits++;
+            return true;
+        }
+    }
+    cache->misses++;
+    return false;
+}
+
+
+int husb238_source_cache_store(husb238_source_cache_t * cache, uint32_t fingerprint, uint8_t pdo, uint32_t negotiation_us) {
+    for (uint8_t i = 0; i < cache->count; ++i) {
+        husb238_source_entry_t const * e = &cache->entries[i];
+        if (e->fingerprint == fingerprint && e->pdo == pdo) {
+            uint32_t diff = e->negotiation_us > negotiation_us ? e->negotiation_us - negotiation_us : negotiation_us - e->negotiation_us;
+            if (diff <= e->negotiation_us / 4) {
+                return PICO_OK;
+            }
+        }
+    }
+
+    husb238_source_cache_put(cache, fingerprint, pdo, negotiation_us);
+
+    // A full sector moves the whole table, this entry included, to the
+    // next one.
+    if (cache->write_offset + sizeof(husb238_record_t) > cache->flash->sector_size) {
+        return husb238_start_sector(cache);
+    }
+
+    husb238_record_t rec = {
+        .kind = HUSB238_RECORD_ENTRY,
+        .pdo = pdo,
+        .key = fingerprint,
+        .negotiation_us = negotiation_us,
+    };
+    return husb238_record_append(cache, &rec);
+}
+
+
+int husb238_source_cache_clear(husb238_source_cache_t * cache) {
+    cache->count = 0;
+    return husb238_start_sector(cache);
+}
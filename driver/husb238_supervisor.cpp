@@ -0,0 +1,249 @@
+#include <hardware/i2c.h>
+
+#include "husb238.h"
+#include "husb238_hal.h"
+#include "husb238_log.h"
+#include "husb238_supervisor.h"
+
+
+void husb238_supervisor_init(husb238_supervisor_t * sv, i2c_inst_t * i2c, husb238_supervisor_config_t const * config, husb238_supervisor_callbacks_t const * callbacks) {
+    *sv = {};
+    sv->i2c = i2c;
+    if (config != NULL) {
+        sv->config = *config;
+    }
+    if (sv->config.interval_us == 0) {
+        sv->config.interval_us = HUSB238_SUPERVISOR_INTERVAL_US;
+    }
+    if (sv->config.backoff_min_us == 0) {
+        sv->config.backoff_min_us = HUSB238_SUPERVISOR_BACKOFF_MIN_US;
+    }
+    if (sv->config.backoff_max_us == 0) {
+        sv->config.backoff_max_us = HUSB238_SUPERVISOR_BACKOFF_MAX_US;
+    }
+    if (callbacks != NULL) {
+        sv->callbacks = *callbacks;
+    }
+    sv->target_pdo = HUSB238_SRC_PDO_NONE;
+    sv->state = HUSB238_SUPERVISOR_IDLE;
+}
+
+
+int husb238_supervisor_set_target(husb238_supervisor_t * sv, int pdo) {
+    husb238_hal_t const * hal = husb238_get_hal();
+
+    if (pdo == HUSB238_SRC_PDO_NONE) {
+        sv->target_pdo = pdo;
+        sv->target_mv = 0;
+        sv->state = HUSB238_SUPERVISOR_IDLE;
+        return PICO_OK;
+    }
+
+    int index = husb238_decode_src_pdo(pdo);
+    if (index < 0) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+
+    // A SELECT_PDO still in flight is left to finish on its own.
+    sv->target_pdo = pdo;
+    sv->target_mv = husb238_pdo_index_mv(index);
+    sv->state = HUSB238_SUPERVISOR_RESTORING;
+    sv->reason = HUSB238_SUPERVISOR_LOST_NONE;
+    sv->select = {};
+    sv->backoff_us = sv->config.backoff_min_us;
+    sv->lost_us = 0;
+    sv->over_budget = false;
+    sv->next_us = hal->time_us();
+    return PICO_OK;
+}
+
+
+//
+// Read PD_STATUS0 and PD_STATUS1, and say what, if anything, is wrong
+// with the contract.  A change of PD_RESPONSE to a failure code only
+// counts if the contract is otherwise fine.
+//
+static husb238_supervisor_reason_t husb238_supervisor_check(husb238_supervisor_t * sv, uint16_t * mv) {
+    husb238_registers_t regs;
+    uint16_t ma;
+
+    sv->checks++;
+    *mv = 0;
+    if (husb238_read_registers(sv->i2c, HUSB238_I2C_REG_PD_STATUS0, &regs.pd_status0, 2) != PICO_OK) {
+        return HUSB238_SUPERVISOR_LOST_NOT_RESPONDING;
+    }
+
+    uint8_t old_response = sv->pd_response;
+    sv->pd_response = husb238_pd_response(regs.pd_status1);
+
+    if (!husb238_attached(regs.pd_status1)) {
+        return HUSB238_SUPERVISOR_LOST_DETACHED;
+    }
+    husb238_snapshot_get_contract_mv_ma(&regs, mv, &ma);
+    if (*mv != sv->target_mv) {
+        return HUSB238_SUPERVISOR_LOST_CONTRACT;
+    }
+    if (sv->pd_response != old_response
+        && sv->pd_response != HUSB238_PD_RESPONSE_NONE
+        && sv->pd_response != HUSB238_PD_RESPONSE_SUCCESS) {
+        return HUSB238_SUPERVISOR_LOST_PD_RESPONSE;
+    }
+    return HUSB238_SUPERVISOR_LOST_NONE;
+}
+
+
+// An attempt failed; wait a while, longer each time, before the next.
+static void husb238_supervisor_back_off(husb238_supervisor_t * sv, uint64_t now) {
+    sv->select = {};
+    sv->failures++;
+    sv->next_us = now + sv->backoff_us;
+    sv->backoff_us *= 2;
+    if (sv->backoff_us > sv->config.backoff_max_us) {
+        sv->backoff_us = sv->config.backoff_max_us;
+    }
+}
+
+
+// Start selecting the target PDO.
+static void husb238_supervisor_attempt(husb238_supervisor_t * sv, uint64_t now) {
+    sv->state = HUSB238_SUPERVISOR_RESTORING;
+    sv->attempts++;
+    sv->select = {};
+    sv->select.timeout_us = sv->config.timeout_us;
+    if (husb238_select_pdo_begin(sv->i2c, &sv->select, sv->target_pdo) == PICO_OK) {
+        sv->next_us = now + HUSB238_SUPERVISOR_POLL_US;
+        return;
+    }
+    husb238_supervisor_back_off(sv, now);
+}
+
+
+static void husb238_supervisor_lost(husb238_supervisor_t * sv, husb238_supervisor_reason_t reason, uint16_t mv, uint64_t now) {
+    husb238_supervisor_callbacks_t const * cb = &sv->callbacks;
+
+    uint32_t detect_us = now - sv->last_good_us;
+    sv->last_detect_us = detect_us;
+    if (detect_us > sv->max_detect_us) {
+        sv->max_detect_us = detect_us;
+    }
+    sv->losses++;
+    sv->lost_us = now;
+    sv->reason = reason;
+    sv->over_budget = false;
+    sv->backoff_us = sv->config.backoff_min_us;
+    sv->select = {};
+    HUSB238_ERROR(SUPERVISOR_LOST, reason, mv, sv->pd_response);
+
+    if (cb->lost) cb->lost(cb->ctx, reason, mv, sv->pd_response);
+}
+
+
+static void husb238_supervisor_restored(husb238_supervisor_t * sv, uint64_t now) {
+    husb238_supervisor_callbacks_t const * cb = &sv->callbacks;
+
+    sv->state = HUSB238_SUPERVISOR_HOLDING;
+    sv->reason = HUSB238_SUPERVISOR_LOST_NONE;
+    sv->select = {};
+    sv->last_good_us = now;
+    sv->next_us = now + sv->config.interval_us;
+    sv->backoff_us = sv->config.backoff_min_us;
+    if (sv->lost_us == 0) {
+        // Established for the first time, nothing was lost.
+        return;
+    }
+
+    uint32_t restore_us = now - sv->lost_us;
+    sv->last_restore_us = restore_us;
+    if (restore_us > sv->max_restore_us) {
+        sv->max_restore_us = restore_us;
+    }
+    sv->restores++;
+    sv->lost_us = 0;
+    HUSB238_PRINT(SUPERVISOR_RESTORED, sv->last_detect_us, restore_us);
+
+    if (cb->restored) cb->restored(cb->ctx, sv->last_detect_us, restore_us);
+}
+
+
+husb238_supervisor_state_t husb238_supervisor_poll(husb238_supervisor_t * sv) {
+    husb238_hal_t const * hal = husb238_get_hal();
+    husb238_supervisor_callbacks_t const * cb = &sv->callbacks;
+
+    uint64_t now = hal->time_us();
+    if (sv->state == HUSB238_SUPERVISOR_IDLE) {
+        return sv->state;
+    }
+
+    if (sv->lost_us != 0 && sv->config.restore_budget_us != 0 && !sv->over_budget
+        && now - sv->lost_us > sv->config.restore_budget_us) {
+        sv->over_budget = true;
+        sv->over_budgets++;
+        if (cb->budget_exceeded) cb->budget_exceeded(cb->ctx, now - sv->lost_us);
+    }
+
+    if (now < sv->next_us) {
+        return sv->state;
+    }
+
+    if (sv->select.busy) {
+        int r = husb238_poll(sv->i2c, &sv->select);
+        now = hal->time_us();
+        if (r == HUSB238_IN_PROGRESS) {
+            sv->next_us = now + HUSB238_SUPERVISOR_POLL_US;
+        } else if (r == PICO_OK) {
+            // Check on the next poll that the contract followed.
+            sv->next_us = now;
+        } else {
+            husb238_supervisor_back_off(sv, now);
+        }
+        return sv->state;
+    }
+
+    uint16_t mv;
+    husb238_supervisor_reason_t reason = husb238_supervisor_check(sv, &mv);
+    now = hal->time_us();
+
+    if (sv->state == HUSB238_SUPERVISOR_HOLDING) {
+        if (reason == HUSB238_SUPERVISOR_LOST_NONE) {
+            sv->last_good_us = now;
+            sv->next_us = now + sv->config.interval_us;
+            return sv->state;
+        }
+        husb238_supervisor_lost(sv, reason, mv, now);
+    } else if (reason == HUSB238_SUPERVISOR_LOST_NONE || reason == HUSB238_SUPERVISOR_LOST_PD_RESPONSE) {
+        // While restoring, a failure code is most likely from our own
+        // attempts; all that matters is the contract.
+        husb238_supervisor_restored(sv, now);
+        return sv->state;
+    }
+
+    switch (reason) {
+        case HUSB238_SUPERVISOR_LOST_NOT_RESPONDING:
+        case HUSB238_SUPERVISOR_LOST_DETACHED:
+            sv->state = HUSB238_SUPERVISOR_DETACHED;
+            sv->next_us = now + sv->config.interval_us;
+            break;
+
+        default:
+            if (mv == 0) {
+                // Attached, but the source hasn't sent its capabilities
+                // yet; there's nothing to select from.
+                sv->state = HUSB238_SUPERVISOR_DETACHED;
+                sv->next_us = now + sv->config.interval_us;
+                break;
+            }
+            if (sv->state == HUSB238_SUPERVISOR_DETACHED) {
+                // Back again: start over with short waits.
+                sv->backoff_us = sv->config.backoff_min_us;
+            }
+            if (sv->select.pdo != HUSB238_SRC_PDO_NONE) {
+                // The HUSB238 reported success, but the contract didn't
+                // follow.
+                husb238_supervisor_back_off(sv, now);
+            } else {
+                husb238_supervisor_attempt(sv, now);
+            }
+            break;
+    }
+    return sv->state;
+}
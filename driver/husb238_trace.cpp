@@ -0,0 +1,170 @@
+#include <atomic>
+#include <stdio.h>
+
+#include <pico/types.h>
+
+#include "husb238_ring.h"
+#include "husb238_trace.h"
+
+
+static husb238_spsc_ring<husb238_trace_entry_t, HUSB238_TRACE_ENTRIES> husb238_trace_ring;
+// Counted by the producer only, with a plain load and store, and never
+// reset; the consumer remembers how many it has already taken.
+static std::atomic<uint32_t> husb238_trace_dropped{0};
+static uint32_t husb238_trace_dropped_taken = 0;
+static bool husb238_trace_enabled = true;
+
+static husb238_histogram_t husb238_histograms[HUSB238_OP_COUNT];
+
+
+void husb238_trace_enable(bool enable) {
+    husb238_trace_enabled = enable;
+}
+
+
+uint32_t husb238_trace_snapshot(husb238_trace_entry_t * entries, uint32_t max) {
+    return husb238_trace_ring.peek(entries, max);
+}
+
+
+uint32_t husb238_trace_drain(husb238_trace_entry_t * entries, uint32_t max) {
+    uint32_t n = 0;
+    while (n < max && husb238_trace_ring.pop(entries[n])) {
+        ++n;
+    }
+    return n;
+}
+
+
+uint32_t husb238_trace_take_dropped(void) {
+    uint32_t dropped = husb238_trace_dropped.load(std::memory_order_relaxed);
+    uint32_t taken = dropped - husb238_trace_dropped_taken;
+    husb238_trace_dropped_taken = dropped;
+    return taken;
+}
+
+
+void husb238_trace_transfer(uint64_t start_us, uint32_t duration_us, uint8_t addr, uint8_t reg, uint8_t dir, size_t len, int result) {
+    if (!husb238_trace_enabled) {
+        return;
+    }
+
+    husb238_trace_entry_t entry = {
+        .time_us = (uint32_t)start_us,
+        .duration_us = duration_us,
+        .addr = addr,
+        .reg = reg,
+        .dir = dir,
+        .len = (uint8_t)len,
+        .result = (int16_t)result,
+    };
+    if (!husb238_trace_ring.push(entry)) {
+        husb238_trace_dropped.store(husb238_trace_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+
+static uint husb238_histogram_bucket(uint32_t us) {
+    uint bucket = 0;
+    while (us > 1 && bucket < HUSB238_HISTOGRAM_BUCKETS - 1) {
+        us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+
+void husb238_histogram_add(husb238_histogram_t * h, uint32_t duration_us) {
+    if (h->count == 0 || duration_us < h->min_us) {
+        h->min_us = duration_us;
+    }
+    if (duration_us > h->max_us) {
+        h->max_us = duration_us;
+    }
+    h->count++;
+    h->total_us += duration_us;
+    h->buckets[husb238_histogram_bucket(duration_us)]++;
+}
+
+
+void husb238_trace_op(husb238_op_t op, uint32_t duration_us) {
+    if (!husb238_trace_enabled || op >= HUSB238_OP_COUNT) {
+        return;
+    }
+    husb238_histogram_add(&husb238_histograms[op], duration_us);
+}
+
+
+char const * husb238_op_name(husb238_op_t op) {
+    switch (op) {
+        case HUSB238_OP_READ_REGISTER:  return "read_register";
+        case HUSB238_OP_WRITE_REGISTER: return "write_register";
+        case HUSB238_OP_GET_PDOS:       return "get_pdos";
+        case HUSB238_OP_SELECT_PDO:     return "select_pdo";
+        case HUSB238_OP_RESET:          return "reset";
+        case HUSB238_OP_COUNT:          break;
+    }
+    return "unknown";
+}
+
+
+void husb238_get_histogram(husb238_op_t op, husb238_histogram_t * histogram) {
+    if (op >= HUSB238_OP_COUNT) {
+        *histogram = {};
+        return;
+    }
+    *histogram = husb238_histograms[op];
+}
+
+
+void husb238_clear_histograms(void) {
+    for (int i = 0; i < HUSB238_OP_COUNT; ++i) {
+        husb238_histograms[i] = {};
+    }
+}
+
+
+uint32_t husb238_histogram_percentile_us(husb238_histogram_t const * histogram, uint permille) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    // The rank of the wanted operation, counting from 1.
+    uint64_t rank = ((uint64_t)histogram->count * permille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint i = 0; i < HUSB238_HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            if (i == HUSB238_HISTOGRAM_BUCKETS - 1) {
+                return histogram->max_us;
+            }
+            uint32_t upper = (2u << i) - 1;
+            return upper < histogram->max_us ? upper : histogram->max_us;
+        }
+    }
+    return histogram->max_us;
+}
+
+
+void husb238_print_histograms(void) {
+    printf("%-15s %8s %8s %8s %8s %8s\n", "op", "count", "min_us", "p50_us", "p99_us", "max_us");
+    for (int i = 0; i < HUSB238_OP_COUNT; ++i) {
+        husb238_histogram_t const * h = &husb238_histograms[i];
+        if (h->count == 0) {
+            continue;
+        }
+        printf(
+            "%-15s %8lu %8lu %8lu %8lu %8lu\n",
+            husb238_op_name((husb238_op_t)i),
+            (unsigned long)h->count,
+            (unsigned long)h->min_us,
+            (unsigned long)husb238_histogram_percentile_us(h, 500),
+            (unsigned long)husb238_histogram_percentile_us(h, 990),
+            (unsigned long)h->max_us
+        );
+    }
+}
@@ -1,13 +1,7 @@
 #ifndef __HUSB238_H__
 #define __HUSB238_H__
 
-#define HUSB238_SRC_PDO_NONE (0x00)
-#define HUSB238_SRC_PDO_5V   (0x10)
-#define HUSB238_SRC_PDO_9V   (0x20)
-#define HUSB238_SRC_PDO_12V  (0x30)
-#define HUSB238_SRC_PDO_15V  (0x80)
-#define HUSB238_SRC_PDO_18V  (0x90)
-#define HUSB238_SRC_PDO_20V  (0xa0)
+#include "husb238_regs.h"
 
 
 typedef struct {
@@ -19,10 +13,54 @@ typedef struct {
 } husb238_pdo_t;
 
 
+//
+// Integer (fixed-point) version of husb238_pdo_t, for code that
+// shouldn't pay for soft-float on the RP2040.
+//
+typedef struct {
+    uint8_t id;        // One of the HUSB238_SRC_PDO_* values.
+    uint8_t reg;       // The corresponding HUSB238_I2C_REG_SRC_PDO_* register address.
+    uint16_t mv;       // Nominal voltage of this PDO, in millivolts.
+    uint16_t max_ma;   // Max current available at this voltage as
+                       // reported by USB PD Source, in milliamps.  0
+                       // means the voltage is not available.
+} husb238_pdo_fixed_t;
+
+static inline uint32_t husb238_mw(uint16_t mv, uint16_t ma) {
+    return ((uint32_t)mv * ma) / 1000;
+}
+
+static inline uint32_t husb238_pdo_mw(husb238_pdo_fixed_t const * pdo) {
+    return husb238_mw(pdo->mv, pdo->max_ma);
+}
+
+
+//
+// An image of the whole HUSB238 register file, PD_STATUS0 (0x00)
+// through GO_COMMAND (0x09), in register address order.  Read it with
+// husb238_read_snapshot() and decode it with the husb238_snapshot_*()
+// functions, as many times as needed, without touching the bus again.
+//
+typedef struct __attribute__((packed)) {
+    uint8_t pd_status0;
+    uint8_t pd_status1;
+    uint8_t src_pdos[6];  // SRC_PDO_5V through SRC_PDO_20V.
+    uint8_t src_pdo;
+    uint8_t go_command;
+} husb238_registers_t;
+
+
 int husb238_get_contract(i2c_inst_t * i2c, int & volts, float & max_current);
 
 int husb238_get_pdos(i2c_inst_t * i2c, husb238_pdo_t pdos[6]);
 
+//
+// Integer versions of husb238_get_contract() and husb238_get_pdos().
+// The contract is 0 mV, 0 mA if there is no USB-PD contract.
+//
+int husb238_get_contract_mv_ma(i2c_inst_t * i2c, uint16_t * mv, uint16_t * ma);
+int husb238_get_pdos_fixed(i2c_inst_t * i2c, husb238_pdo_fixed_t pdos[6]);
+
 //
 // Reads the currently active PDO ID from the HUSB238 and sets *pdo to
 // the corresponding HUSB238_SRC_PDO_* constant.
@@ -42,11 +80,323 @@ bool husb238_connected(i2c_inst_t * i2c);
 
 int husb238_read_register(i2c_inst_t * i2c, uint8_t reg, uint8_t * val);
 
+//
+// Read `count` consecutive registers starting at `reg` into `vals`,
+// using one register address write and one multi-byte read.
+//
+// Returns PICO_OK if all went well, or one of the PICO_ERROR_* constants
+// from "pico/error.h" if there was a problem.
+//
+int husb238_read_registers(i2c_inst_t * i2c, uint8_t reg, uint8_t * vals, size_t count);
+
+//
+// Read all ten HUSB238 registers into `regs` in a single burst.
+//
+// Returns PICO_OK if all went well, or one of the PICO_ERROR_* constants
+// from "pico/error.h" if there was a problem.
+//
+int husb238_read_snapshot(i2c_inst_t * i2c, husb238_registers_t * regs);
+
+//
+// Batches of register reads and writes, run in as few transfers as
+// possible.  Writes to consecutive registers in ascending order (SRC_PDO
+// then GO_COMMAND, say) go out as one multi-byte write.  Reads with no
+// write between them, in any order, are served by one read of the
+// registers they span (or from the cache).  Reads and writes still
+// happen in the order they were added.
+//
+//     husb238_batch_t batch;
+//     husb238_batch_init(&batch);
+//     husb238_batch_write(&batch, HUSB238_I2C_REG_SRC_PDO, pdo);
+//     husb238_batch_write(&batch, HUSB238_I2C_REG_GO_COMMAND, HUSB238_CMD_SELECT_PDO);
+//     int status1 = husb238_batch_read(&batch, HUSB238_I2C_REG_PD_STATUS1);
+//     int status0 = husb238_batch_read(&batch, HUSB238_I2C_REG_PD_STATUS0);
+//     husb238_batch_run(i2c, &batch);
+//
+// is three transfers instead of six: one write, and one register
+// address write and read (a single transaction with repeated starts).
+//
+// husb238_batch_write() and husb238_batch_read() return the index of the
+// op in batch->ops, PICO_ERROR_INVALID_ARG for a register past
+// GO_COMMAND, or PICO_ERROR_INSUFFICIENT_RESOURCES if the batch is full.
+//
+// husb238_batch_run() returns PICO_OK if every op succeeded, or the
+// PICO_ERROR_* constant of the first transfer that failed, after which
+// nothing more is sent.  Each op's `result` says how its transfer went
+// (PICO_ERROR_NO_DATA if it wasn't sent), and each read op's `val` holds
+// the register value.
+//
+#define HUSB238_BATCH_MAX_OPS (8)
+
+typedef struct {
+    bool write;
+    uint8_t reg;
+    uint8_t val;  // The value to write, or the value read.
+    int result;
+} husb238_batch_op_t;
+
+typedef struct {
+    size_t count;
+    husb238_batch_op_t ops[HUSB238_BATCH_MAX_OPS];
+} husb238_batch_t;
+
+void husb238_batch_init(husb238_batch_t * batch);
+int husb238_batch_write(husb238_batch_t * batch, uint8_t reg, uint8_t val);
+int husb238_batch_read(husb238_batch_t * batch, uint8_t reg);
+int husb238_batch_run(i2c_inst_t * i2c, husb238_batch_t * batch);
+
+//
+// Decode a register snapshot.  These do no I/O, and match what
+// husb238_get_contract(), husb238_get_pdos() and
+// husb238_get_current_pdo() would have returned at the time the
+// snapshot was read.
+//
+void husb238_snapshot_get_contract(husb238_registers_t const * regs, int & volts, float & max_current);
+void husb238_snapshot_get_pdos(husb238_registers_t const * regs, husb238_pdo_t pdos[6]);
+int husb238_snapshot_get_current_pdo(husb238_registers_t const * regs);
+void husb238_snapshot_get_contract_mv_ma(husb238_registers_t const * regs, uint16_t * mv, uint16_t * ma);
+void husb238_snapshot_get_pdos_fixed(husb238_registers_t const * regs, husb238_pdo_fixed_t pdos[6]);
+
+//
+// Print a decoded register snapshot, in the same format as
+// husb238_dump_registers().
+//
+void husb238_print_snapshot(husb238_registers_t const * regs);
+
+//
+// Send a USB-PD hard reset, see the HUSB238 go down (off the bus,
+// detached, or without a PD contract), and wait for it to come back:
+// answering on the bus and attached.
+//
+// Returns PICO_OK if all went well, PICO_ERROR_IO if the HUSB238 wasn't
+// seen to go down within HUSB238_RESET_DOWN_WINDOW_US (so the reset
+// can't be told to have happened), PICO_ERROR_TIMEOUT if it didn't come
+// back within HUSB238_RESET_DEADLINE_MS, or another PICO_ERROR_*
+// constant if the reset command could not be sent.
+//
+// A source with no PD contract (a plain Type-C one) has nothing to
+// reset; the HUSB238 counts as down straight away, and as back as soon
+// as it's seen attached.
+//
 int husb238_reset(i2c_inst_t * i2c);
+
+#define HUSB238_RESET_DEADLINE_MS (3000)
+
+// A source takes 25-35 ms to act on a hard reset, and then VBUS has to
+// fall.
+#define HUSB238_RESET_DOWN_WINDOW_US (100 * 1000)
+
+typedef struct {
+    uint32_t deadline_ms;     // Give up waiting after this long.
+    uint32_t backoff_min_us;  // First poll interval.
+    uint32_t backoff_max_us;  // Poll interval doubles up to this.
+    uint32_t down_window_us;  // 0 means HUSB238_RESET_DOWN_WINDOW_US.
+    bool wait_for_contract;   // Also wait for a PD contract to come back.
+} husb238_reset_config_t;
+
+//
+// Like husb238_reset(), but with a configurable deadline and polling
+// backoff (NULL `config` means the defaults).  If `elapsed_us` is not
+// NULL it's set to how long the reset took.
+//
+int husb238_reset_wait(i2c_inst_t * i2c, husb238_reset_config_t const * config, uint32_t * elapsed_us);
+
+typedef struct {
+    husb238_reset_config_t config;
+    bool busy;            // True until the reset finishes or times out.
+    bool down;            // The HUSB238 was seen going down.
+    uint64_t start_us;    // When HARD_RESET was sent.
+    uint64_t next_us;     // When husb238_reset_poll() should next be called.
+    uint32_t backoff_us;
+    uint32_t elapsed_us;  // How long the reset took, once it's done.
+} husb238_reset_t;
+
+//
+// Send a hard reset without waiting for the HUSB238 to come back.  Call
+// husb238_reset_poll() on `op`, no earlier than op->next_us, until it
+// returns something other than HUSB238_IN_PROGRESS; the return value is
+// then what husb238_reset_wait() would have returned.
+//
+// husb238_reset_begin() returns PICO_OK if the command was sent, or a
+// PICO_ERROR_* constant if there was an I2C problem.
+//
+int husb238_reset_begin(i2c_inst_t * i2c, husb238_reset_t * op, husb238_reset_config_t const * config);
+int husb238_reset_poll(i2c_inst_t * i2c, husb238_reset_t * op);
+
+#define HUSB238_RESET_HISTOGRAM_BUCKET_MS (100)
+#define HUSB238_RESET_HISTOGRAM_BUCKETS (20)
+
+//
+// Durations of all resets since boot (or the last
+// husb238_clear_reset_stats()).  histogram[i] counts resets that took
+// [i, i+1) * HUSB238_RESET_HISTOGRAM_BUCKET_MS, the last bucket counts
+// everything longer.
+//
+typedef struct {
+    uint32_t resets;    // Resets that completed.
+    uint32_t timeouts;  // Resets that missed their deadline.
+    uint32_t not_down;  // Resets the HUSB238 wasn't seen going down for.
+    uint32_t last_us;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t histogram[HUSB238_RESET_HISTOGRAM_BUCKETS];
+} husb238_reset_stats_t;
+
+void husb238_get_reset_stats(husb238_reset_stats_t * stats);
+void husb238_clear_reset_stats(void);
+
 int husb238_get_src_cap(i2c_inst_t * i2c);
 
 //
-// Read and print all registers on the HUSB238.
+// Per-device bus configuration.
+//
+// `baudrate` should be what i2c_init() returned; I2C timeouts are
+// derived from it.  `gap_us` is how long the driver leaves the bus idle
+// after each transfer, and may be 0.
+//
+// A failed transaction is tried again up to `retries` more times.  If
+// `bus_recovery` is set, a transaction that timed out (the symptom of a
+// target holding SDA low) first gets the bus recovered: SCL is clocked
+// on `scl_gpio` until `sda_gpio` is released, a STOP is sent, and the
+// I2C peripheral is re-initialized.
+//
+// With `repeated_start` set, register reads send the register address
+// and read the data in one I2C transaction, with a repeated START and no
+// gap in between, instead of two transactions.  The HUSB238 supports
+// it, but not every transport does (the DMA one doesn't).
+//
+#define HUSB238_DEFAULT_BAUDRATE (100 * 1000)
+#define HUSB238_DEFAULT_GAP_US (100)
+
+typedef struct {
+    uint baudrate;
+    uint gap_us;
+    uint retries;
+    bool bus_recovery;
+    uint8_t sda_gpio;
+    uint8_t scl_gpio;
+    bool repeated_start;
+} husb238_config_t;
+
+typedef struct {
+    uint32_t retries;             // Transactions tried again.
+    uint32_t recoveries;          // Hung-bus recoveries attempted.
+    uint32_t recovery_failures;   // Recoveries that didn't free SDA.
+    uint64_t recovery_us_total;   // Time spent recovering.
+    uint32_t recovery_us_max;
+} husb238_bus_stats_t;
+
+void husb238_get_bus_stats(i2c_inst_t * i2c, husb238_bus_stats_t * stats);
+
+//
+// When the gap after the last transfer on `i2c` ends, in microseconds
+// since boot.  The driver waits until then before its next transfer;
+// code that has other things to do can come back no earlier instead.
+//
+uint64_t husb238_bus_idle_us(i2c_inst_t * i2c);
+
+//
+// Returns PICO_OK, PICO_ERROR_INVALID_ARG if the baudrate is 0, or
+// PICO_ERROR_INSUFFICIENT_RESOURCES if too many devices are in use.
+//
+int husb238_configure(i2c_inst_t * i2c, husb238_config_t const * config);
+void husb238_get_config(i2c_inst_t * i2c, husb238_config_t * config);
+
+//
+// Find the smallest inter-transfer gap at which `transfers` back-to-back
+// full register reads all succeed and return consistent data, and
+// configure the device to use it.  The chip must be attached to a
+// source and otherwise idle.
+//
+// Returns PICO_OK and sets *gap_us (if not NULL) on success, or
+// PICO_ERROR_IO (leaving the gap unchanged) if no gap passed.
+//
+int husb238_calibrate_gap(i2c_inst_t * i2c, uint transfers, uint * gap_us);
+
+//
+// Multiple HUSB238s behind a TCA9548A-style I2C mux.
+//
+// All HUSB238s answer at the same address, so several on one bus need
+// a mux.  A husb238_port_t names one HUSB238: a bus, and optionally the
+// mux and channel it's behind.  After husb238_port_select(port), all
+// other husb238_*(port->i2c, ...) calls talk to that port, each port
+// with its own configuration and cache.  The mux is only written when
+// the selection actually changes.
+//
+// husb238_port_select() returns PICO_OK, PICO_ERROR_INVALID_ARG for a
+// bad channel, or a PICO_ERROR_* constant if the mux write failed.
+//
+#define HUSB238_NO_MUX (0x00)
+#define HUSB238_MUX_CHANNELS (8)
+
+typedef struct {
+    i2c_inst_t * i2c;
+    uint8_t mux_addr;     // 7-bit mux address, or HUSB238_NO_MUX.
+    uint8_t mux_channel;  // 0 to HUSB238_MUX_CHANNELS-1, ignored without a mux.
+} husb238_port_t;
+
+int husb238_port_select(husb238_port_t const * port);
+
+#define HUSB238_SCAN_MAX_PORTS (32)
+
+typedef struct {
+    int result;                   // PICO_OK, or the error reading this port.
+    bool attached;                // ATTACH bit of PD_STATUS1.
+    uint16_t mv;                  // Contract voltage, 0 if no PD contract.
+    uint16_t ma;                  // Contract max current.
+    int current_pdo;              // HUSB238_SRC_PDO_* in SRC_PDO.
+    husb238_pdo_fixed_t pdos[6];  // Source capabilities.
+    husb238_registers_t regs;     // The raw registers all of this came from.
+} husb238_port_status_t;
+
+typedef struct {
+    uint32_t ports;         // Ports scanned.
+    uint32_t mux_switches;  // Times the routing had to change.
+    uint64_t sweep_us;      // Time for the whole sweep.
+    uint64_t mux_us;        // Part of sweep_us spent switching the mux.
+} husb238_scan_stats_t;
+
+//
+// Read the status of `n` ports (up to HUSB238_SCAN_MAX_PORTS) into
+// status[], one full register read per port.  Ports are visited in
+// bus/mux/channel order so each channel is selected at most once per
+// sweep, however `ports` is ordered.  `stats` may be NULL.
+//
+// Returns PICO_OK if every port was read, otherwise the last error; the
+// per-port results are in status[i].result.
+//
+int husb238_scan(husb238_port_t const ports[], size_t n, husb238_port_status_t status[], husb238_scan_stats_t * stats);
+
+//
+// Optional shadow cache of the HUSB238 registers that only change when
+// a source attaches, after GET_SRC_CAP or HARD_RESET, or when we write
+// them: SRC_PDO_5V through SRC_PDO_20V, and SRC_PDO.  With the cache
+// enabled, husb238_get_pdos() and husb238_get_current_pdo() cost no bus
+// transactions once the cache is filled.
+//
+// The cache is dropped by husb238_get_src_cap(), husb238_reset(),
+// husb238_select_pdo(), any failed transfer, and whenever the ATTACH
+// bit of PD_STATUS1 is seen to change (by any driver call that reads
+// PD_STATUS1).  A miss reads the whole register file in one transfer,
+// and the cache is only filled while PD_STATUS0/1 show an attached
+// source with a PD contract.
+//
+// husb238_cache_enable() returns PICO_OK, or
+// PICO_ERROR_INSUFFICIENT_RESOURCES if too many devices are in use.
+//
+typedef struct {
+    uint32_t hits;           // Reads served from the cache.
+    uint32_t misses;         // Cacheable reads that went to the bus.
+    uint32_t invalidations;  // Times a filled cache was dropped.
+} husb238_cache_stats_t;
+
+int husb238_cache_enable(i2c_inst_t * i2c, bool enable);
+void husb238_cache_invalidate(i2c_inst_t * i2c);
+void husb238_get_cache_stats(i2c_inst_t * i2c, husb238_cache_stats_t * stats);
+
+//
+// Read all registers on the HUSB238 in one burst, and print them.
 //
 // Returns PICO_OK if all went well, or one of the PICO_ERROR_* constants
 // from "pico/error.h" if there was a problem.
@@ -58,7 +408,56 @@ int husb238_read_pd_status1(i2c_inst_t * i2c, uint8_t * val);
 
 float husb238_pdo_max_current(uint8_t pdo);
 
+//
+// Max current of a SRC_PDO_* register value in milliamps, or 0 if the
+// PDO is not detected.
+//
+uint16_t husb238_pdo_max_current_ma(uint8_t pdo);
+
+//
+// Select the PDO with the specified PDO ID (one of the
+// HUSB238_SRC_PDO_* constants), and wait until the HUSB238 reports the
+// outcome of the negotiation in PD_RESPONSE.
+//
+// Returns PICO_OK if the source accepted the new PDO,
+// PICO_ERROR_INVALID_ARG if the HUSB238 rejected the request,
+// PICO_ERROR_IO if the USB-PD transaction failed, PICO_ERROR_TIMEOUT if
+// no response arrived in time, or another PICO_ERROR_* constant if
+// there was an I2C problem.
+//
 int husb238_select_pdo(i2c_inst_t * i2c, int pdo);
 
 
+// Returned by husb238_poll() while an operation is still in progress.
+#define HUSB238_IN_PROGRESS (1)
+
+// Default time to wait for a PDO negotiation to finish.
+#define HUSB238_SELECT_PDO_TIMEOUT_US (600 * 1000)
+
+// How often husb238_select_pdo() reads PD_STATUS1 while it waits.
+#define HUSB238_SELECT_PDO_POLL_US (1000)
+
+typedef struct {
+    int pdo;              // The requested HUSB238_SRC_PDO_* value.
+    uint32_t timeout_us;  // 0 means HUSB238_SELECT_PDO_TIMEOUT_US.
+    bool busy;            // True while the negotiation is in flight.
+    int pd_response;      // Last PD_RESPONSE seen, HUSB238_PD_RESPONSE_*.
+    uint64_t start_us;    // When SELECT_PDO was issued.
+    uint64_t latency_us;  // Time from SELECT_PDO to the last poll.
+} husb238_select_t;
+
+//
+// Start selecting a PDO without waiting for the negotiation to finish.
+// Call husb238_poll() on `op` until it returns something other than
+// HUSB238_IN_PROGRESS; the return value is then the same as
+// husb238_select_pdo() would have returned, and op->latency_us is the
+// measured negotiation time.
+//
+// Returns PICO_OK if the command was issued, or a PICO_ERROR_*
+// constant if there was an I2C problem.
+//
+int husb238_select_pdo_begin(i2c_inst_t * i2c, husb238_select_t * op, int pdo);
+int husb238_poll(i2c_inst_t * i2c, husb238_select_t * op);
+
+
 #endif // __HUSB238_H__
@@ -0,0 +1,114 @@
+#ifndef __HUSB238_ARBITER_H__
+#define __HUSB238_ARBITER_H__
+
+#include <stdint.h>
+
+#include <hardware/i2c.h>
+#include <pico/critical_section.h>
+
+
+//
+// An I2C bus shared between the HUSB238 driver and other devices, on
+// either core.
+//
+// Whoever uses the bus holds the arbiter for one transaction at a time:
+// acquire, transfer, release.  Holding is exclusive across both cores.
+// When the bus comes free, the most urgent priority class waiting gets
+// it, so a time-critical sensor waits for at most the transaction in
+// progress, never for a queue of background ones.
+//
+// That transaction can still delay a sensor sampled on a fixed period,
+// so the sensor can also reserve a window for each sample.  A
+// transaction of a less urgent class isn't started if its declared
+// duration would run into the window; it waits until the window has
+// passed.  Urgent classes are never held back by a reservation.
+//
+// With an arbiter set for a bus (husb238_set_bus_arbiter()), the driver
+// holds it for each register read (address write and data read
+// together), register write, mux write and bus recovery, at the class
+// given.  Its declared durations are the time on the wire, plus the
+// gap between the two halves of a read without repeated starts, so
+// repeated starts make for much shorter holds.  The gap after a
+// transaction is taken with the bus released.
+//
+typedef enum {
+    HUSB238_BUS_PRIORITY_CRITICAL,    // Sensors sampled on a fixed period.
+    HUSB238_BUS_PRIORITY_NORMAL,
+    HUSB238_BUS_PRIORITY_BACKGROUND,  // PD status polling, by default.
+    HUSB238_BUS_PRIORITIES,
+} husb238_bus_priority_t;
+
+// How often a waiter looks at the bus again.
+#define HUSB238_ARBITER_POLL_US (5)
+
+typedef struct {
+    uint32_t acquisitions;
+    uint32_t waits;          // Acquisitions that found the bus taken.
+    uint32_t deferrals;      // Acquisitions held back by a reservation.
+    uint32_t overruns;       // Holds longer than their declared duration.
+    uint64_t wait_us_total;
+    uint32_t wait_us_max;
+    uint64_t hold_us_total;
+    uint32_t hold_us_max;
+} husb238_arbiter_class_stats_t;
+
+typedef struct {
+    husb238_arbiter_class_stats_t classes[HUSB238_BUS_PRIORITIES];
+    uint64_t since_us;  // When the stats were last cleared.
+    uint64_t busy_us;   // Time held since then, by every class.
+} husb238_arbiter_stats_t;
+
+typedef struct {
+    critical_section_t lock;  // Guards everything below.
+
+    bool busy;
+    uint8_t owner;            // husb238_bus_priority_t of the holder.
+    uint64_t acquired_us;
+    uint32_t declared_us;
+    uint16_t waiting[HUSB238_BUS_PRIORITIES];
+
+    // The next reserved window, len_us 0 for none.
+    uint8_t reserved_priority;
+    uint64_t reserved_us;
+    uint32_t reserved_len_us;
+    uint32_t reserved_period_us;
+
+    husb238_arbiter_stats_t stats;
+} husb238_arbiter_t;
+
+void husb238_arbiter_init(husb238_arbiter_t * arb);
+void husb238_arbiter_deinit(husb238_arbiter_t * arb);
+
+//
+// Wait for the bus, and hold it for a transaction expected to take
+// `duration_us` (0 if unknown, which a reservation only holds back
+// while its window is open).
+//
+void husb238_arbiter_acquire(husb238_arbiter_t * arb, husb238_bus_priority_t priority, uint32_t duration_us);
+
+// Hold the bus if that's possible right now.  Returns true if it's held.
+bool husb238_arbiter_try_acquire(husb238_arbiter_t * arb, husb238_bus_priority_t priority, uint32_t duration_us);
+
+void husb238_arbiter_release(husb238_arbiter_t * arb);
+
+//
+// Keep classes less urgent than `priority` off the bus from `start_us`
+// for `len_us`, and then every `period_us` after that if it's not 0.
+// Replaces any earlier reservation; `len_us` of 0 cancels it.
+//
+void husb238_arbiter_reserve(husb238_arbiter_t * arb, husb238_bus_priority_t priority, uint64_t start_us, uint32_t len_us, uint32_t period_us);
+
+void husb238_arbiter_get_stats(husb238_arbiter_t * arb, husb238_arbiter_stats_t * stats);
+void husb238_arbiter_clear_stats(husb238_arbiter_t * arb);
+
+//
+// Share `i2c` through `arb`, with the driver's transactions at
+// `priority`.  NULL `arb` stops using an arbiter.
+//
+// Returns PICO_OK, or PICO_ERROR_INSUFFICIENT_RESOURCES if too many
+// buses are in use.
+//
+int husb238_set_bus_arbiter(i2c_inst_t * i2c, husb238_arbiter_t * arb, husb238_bus_priority_t priority);
+
+
+#endif // __HUSB238_ARBITER_H__
@@ -0,0 +1,90 @@
+#ifndef __HUSB238_ASYNC_H__
+#define __HUSB238_ASYNC_H__
+
+#include <stdint.h>
+
+#include <hardware/i2c.h>
+#include <pico/async_context.h>
+
+#include "husb238.h"
+
+
+//
+// HUSB238 operations run by an async_context, so that one core can
+// drive the HUSB238 alongside USB and everything else without sleeping.
+//
+// Each operation is a chain of at-time workers.  A worker does one
+// step (a register read, the SELECT_PDO command, one status poll) and
+// schedules the next step for when it's due: after the bus's gap_us,
+// after the poll period while a PDO negotiation is in flight, or at the
+// next backoff while a hard reset is in progress.  Nothing in between
+// sleeps, so the rest of the time belongs to the async_context's other
+// workers and the caller.  When the operation finishes, `done` is called
+// from the async_context with the same result the blocking call would
+// have returned.
+//
+// Each step still does its I2C transfers synchronously, which at 100
+// kHz takes a few hundred microseconds.  A register read is two
+// transfers with a gap in between unless the bus is configured with
+// repeated_start.
+//
+// Operations on the same bus are serialized by the async_context, as
+// its workers never run concurrently.  The husb238_async_*() calls
+// take the async_context's lock, so with a threadsafe_background or
+// FreeRTOS context they may be made from outside it.
+//
+
+#define HUSB238_ASYNC_POLL_US (1000)
+
+typedef struct husb238_async husb238_async_t;
+
+typedef void (*husb238_async_done_t)(husb238_async_t * op, int result);
+
+typedef enum {
+    HUSB238_ASYNC_READ_SNAPSHOT,
+    HUSB238_ASYNC_SELECT_PDO,
+    HUSB238_ASYNC_RESET,
+} husb238_async_kind_t;
+
+struct husb238_async {
+    // May be set before starting an operation.
+    void * user_data;
+    uint32_t poll_us;           // PD_STATUS1 poll period, 0 means HUSB238_ASYNC_POLL_US.
+
+    // HUSB238_IN_PROGRESS while the operation runs, then its result.
+    int result;
+
+    // What the operation produced, when it's done: the snapshot, the
+    // negotiation's PD_RESPONSE and latency, the reset's duration.
+    husb238_registers_t * regs;
+    husb238_select_t select;
+    husb238_reset_t reset;
+
+    // Private.
+    async_context_t * context;
+    i2c_inst_t * i2c;
+    husb238_async_done_t done;
+    async_at_time_worker_t worker;
+    husb238_async_kind_t kind;
+    bool started;
+    husb238_reset_config_t reset_config;
+    bool default_reset_config;
+};
+
+//
+// Start an operation.  `op` must stay valid until `done` (which may be
+// NULL) has been called, or op->result is no longer
+// HUSB238_IN_PROGRESS.
+//
+// Returns PICO_OK if the operation was started, or
+// PICO_ERROR_NOT_PERMITTED if `op` is already running one.
+//
+int husb238_async_read_snapshot(async_context_t * context, husb238_async_t * op, i2c_inst_t * i2c, husb238_registers_t * regs, husb238_async_done_t done);
+int husb238_async_select_pdo(async_context_t * context, husb238_async_t * op, i2c_inst_t * i2c, int pdo, husb238_async_done_t done);
+int husb238_async_reset(async_context_t * context, husb238_async_t * op, i2c_inst_t * i2c, husb238_reset_config_t const * config, husb238_async_done_t done);
+
+// Stop a running operation; it completes with PICO_ERROR_TIMEOUT.
+void husb238_async_cancel(husb238_async_t * op);
+
+
+#endif // __HUSB238_ASYNC_H__
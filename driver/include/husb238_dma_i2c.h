@@ -0,0 +1,138 @@
+#ifndef __HUSB238_DMA_I2C_H__
+#define __HUSB238_DMA_I2C_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <hardware/i2c.h>
+
+#include "husb238.h"
+#include "husb238_hal.h"
+
+
+//
+// I2C transfers on the I2C peripheral, fed by DMA and finished from its
+// interrupt, so the CPU doesn't spin for the duration of a transfer.
+//
+// Transfers are submitted as a chain of husb238_dma_i2c_xfer_t and run
+// one after the other without the CPU.  Each ends with a STOP, and the
+// STOP interrupt starts the next one after the bus's configured gap_us
+// (timed by an alarm).  The caller checks for completion with
+// husb238_dma_i2c_result(), or sleeps until then with
+// husb238_dma_i2c_wait().
+//
+// husb238_dma_i2c_init() also makes this the bus's HAL, so the rest of
+// the driver's transfers on that bus go through it too, and sleep in
+// WFE instead of polling the peripheral.
+//
+
+
+typedef void (*husb238_dma_i2c_done_t)(void * ctx, int result);
+
+typedef struct husb238_dma_i2c_xfer {
+    uint8_t addr;
+    bool read;             // Read `len` bytes into `dst`, or write `src`.
+    uint8_t const * src;
+    uint8_t * dst;
+    size_t len;            // 1 to HUSB238_DMA_I2C_MAX_LEN.
+
+    // Called from the interrupt handler when this transfer finishes (or
+    // is skipped because an earlier one in the chain failed).  May be
+    // NULL.
+    husb238_dma_i2c_done_t done;
+    void * ctx;
+
+    struct husb238_dma_i2c_xfer * next;
+
+    // Set by the transport: HUSB238_IN_PROGRESS, then PICO_OK or a
+    // PICO_ERROR_* constant.
+    volatile int result;
+} husb238_dma_i2c_xfer_t;
+
+// Longest transfer, in bytes.
+#ifndef HUSB238_DMA_I2C_MAX_LEN
+#define HUSB238_DMA_I2C_MAX_LEN (16)
+#endif
+
+typedef struct {
+    i2c_inst_t * i2c;
+    int tx_dma;
+    int rx_dma;
+    uint gap_us;
+
+    husb238_dma_i2c_xfer_t * volatile current;
+    volatile int result;              // Of the whole chain.
+    volatile int32_t alarm;           // Pending gap alarm, or 0.
+    uint32_t cmds[HUSB238_DMA_I2C_MAX_LEN];  // IC_DATA_CMD words.
+} husb238_dma_i2c_t;
+
+
+//
+// Set up DMA and interrupt driven transfers on `i2c`, which must already
+// be initialized with i2c_init().  Claims two DMA channels and the
+// I2Cx_IRQ handler, and makes husb238_dma_i2c_hal the HAL for `i2c`.
+//
+// Returns PICO_OK, or PICO_ERROR_INSUFFICIENT_RESOURCES.
+//
+int husb238_dma_i2c_init(husb238_dma_i2c_t * bus, i2c_inst_t * i2c);
+
+void husb238_dma_i2c_deinit(husb238_dma_i2c_t * bus);
+
+//
+// Start the chain of transfers at `xfer`.  `xfer` and everything it
+// points to must stay valid until the chain completes.
+//
+// Returns PICO_OK, PICO_ERROR_NOT_PERMITTED if a chain is already
+// running on `bus`, or PICO_ERROR_INVALID_ARG.
+//
+int husb238_dma_i2c_submit(husb238_dma_i2c_t * bus, husb238_dma_i2c_xfer_t * xfer);
+
+// HUSB238_IN_PROGRESS while the last submitted chain is running, then
+// PICO_OK or the error of the transfer that failed.
+int husb238_dma_i2c_result(husb238_dma_i2c_t * bus);
+
+//
+// Sleep (in WFE) until the running chain completes, or cancel it after
+// `timeout_us` (0 waits forever).  Returns the same as
+// husb238_dma_i2c_result(), or PICO_ERROR_TIMEOUT.
+//
+int husb238_dma_i2c_wait(husb238_dma_i2c_t * bus, uint timeout_us);
+
+// Stop the running chain; it completes with PICO_ERROR_TIMEOUT.
+void husb238_dma_i2c_cancel(husb238_dma_i2c_t * bus);
+
+//
+// The HAL husb238_dma_i2c_init() installs: each transfer is submitted
+// and waited for, and fails with PICO_ERROR_NOT_PERMITTED while a
+// chain is running.  `nostop` isn't supported.  bus_recover is the
+// default HAL's.
+//
+extern husb238_hal_t const husb238_dma_i2c_hal;
+
+
+//
+// HUSB238 operations as transfer chains, for use without the CPU.
+// Each fills in `op` and submits it; `op` must stay valid until
+// husb238_dma_i2c_result() is no longer HUSB238_IN_PROGRESS.
+//
+typedef struct {
+    husb238_dma_i2c_xfer_t xfers[2];
+    uint8_t out[2][3];
+} husb238_dma_op_t;
+
+// Read `len` registers starting at `reg` into `dst`, like
+// husb238_read_registers().
+int husb238_dma_read_registers(husb238_dma_i2c_t * bus, husb238_dma_op_t * op, uint8_t reg, uint8_t * dst, size_t len);
+
+// Read a register snapshot, like husb238_read_snapshot().
+int husb238_dma_read_snapshot(husb238_dma_i2c_t * bus, husb238_dma_op_t * op, husb238_registers_t * regs);
+
+//
+// Write SRC_PDO and issue SELECT_PDO, like husb238_select_pdo_begin().
+// Once the chain completes successfully, `select` is ready for
+// husb238_poll().
+//
+int husb238_dma_select_pdo(husb238_dma_i2c_t * bus, husb238_dma_op_t * op, husb238_select_t * select, int pdo);
+
+
+#endif // __HUSB238_DMA_I2C_H__
@@ -0,0 +1,102 @@
+#ifndef __HUSB238_EVENTS_H__
+#define __HUSB238_EVENTS_H__
+
+#include <hardware/i2c.h>
+
+#include "husb238.h"
+
+
+//
+// Attach/detach/contract event engine.
+//
+// Each poll reads only PD_STATUS1 (one byte).  A change in PD_STATUS1
+// (ATTACH, CC_DIR, PD_RESPONSE or the 5V contract bits) that persists
+// for `debounce` consecutive polls triggers one full register read, and
+// the callbacks for whatever changed.  In steady state the bus cost is
+// one single-byte read per interval.  The exception is the time between
+// attach and the first PD contract, when the contract and the source's
+// PDOs show up without PD_STATUS1 changing; the engine reads all
+// registers on each poll until then, but for no longer than
+// HUSB238_EVENTS_CONTRACT_WAIT_US.  A source with no contract by then
+// is taken for a plain Type-C (non-PD) one, and polling goes back to
+// PD_STATUS1 alone; a contract that does come later is seen by the
+// PD_STATUS0 check below.
+//
+// A SELECT_PDO or GET_SRC_CAP can change the contract and the PDOs
+// while PD_STATUS1 reads the same before and after, PD_RESPONSE only
+// clearing while the command runs.  Any PD_RESPONSE change that's seen,
+// however short, triggers a full read once PD_STATUS1 has settled.  One
+// that falls between two polls is caught by a PD_STATUS0 read every
+// HUSB238_EVENTS_CONTRACT_CHECK_US while attached, one more byte every
+// 50 intervals at the default interval.
+//
+// Callbacks run from husb238_events_poll(), on the caller's core, and
+// any of them may be NULL.
+//
+typedef struct {
+    void (*attached)(void * ctx, husb238_registers_t const * regs);
+    void (*detached)(void * ctx);
+    void (*contract_changed)(void * ctx, uint16_t mv, uint16_t ma);
+    void (*negotiation_failed)(void * ctx, int pd_response);
+    void * ctx;
+} husb238_event_callbacks_t;
+
+#define HUSB238_EVENTS_INTERVAL_US (10 * 1000)
+#define HUSB238_EVENTS_DEBOUNCE (2)
+#define HUSB238_EVENTS_CONTRACT_WAIT_US (2000 * 1000)
+#define HUSB238_EVENTS_CONTRACT_CHECK_US (500 * 1000)
+
+typedef struct {
+    i2c_inst_t * i2c;
+    uint32_t interval_us;  // Poll period.
+    uint8_t debounce;      // Consecutive polls a change must persist for.
+    husb238_event_callbacks_t callbacks;
+
+    // Debounced state.
+    bool connected;
+    uint8_t pd_status1;
+    bool attached;
+    uint16_t mv;
+    uint16_t ma;
+    husb238_registers_t regs;
+    uint64_t contract_wait_us;  // Full reads until then, if there's no contract.
+    uint64_t contract_check_us; // Next PD_STATUS0 read.
+    bool recheck;               // PD_RESPONSE moved; read everything when settled.
+
+    // A change that hasn't persisted long enough yet.
+    bool candidate_connected;
+    uint8_t candidate_pd_status1;
+    uint8_t candidate_polls;
+    uint64_t candidate_since_us;
+
+    uint64_t next_poll_us;
+
+    // Metrics.
+    uint32_t polls;             // PD_STATUS1 reads.
+    uint32_t fetches;           // Full register reads after a change.
+    uint32_t contract_checks;   // PD_STATUS0 reads.
+    uint32_t events;            // Callbacks delivered.
+    uint32_t last_latency_us;   // From first seeing a change to its callbacks.
+    uint32_t max_latency_us;
+} husb238_events_t;
+
+//
+// Set up `ev` to watch the HUSB238 on `i2c`.  interval_us and debounce
+// of 0 mean HUSB238_EVENTS_INTERVAL_US and HUSB238_EVENTS_DEBOUNCE.
+// The engine starts out believing nothing is attached, so an attached
+// HUSB238 produces an `attached` event on the first change.
+//
+void husb238_events_init(husb238_events_t * ev, i2c_inst_t * i2c, uint32_t interval_us, uint8_t debounce, husb238_event_callbacks_t const * callbacks);
+
+//
+// Call this as often as convenient; it only touches the bus once
+// interval_us has passed since the last poll.
+//
+// Returns PICO_OK, or the PICO_ERROR_* constant from a failed full
+// register read.  A HUSB238 that doesn't answer the PD_STATUS1 read is
+// treated as detached, not as an error.
+//
+int husb238_events_poll(husb238_events_t * ev);
+
+
+#endif // __HUSB238_EVENTS_H__
@@ -0,0 +1,47 @@
+#ifndef __HUSB238_FLASH_H__
+#define __HUSB238_FLASH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+//
+// A region of NOR flash, for the driver's persistent state.
+//
+// The region is `sectors` erase sectors of `sector_size` bytes.
+// Offsets are relative to the start of the region.  erase() sets a
+// sector to 0xff; program() writes whole pages, and like NOR flash can
+// only clear bits, so programming a page again with 0xff everywhere
+// but a few new bytes adds those bytes and leaves the rest alone.
+//
+// Each function returns PICO_OK or a PICO_ERROR_* constant.
+//
+typedef struct husb238_flash {
+    uint32_t sector_size;
+    uint32_t page_size;
+    uint32_t sectors;
+    int (*read)(struct husb238_flash const * flash, uint32_t offset, void * dst, size_t len);
+    int (*program)(struct husb238_flash const * flash, uint32_t offset, void const * src, size_t len);
+    int (*erase)(struct husb238_flash const * flash, uint32_t offset);
+
+    // For the backend.
+    uint32_t base;
+    void * ctx;
+} husb238_flash_t;
+
+
+//
+// The RP2040's own flash: its last `sectors` sectors, which the
+// program mustn't be big enough to reach.  Programming and erasing
+// disable interrupts for the duration; with core1 running, it must be
+// locked out (see multicore_lockout_start_blocking()) or running from
+// RAM.  On the host build the flash is an in-memory image.
+//
+// Returns PICO_OK, or PICO_ERROR_INVALID_ARG if the flash is smaller.
+//
+#define HUSB238_FLASH_PICO_SECTORS (2)
+
+int husb238_flash_pico_init(husb238_flash_t * flash, uint32_t sectors);
+
+
+#endif // __HUSB238_FLASH_H__
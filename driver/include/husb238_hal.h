@@ -0,0 +1,68 @@
+#ifndef __HUSB238_HAL_H__
+#define __HUSB238_HAL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <hardware/i2c.h>
+
+
+//
+// Everything the HUSB238 driver needs from the platform: I2C transfers,
+// a microsecond clock, and a way to wait.
+//
+// The default HAL (husb238_hal_default) calls the Pico SDK functions of
+// the same names.  On the host build those come from the pico_host shim
+// and talk to the simulated HUSB238 instead of real hardware.
+//
+typedef struct {
+    // Same semantics as the Pico SDK i2c_write_timeout_us() and
+    // i2c_read_timeout_us(): return the number of bytes transferred,
+    // or a PICO_ERROR_* constant.  A timeout_us of 0 means block
+    // forever.
+    int (*i2c_write)(i2c_inst_t * i2c, uint8_t addr, uint8_t const * src, size_t len, bool nostop, uint timeout_us);
+    int (*i2c_read)(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, uint timeout_us);
+
+    // Microseconds since boot.
+    uint64_t (*time_us)(void);
+
+    void (*sleep_us)(uint64_t us);
+
+    // Free a hung bus: take `sda_gpio` and `scl_gpio` away from the I2C
+    // peripheral, clock SCL until the target lets go of SDA (up to nine
+    // times), issue a STOP, then hand the pins back and re-initialize
+    // the peripheral at `baudrate`.  Returns PICO_OK if SDA was released.
+    int (*bus_recover)(i2c_inst_t * i2c, uint sda_gpio, uint scl_gpio, uint baudrate);
+} husb238_hal_t;
+
+
+extern husb238_hal_t const husb238_hal_default;
+
+//
+// Replace the HAL used by all subsequent driver calls.  Passing NULL
+// restores husb238_hal_default.
+//
+void husb238_set_hal(husb238_hal_t const * hal);
+
+husb238_hal_t const * husb238_get_hal(void);
+
+//
+// Use `hal` for transfers on `i2c` only, for buses that aren't driven
+// by the I2C peripheral (see husb238_pio_i2c.h).  `i2c` then only needs
+// to be a unique key for the bus.  Passing NULL removes the override.
+// The clock and sleep always come from the global HAL.
+//
+// Returns PICO_OK, or PICO_ERROR_INSUFFICIENT_RESOURCES if more than
+// HUSB238_MAX_BUS_HALS buses have their own HAL.
+//
+#ifndef HUSB238_MAX_BUS_HALS
+#define HUSB238_MAX_BUS_HALS (8)
+#endif
+
+int husb238_set_bus_hal(i2c_inst_t * i2c, husb238_hal_t const * hal);
+
+// The HAL for transfers on `i2c`: its override, or the global HAL.
+husb238_hal_t const * husb238_get_bus_hal(i2c_inst_t * i2c);
+
+
+#endif // __HUSB238_HAL_H__
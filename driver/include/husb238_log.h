@@ -0,0 +1,142 @@
+#ifndef __HUSB238_LOG_H__
+#define __HUSB238_LOG_H__
+
+#include <pico/types.h>
+
+
+//
+// Deferred binary logging for the driver.
+//
+// A log site records an event ID and up to four 32-bit arguments in a
+// lock-free RAM buffer; it never formats or prints, so logging in an
+// I2C error path costs a few dozen cycles instead of a (possibly
+// blocking) stdio write.  The records are turned into text later,
+// either on the device by husb238_log_flush() from a low-priority
+// context, or on a host by tools/husb238_log_decode.py from the output
+// of husb238_log_dump().
+//
+// Only one context may log at a time (the same rule as for the rest of
+// the driver), and only one may flush, dump or drain.
+//
+
+
+#define HUSB238_LOG_LEVEL_NONE  (0)  // Don't say anything.
+#define HUSB238_LOG_LEVEL_ERROR (1)  // Only say errors.
+#define HUSB238_LOG_LEVEL_DEBUG (2)  // Verbose debug output.
+
+// Log sites above this level are compiled out.
+#ifndef HUSB238_LOG_MAX_LEVEL
+#define HUSB238_LOG_MAX_LEVEL HUSB238_LOG_LEVEL_DEBUG
+#endif
+
+#ifndef HUSB238_LOG_RECORDS
+#define HUSB238_LOG_RECORDS (64)
+#endif
+
+
+//
+// Every log message the driver can emit: X(ID, level, format).  IDs are
+// assigned in order, so only add new messages at the end, or logs from
+// older firmware will decode wrongly.  Formats may only use conversions
+// of 32-bit integers (%d, %u, %x and friends), and end without a
+// newline.  The decoder tool parses this list.
+//
+#define HUSB238_LOG_EVENTS(X) \
+    X(BUS_RECOVERED,            ERROR, "recovered hung I2C bus in %u us: %d") \
+    X(READ_PDOS_FAILED,         ERROR, "error reading PDOs from HUSB238") \
+    X(PROBE_TIMEOUT,            ERROR, "timeout reading addr Ack from HUSB238") \
+    X(PROBE_FAILED,             ERROR, "unknown error reading addr Ack from HUSB238") \
+    X(NOT_RESPONDING,           ERROR, "HUSB238 not responding") \
+    X(FOUND,                    DEBUG, "HUSB238 found!") \
+    X(REG_ADDR_TIMEOUT,         ERROR, "timeout writing register address 0x%02x to HUSB238") \
+    X(REG_ADDR_FAILED,          ERROR, "unknown error writing register address 0x%02x to HUSB238") \
+    X(REG_ADDR_SHORT,           ERROR, "short write of register address 0x%02x to HUSB238: %d bytes instead of %u") \
+    X(REG_ADDR_WRITTEN,         DEBUG, "wrote register address 0x%02x") \
+    X(READ_TIMEOUT,             ERROR, "timeout reading register 0x%02x data from HUSB238") \
+    X(READ_FAILED,              ERROR, "unknown error reading register 0x%02x data from HUSB238") \
+    X(READ_SHORT,               ERROR, "short read of register 0x%02x data from HUSB238: %d instead of %u") \
+    X(WRITE_TIMEOUT,            ERROR, "timeout writing register 0x%02x on HUSB238") \
+    X(WRITE_FAILED,             ERROR, "unknown error writing register 0x%02x on HUSB238") \
+    X(WRITE_SHORT,              ERROR, "short write to register 0x%02x on HUSB238 (data 0x%02x): %d") \
+    X(WRITTEN,                  DEBUG, "wrote 0x%02x to register address 0x%02x") \
+    X(RESET_TIMEOUT,            ERROR, "HUSB238 not back from reset after %u ms") \
+    X(RESET_DONE,               DEBUG, "HUSB238 back from reset in %u us") \
+    X(MUX_WRITE_FAILED,         ERROR, "error writing 0x%02x to I2C mux at 0x%02x: %d") \
+    X(GAP_CALIBRATED,           DEBUG, "HUSB238 gap calibrated to %u us") \
+    X(SOAK_FAILED,              ERROR, "HUSB238 soak failed with %u us gap") \
+    X(SELECT_TIMEOUT,           ERROR, "timeout waiting for HUSB238 to select PDO 0x%02x") \
+    X(SELECTED,                 DEBUG, "selected PDO 0x%02x in %u us") \
+    X(SELECT_FAILED,            ERROR, "USB-PD transaction failed selecting PDO 0x%02x") \
+    X(SELECT_REJECTED,          ERROR, "HUSB238 rejected PDO 0x%02x, PD response %d") \
+    X(POLICY_NO_CANDIDATE,      ERROR, "no PDO from the source satisfies the policy") \
+    X(POLICY_CONTRACT_MISMATCH, ERROR, "selected %u mV but the contract doesn't match") \
+    X(POLICY_NEGOTIATED,        DEBUG, "negotiated %u mV %u mA after %u attempts in %u us") \
+    X(POLICY_CACHED_FAILED,     DEBUG, "cached PDO 0x%02x for source 0x%08x failed: %d") \
+    X(SOURCE_CACHE_FAILED,      ERROR, "error storing source 0x%08x in flash: %d") \
+    X(SUPERVISOR_LOST,          ERROR, "contract lost (reason %u): %u mV, PD response %u") \
+    X(SUPERVISOR_RESTORED,      DEBUG, "contract restored: detected in %u us, restored in %u us") \
+    X(RESET_NOT_DOWN,           ERROR, "HUSB238 not seen going down within %u us of reset")
+
+typedef enum {
+#define HUSB238_LOG_ID(id, level, format) HUSB238_LOG_##id,
+    HUSB238_LOG_EVENTS(HUSB238_LOG_ID)
+#undef HUSB238_LOG_ID
+    HUSB238_LOG_COUNT
+} husb238_log_id_t;
+
+constexpr uint8_t husb238_log_levels[HUSB238_LOG_COUNT] = {
+#define HUSB238_LOG_LEVEL(id, level, format) HUSB238_LOG_LEVEL_##level,
+    HUSB238_LOG_EVENTS(HUSB238_LOG_LEVEL)
+#undef HUSB238_LOG_LEVEL
+};
+
+typedef struct {
+    uint32_t time_us;   // Low 32 bits of time_us() at the log site.
+    uint8_t id;         // husb238_log_id_t.
+    uint8_t reserved[3];
+    uint32_t args[4];
+} husb238_log_record_t;
+
+static_assert(sizeof(husb238_log_record_t) == 24, "the decoder tool expects 24-byte records");
+
+void husb238_log(husb238_log_id_t id, uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0, uint32_t a3 = 0);
+
+//
+// Log sites.  `id` is the name from HUSB238_LOG_EVENTS, without the
+// HUSB238_LOG_ prefix.
+//
+#define HUSB238_LOG(id, args...) \
+    if (husb238_log_levels[HUSB238_LOG_##id] <= HUSB238_LOG_MAX_LEVEL) { husb238_log(HUSB238_LOG_##id, ## args); }
+#define HUSB238_ERROR(id, args...) HUSB238_LOG(id, ## args)
+#define HUSB238_PRINT(id, args...) HUSB238_LOG(id, ## args)
+
+// Messages above `level` are not recorded.  Defaults to
+// HUSB238_LOG_LEVEL_ERROR.
+void husb238_log_set_level(uint level);
+
+// The format string of a message.
+char const * husb238_log_format(husb238_log_id_t id);
+
+//
+// Format and print every buffered record with printf(), oldest first.
+// Call it from a context that may block.  Returns how many records
+// were printed.
+//
+uint32_t husb238_log_flush(void);
+
+//
+// Print every buffered record without formatting it, one line each, as
+// "husb238-log:" followed by the record in hex, for
+// tools/husb238_log_decode.py.  Returns how many records were printed.
+//
+uint32_t husb238_log_dump(void);
+
+// Move up to `max` buffered records to `records`, oldest first.
+uint32_t husb238_log_drain(husb238_log_record_t * records, uint32_t max);
+
+// Records lost to a full buffer since the last call.  Consumer side
+// only, like husb238_log_drain().
+uint32_t husb238_log_take_dropped(void);
+
+
+#endif // __HUSB238_LOG_H__
@@ -0,0 +1,88 @@
+#ifndef __HUSB238_MONITOR_H__
+#define __HUSB238_MONITOR_H__
+
+#include <atomic>
+
+#include <hardware/i2c.h>
+
+#include "husb238.h"
+#include "husb238_ring.h"
+
+
+typedef enum {
+    HUSB238_EVENT_ATTACHED,
+    HUSB238_EVENT_DETACHED,
+    HUSB238_EVENT_CONTRACT_CHANGED,
+    HUSB238_EVENT_PDOS_CHANGED,
+} husb238_event_type_t;
+
+typedef struct {
+    husb238_event_type_t type;
+    uint64_t time_us;       // When the monitor saw the change.
+    uint16_t mv;            // Contract after the change.
+    uint16_t ma;
+    uint8_t src_pdos[6];    // SRC_PDO_5V..20V registers after the change.
+} husb238_event_t;
+
+typedef struct {
+    uint64_t time_us;       // When this status was read.
+    bool connected;         // HUSB238 answered on the bus.
+    bool attached;          // ATTACH bit of PD_STATUS1.
+    uint16_t mv;            // Contract voltage, 0 if no PD contract.
+    uint16_t ma;            // Contract max current.
+    int current_pdo;        // HUSB238_SRC_PDO_* in SRC_PDO.
+    husb238_registers_t regs;
+} husb238_status_t;
+
+
+#define HUSB238_MONITOR_EVENTS (32)
+#define HUSB238_MONITOR_INTERVAL_US (10 * 1000)
+
+//
+// A HUSB238 monitor polls one HUSB238 on its own core (core1 on the
+// RP2040, a thread on the host), and publishes what it sees to the
+// other core: discrete events through `events`, and the latest status
+// through `status`.  The consuming core never touches the I2C bus.
+//
+typedef struct {
+    i2c_inst_t * i2c;
+    uint32_t interval_us;   // Poll period, 0 means HUSB238_MONITOR_INTERVAL_US.
+
+    husb238_spsc_ring<husb238_event_t, HUSB238_MONITOR_EVENTS> events;
+    husb238_seqlock<husb238_status_t> status;
+    std::atomic<uint32_t> dropped_events{0};
+    std::atomic<bool> stop{false};
+
+    // Private to the monitor core.
+    husb238_status_t last;
+} husb238_monitor_t;
+
+//
+// Launch the monitor loop on core1.  Returns PICO_OK, or
+// PICO_ERROR_NOT_PERMITTED if a monitor is already running.
+//
+int husb238_monitor_start(husb238_monitor_t * mon, i2c_inst_t * i2c);
+
+// Ask the monitor loop to exit, and wait for it to do so.
+void husb238_monitor_stop(husb238_monitor_t * mon);
+
+//
+// The monitor loop itself, for running a monitor in some other context
+// than core1.  Returns when mon->stop is set.
+//
+void husb238_monitor_run(husb238_monitor_t * mon);
+
+// One iteration of the monitor loop, without the sleep.
+void husb238_monitor_poll(husb238_monitor_t * mon);
+
+// For the consuming core.  Both are wait-free for the caller.
+static inline bool husb238_monitor_get_event(husb238_monitor_t * mon, husb238_event_t * event) {
+    return mon->events.pop(*event);
+}
+
+static inline void husb238_monitor_get_status(husb238_monitor_t const * mon, husb238_status_t * status) {
+    mon->status.read(*status);
+}
+
+
+#endif // __HUSB238_MONITOR_H__
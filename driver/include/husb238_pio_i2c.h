@@ -0,0 +1,117 @@
+#ifndef __HUSB238_PIO_I2C_H__
+#define __HUSB238_PIO_I2C_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <hardware/i2c.h>
+#include <hardware/pio.h>
+
+#include "husb238.h"
+#include "husb238_hal.h"
+
+
+//
+// I2C buses driven by PIO state machines instead of the I2C peripherals.
+//
+// Every HUSB238 answers at address 0x08 and the RP2040 only has i2c0
+// and i2c1, so without a mux only two chips can be reached.  Each
+// husb238_pio_i2c_t is an independent I2C master on any pair of GPIOs
+// (SCL must be SDA + 1), using one state machine and two DMA channels.
+// The RP2040's 12 DMA channels make for at most
+// HUSB238_PIO_I2C_MAX_BUSES buses, and fewer if anything else claims
+// DMA channels, such as a husb238_dma_i2c_t (two each).  Pass
+// husb238_pio_i2c_inst() to the driver wherever it takes an
+// i2c_inst_t *; husb238_pio_i2c_init() installs the PIO transfer
+// functions as that bus's HAL (see husb238_set_bus_hal()).
+//
+// Transfers are fed and drained by DMA, so the CPU only sets them up
+// and waits.  husb238_pio_sweep() starts a register snapshot read on
+// every bus at once, so sweeping N ports takes about as long as one.
+//
+// The state machine's IRQ flag signals a Nack; the PIO's own IRQ lines
+// aren't used, so they stay free for the application.
+//
+
+
+// Most buses husb238_pio_i2c_init() sets up, two DMA channels each.
+#ifndef HUSB238_PIO_I2C_MAX_BUSES
+#define HUSB238_PIO_I2C_MAX_BUSES (6)
+#endif
+
+// Longest write or read husb238_pio_i2c_hal supports, in bytes.
+#ifndef HUSB238_PIO_I2C_MAX_LEN
+#define HUSB238_PIO_I2C_MAX_LEN (16)
+#endif
+
+// Command words in the longest transfer: repeated START, the address,
+// the data, and STOP.
+#define HUSB238_PIO_I2C_MAX_CMDS (HUSB238_PIO_I2C_MAX_LEN + 10)
+
+typedef struct {
+    // Must be first: the driver knows this bus by the address of `key`,
+    // and the PIO HAL gets back to the bus from it.
+    i2c_inst_t key;
+
+    PIO pio;
+    uint sm;
+    uint offset;           // Where the program is loaded in `pio`.
+    uint sda_gpio;         // SCL is sda_gpio + 1.
+    uint baudrate;
+    int tx_dma;
+    int rx_dma;
+    bool restart;          // The last transfer ended without a STOP.
+
+    // The transfer in flight.
+    uint16_t cmds[HUSB238_PIO_I2C_MAX_CMDS];
+    uint8_t rx[HUSB238_PIO_I2C_MAX_LEN + 1];
+    uint rx_len;
+    uint rx_skip;          // Leading bytes of `rx` clocked out by us.
+    bool tail;             // DMA done, waiting for the Ack and STOP.
+} husb238_pio_i2c_t;
+
+
+//
+// Set up `bus` as an I2C master at `baudrate` on `sda_gpio` and
+// sda_gpio + 1, on an unused state machine of `pio`, and make the driver
+// use it for husb238_pio_i2c_inst(bus).  The program is loaded into each
+// PIO once, and shared by all its buses.  `bus` must stay valid until
+// husb238_pio_i2c_deinit().
+//
+// Returns PICO_OK, or PICO_ERROR_INSUFFICIENT_RESOURCES if
+// HUSB238_PIO_I2C_MAX_BUSES buses are already set up, or there's no free
+// state machine, DMA channel, program space or bus HAL slot.
+//
+int husb238_pio_i2c_init(husb238_pio_i2c_t * bus, PIO pio, uint sda_gpio, uint baudrate);
+
+// Release the state machine and DMA channels, and drop the bus HAL.
+void husb238_pio_i2c_deinit(husb238_pio_i2c_t * bus);
+
+// The i2c_inst_t * to pass to the driver for `bus`.
+static inline i2c_inst_t * husb238_pio_i2c_inst(husb238_pio_i2c_t * bus) {
+    return &bus->key;
+}
+
+//
+// The HAL husb238_pio_i2c_init() installs.  Its transfers take an
+// i2c_inst_t * from husb238_pio_i2c_inst(), and return the same values
+// as the SDK's: the byte count, PICO_ERROR_GENERIC on a Nack, or
+// PICO_ERROR_TIMEOUT.  bus_recover is NULL; a timed-out transfer resets
+// the state machine and ends with a STOP instead.
+//
+extern husb238_hal_t const husb238_pio_i2c_hal;
+
+//
+// Read a register snapshot from the HUSB238 on each of `n` buses, all at
+// the same time, as husb238_read_snapshot() would: the register pointer
+// writes all run together, then the longest configured gap_us, then the
+// reads.  results[i] is PICO_OK or the error on buses[i]; regs[i] is
+// valid when it's PICO_OK.  Each of the two phases waits at most
+// `timeout_us`.  There are no retries, and nothing is traced.
+//
+// Returns PICO_OK if every read succeeded, otherwise the first error.
+//
+int husb238_pio_sweep(husb238_pio_i2c_t * const buses[], size_t n, husb238_registers_t regs[], int results[], uint timeout_us);
+
+
+#endif // __HUSB238_PIO_I2C_H__
@@ -0,0 +1,74 @@
+#ifndef __HUSB238_POLICY_H__
+#define __HUSB238_POLICY_H__
+
+#include <hardware/i2c.h>
+
+#include "husb238.h"
+#include "husb238_source_cache.h"
+
+
+//
+// PDO negotiation policy.
+//
+// husb238_negotiate() reads the source's capabilities once, ranks the
+// PDOs that satisfy the policy, and selects them best-first until one
+// sticks.  A PDO is eligible if its voltage is within [min_mv, max_mv]
+// and the source offers at least min_ma at it.  Eligible PDOs listed in
+// preferred_mv come first, in that order; the rest follow by power,
+// highest first, with the lower voltage winning a tie.
+//
+// If the contract already in place is the best candidate, no SELECT_PDO
+// is sent at all.  Otherwise each attempt is verified against
+// PD_STATUS0/PD_STATUS1 after the HUSB238 reports success, and a PDO
+// that was rejected, failed, or didn't produce the expected contract
+// moves the negotiation on to the next candidate.
+//
+typedef struct {
+    uint16_t min_mv;          // Lowest acceptable voltage, 0 for no limit.
+    uint16_t max_mv;          // Highest acceptable voltage, 0 for no limit.
+    uint16_t min_ma;          // Current the load needs.
+    uint16_t preferred_mv[6]; // Voltages to try first, ends at the first 0.
+    uint8_t max_attempts;     // SELECT_PDO round-trips allowed, 0 for no limit.
+    uint32_t timeout_us;      // Per attempt, 0 means HUSB238_SELECT_PDO_TIMEOUT_US.
+} husb238_policy_t;
+
+typedef struct {
+    husb238_pdo_fixed_t pdo;      // The PDO in force at the end.
+    uint8_t candidates;           // PDOs that satisfied the policy.
+    uint8_t attempts;             // SELECT_PDO round-trips made.
+    int last_error;               // Why the last failed attempt failed.
+    uint64_t time_to_contract_us; // From the call to a verified contract.
+    uint32_t negotiation_us;      // The SELECT_PDO that stuck, 0 if none was sent.
+    bool cached;                  // The PDO came from the source cache.
+} husb238_negotiation_t;
+
+//
+// Negotiate the best contract the policy allows with the source behind
+// the HUSB238 on `i2c`, and describe how it went in `*result`.
+//
+// Returns PICO_OK once a contract matching a candidate is verified,
+// PICO_ERROR_NOT_PERMITTED if nothing is attached,
+// PICO_ERROR_NO_DATA if no advertised PDO satisfies the policy, or the
+// error from the last attempt (see husb238_select_pdo()) if every
+// attempt allowed failed.
+//
+int husb238_negotiate(i2c_inst_t * i2c, husb238_policy_t const * policy, husb238_negotiation_t * result);
+
+//
+// husb238_negotiate(), but first asking a source found in `cache` for
+// the PDO that last gave a contract with it, if the policy still allows
+// it.  That attempt times out after four times the negotiation time
+// remembered for the source (at least HUSB238_CACHED_MIN_TIMEOUT_US),
+// and if it fails the rest of the candidates are tried as usual,
+// within the same max_attempts.  The PDO that sticks, and how long it
+// took, is stored in the cache.
+//
+// Returns the same as husb238_negotiate().  The cache not being written
+// doesn't fail the negotiation.
+//
+#define HUSB238_CACHED_MIN_TIMEOUT_US (50 * 1000)
+
+int husb238_negotiate_cached(i2c_inst_t * i2c, husb238_policy_t const * policy, husb238_source_cache_t * cache, husb238_negotiation_t * result);
+
+
+#endif // __HUSB238_POLICY_H__
@@ -0,0 +1,217 @@
+#ifndef __HUSB238_REGS_H__
+#define __HUSB238_REGS_H__
+
+#include <stdint.h>
+
+
+//
+// HUSB238 register map, and side-effect-free decoding of register
+// values into typed structs (and encoding of commands back).
+//
+// Everything here is constexpr and does no I/O, so it works on the host
+// as well as the RP2040, can be evaluated at compile time, and can
+// decode one register snapshot as often as needed without touching the
+// bus.  Every decoder is defined for all 256 values of its register;
+// husb238_regs_check.cpp verifies that at compile time.
+//
+
+
+#define HUSB238_I2C_SLAVE_ADDRESS (0x08)
+
+#define HUSB238_I2C_REG_PD_STATUS0  (0x00)
+#define HUSB238_I2C_REG_PD_STATUS1  (0x01)
+#define HUSB238_I2C_REG_SRC_PDO_5V  (0x02)
+#define HUSB238_I2C_REG_SRC_PDO_9V  (0x03)
+#define HUSB238_I2C_REG_SRC_PDO_12V (0x04)
+#define HUSB238_I2C_REG_SRC_PDO_15V (0x05)
+#define HUSB238_I2C_REG_SRC_PDO_18V (0x06)
+#define HUSB238_I2C_REG_SRC_PDO_20V (0x07)
+#define HUSB238_I2C_REG_SRC_PDO     (0x08)
+#define HUSB238_I2C_REG_GO_COMMAND  (0x09)
+
+// GO_COMMAND values.
+#define HUSB238_CMD_HARD_RESET  (0x10)
+#define HUSB238_CMD_GET_SRC_CAP (0x04)
+#define HUSB238_CMD_SELECT_PDO  (0x01)
+
+// Values of the SRC_PDO register (the PDO to request with SELECT_PDO).
+#define HUSB238_SRC_PDO_NONE (0x00)
+#define HUSB238_SRC_PDO_5V   (0x10)
+#define HUSB238_SRC_PDO_9V   (0x20)
+#define HUSB238_SRC_PDO_12V  (0x30)
+#define HUSB238_SRC_PDO_15V  (0x80)
+#define HUSB238_SRC_PDO_18V  (0x90)
+#define HUSB238_SRC_PDO_20V  (0xa0)
+
+// Values of the PD_RESPONSE field of PD_STATUS1.
+#define HUSB238_PD_RESPONSE_NONE             (0)
+#define HUSB238_PD_RESPONSE_SUCCESS          (1)
+#define HUSB238_PD_RESPONSE_INVALID          (3)
+#define HUSB238_PD_RESPONSE_NOT_SUPPORTED    (4)
+#define HUSB238_PD_RESPONSE_TRANSACTION_FAIL (5)
+
+// Number of fixed PDOs the HUSB238 knows about: 5, 9, 12, 15, 18, 20 V.
+#define HUSB238_NUM_PDOS (6)
+
+
+//
+// Decode tables.  Each covers every value of its bit field.
+//
+
+// Contract voltage by the PD_SRC_VOLTAGE field of PD_STATUS0.  Values
+// the datasheet doesn't define mean there's no PD contract, like 0.
+constexpr uint16_t husb238_pd_src_mv[16] = {
+    0, 5000, 9000, 12000, 15000, 18000, 20000,
+    0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+// Max current by the PD_SRC_CURRENT field of PD_STATUS0, and by the
+// identically encoded PDO_CURRENT field of the SRC_PDO_* registers.
+constexpr uint16_t husb238_pd_src_ma[16] = {
+    500, 700,
+    1000, 1250, 1500, 1750,
+    2000, 2250, 2500, 2750,
+    3000, 3250, 3500,
+    4000, 4500,
+    5000
+};
+
+// 5V contract current by the 5V_CURRENT field of PD_STATUS1.
+constexpr uint16_t husb238_5v_ma[4] = { 0, 1500, 2400, 3000 };
+
+// SRC_PDO register value of each PDO, by PDO index (5 V is index 0).
+constexpr uint8_t husb238_src_pdo_ids[HUSB238_NUM_PDOS] = {
+    HUSB238_SRC_PDO_5V, HUSB238_SRC_PDO_9V, HUSB238_SRC_PDO_12V,
+    HUSB238_SRC_PDO_15V, HUSB238_SRC_PDO_18V, HUSB238_SRC_PDO_20V
+};
+
+
+//
+// PD_STATUS0: the current PD contract.
+//
+typedef struct {
+    uint8_t voltage_code;  // PD_SRC_VOLTAGE, bits 7:4.
+    uint8_t current_code;  // PD_SRC_CURRENT, bits 3:0.
+    uint16_t mv;           // Contract voltage, 0 if there's no PD contract.
+    uint16_t ma;           // Contract max current, 0 if there's no PD contract.
+} husb238_pd_status0_t;
+
+constexpr husb238_pd_status0_t husb238_decode_pd_status0(uint8_t val) {
+    uint8_t voltage_code = val >> 4;
+    uint8_t current_code = val & 0x0f;
+    uint16_t mv = husb238_pd_src_mv[voltage_code];
+    return {
+        voltage_code,
+        current_code,
+        mv,
+        (uint16_t)(mv ? husb238_pd_src_ma[current_code] : 0),
+    };
+}
+
+
+//
+// PD_STATUS1: attachment, the outcome of the last command, and the
+// non-PD 5V contract.
+//
+typedef struct {
+    bool cc2;              // CC_DIR: CC2 (rather than CC1) is connected.
+    bool attached;         // ATTACH.
+    uint8_t pd_response;   // PD_RESPONSE, HUSB238_PD_RESPONSE_*.
+    bool contract_5v;      // 5V_VOLTAGE: the contract is at 5 V.
+    uint8_t current_5v_code; // 5V_CURRENT.
+    uint16_t ma_5v;        // 5V contract max current, 0 if unknown.
+} husb238_pd_status1_t;
+
+constexpr husb238_pd_status1_t husb238_decode_pd_status1(uint8_t val) {
+    return {
+        (val & 0x80) != 0,
+        (val & 0x40) != 0,
+        (uint8_t)((val >> 3) & 0x07),
+        (val & 0x04) != 0,
+        (uint8_t)(val & 0x03),
+        husb238_5v_ma[val & 0x03],
+    };
+}
+
+constexpr uint8_t husb238_encode_pd_status1(husb238_pd_status1_t const & s) {
+    return (s.cc2 ? 0x80 : 0)
+        | (s.attached ? 0x40 : 0)
+        | ((s.pd_response & 0x07) << 3)
+        | (s.contract_5v ? 0x04 : 0)
+        | (s.current_5v_code & 0x03);
+}
+
+constexpr bool husb238_attached(uint8_t pd_status1) {
+    return husb238_decode_pd_status1(pd_status1).attached;
+}
+
+constexpr uint8_t husb238_pd_response(uint8_t pd_status1) {
+    return husb238_decode_pd_status1(pd_status1).pd_response;
+}
+
+constexpr char const * husb238_pd_response_str(uint8_t pd_response) {
+    switch (pd_response) {
+        case HUSB238_PD_RESPONSE_NONE:             return "no response";
+        case HUSB238_PD_RESPONSE_SUCCESS:          return "success";
+        case HUSB238_PD_RESPONSE_INVALID:          return "invalid command or argument";
+        case HUSB238_PD_RESPONSE_NOT_SUPPORTED:    return "command not supported";
+        case HUSB238_PD_RESPONSE_TRANSACTION_FAIL: return "transaction fail, no GoodCRC received after sending";
+    }
+    return "(reserved)";
+}
+
+
+//
+// SRC_PDO_5V .. SRC_PDO_20V: what the source offers at each voltage.
+//
+typedef struct {
+    bool detected;         // SRC_DETECT, bit 7.
+    uint8_t current_code;  // PDO_CURRENT, bits 3:0.
+    uint16_t max_ma;       // Max current, 0 if not detected.
+} husb238_src_pdo_reg_t;
+
+constexpr husb238_src_pdo_reg_t husb238_decode_src_pdo_reg(uint8_t val) {
+    bool detected = (val & 0x80) != 0;
+    return {
+        detected,
+        (uint8_t)(val & 0x0f),
+        (uint16_t)(detected ? husb238_pd_src_ma[val & 0x0f] : 0),
+    };
+}
+
+// Nominal voltage of the PDO with index `index`, 5 V being index 0.
+constexpr uint16_t husb238_pdo_index_mv(int index) {
+    return (index >= 0 && index < HUSB238_NUM_PDOS) ? husb238_pd_src_mv[index + 1] : 0;
+}
+
+
+//
+// SRC_PDO: the PDO to request.  Decodes to a PDO index (5 V is 0), or
+// -1 if the register doesn't select a known PDO.
+//
+constexpr int husb238_decode_src_pdo(uint8_t val) {
+    for (int i = 0; i < HUSB238_NUM_PDOS; ++i) {
+        if (husb238_src_pdo_ids[i] == (val & 0xf0)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// SRC_PDO value selecting PDO `index`, or HUSB238_SRC_PDO_NONE.
+constexpr uint8_t husb238_encode_src_pdo(int index) {
+    return (index >= 0 && index < HUSB238_NUM_PDOS) ? husb238_src_pdo_ids[index] : HUSB238_SRC_PDO_NONE;
+}
+
+// SRC_PDO value for the PDO at `mv`, or HUSB238_SRC_PDO_NONE.
+constexpr uint8_t husb238_encode_src_pdo_mv(uint16_t mv) {
+    for (int i = 0; i < HUSB238_NUM_PDOS; ++i) {
+        if (husb238_pdo_index_mv(i) == mv) {
+            return husb238_src_pdo_ids[i];
+        }
+    }
+    return HUSB238_SRC_PDO_NONE;
+}
+
+
+#endif // __HUSB238_REGS_H__
@@ -0,0 +1,105 @@
+#ifndef __HUSB238_RING_H__
+#define __HUSB238_RING_H__
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+
+//
+// Lock-free single-producer, single-consumer ring of `N` slots (a power
+// of two), holding up to N-1 items.  push() may only be called from one
+// context and pop() from one other context; neither ever blocks.
+//
+// Only atomic loads and stores are used (no read-modify-write), so this
+// is lock-free on the Cortex-M0+ too.
+//
+template <typename T, uint32_t N>
+class husb238_spsc_ring {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+    // Returns false (and drops `item`) if the ring is full.
+    bool push(T const & item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= N - 1) {
+            return false;
+        }
+        slots_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the ring is empty.
+    bool pop(T & item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t size(void) const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    //
+    // Copy up to `max` of the oldest items to `items` without removing
+    // them, and return how many were copied.  Consumer side only.
+    //
+    uint32_t peek(T * items, uint32_t max) const {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        uint32_t n = 0;
+        for (; n < max && tail + n != head; ++n) {
+            items[n] = slots_[(tail + n) & (N - 1)];
+        }
+        return n;
+    }
+
+private:
+    T slots_[N];
+    std::atomic<uint32_t> head_{0};  // Written only by the producer.
+    std::atomic<uint32_t> tail_{0};  // Written only by the consumer.
+};
+
+
+//
+// A value with one writer and any number of readers.  Readers never
+// block the writer; they retry if the writer was mid-update.
+//
+template <typename T>
+class husb238_seqlock {
+public:
+    void write(T const & value) {
+        uint32_t seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&value_, &value, sizeof(T));
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    void read(T & value) const {
+        uint32_t seq0, seq1;
+        do {
+            seq0 = seq_.load(std::memory_order_acquire);
+            memcpy(&value, &value_, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            seq1 = seq_.load(std::memory_order_relaxed);
+        } while ((seq0 & 1) || seq0 != seq1);
+    }
+
+    // Number of completed writes.
+    uint32_t writes(void) const {
+        return seq_.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    T value_;
+    std::atomic<uint32_t> seq_{0};
+};
+
+
+#endif // __HUSB238_RING_H__
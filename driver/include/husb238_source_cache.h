@@ -0,0 +1,84 @@
+#ifndef __HUSB238_SOURCE_CACHE_H__
+#define __HUSB238_SOURCE_CACHE_H__
+
+#include <stdint.h>
+
+#include <hardware/i2c.h>
+
+#include "husb238.h"
+#include "husb238_flash.h"
+
+
+//
+// Sources the HUSB238 has negotiated with before, kept in flash.
+//
+// A source is known by a fingerprint of its SRC_PDO register image (the
+// voltages it offers and the current at each), and the cache remembers
+// the PDO that last gave a contract with it and how long that
+// negotiation took.  On reattach, husb238_negotiate_cached() (see
+// "husb238_policy.h") asks a known source for that PDO straight away.
+//
+// The flash region is a log of 16-byte records, one sector at a time.
+// Each sector starts with a header and a copy of every live entry, then
+// takes updates until it's full, when the next sector round the region
+// is erased and started.  Erases rotate through all the sectors, and a
+// power cut at any point loses at most the update being written.
+//
+#define HUSB238_SOURCE_CACHE_ENTRIES (16)
+
+typedef struct {
+    uint32_t fingerprint;
+    uint8_t pdo;              // HUSB238_SRC_PDO_* that last gave a contract.
+    uint32_t negotiation_us;  // How long that SELECT_PDO took.
+    uint32_t stamp;           // Higher is more recently stored.
+} husb238_source_entry_t;
+
+typedef struct {
+    husb238_flash_t const * flash;
+    uint32_t sector;          // The sector being written.
+    uint32_t sector_seq;      // Its sequence number, one up on the last.
+    uint32_t write_offset;    // Where the next record goes in it.
+    uint32_t stamp;
+
+    uint8_t count;
+    husb238_source_entry_t entries[HUSB238_SOURCE_CACHE_ENTRIES];
+
+    // Metrics.
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t programs;        // Records written.
+    uint32_t erases;
+} husb238_source_cache_t;
+
+// FNV-1a of the six SRC_PDO registers.
+uint32_t husb238_source_fingerprint(husb238_registers_t const * regs);
+
+//
+// Load the cache from `flash`, which must stay valid while the cache is
+// in use.  Flash that doesn't hold a cache yet is formatted.
+//
+// Returns PICO_OK, PICO_ERROR_INVALID_ARG if the region has fewer than
+// two sectors or sectors too small for a full copy of the cache, or a
+// PICO_ERROR_* constant from the flash.
+//
+int husb238_source_cache_mount(husb238_source_cache_t * cache, husb238_flash_t const * flash);
+
+// Look up a source.  Returns true, and fills in *entry, if it's known.
+bool husb238_source_cache_lookup(husb238_source_cache_t * cache, uint32_t fingerprint, husb238_source_entry_t * entry);
+
+//
+// Remember that `pdo` gave a contract with the source in
+// `negotiation_us`.  To spare the flash, nothing is written if the
+// entry already says so to within a quarter of the time.  When the
+// cache is full, the entry stored longest ago is dropped.
+//
+// Returns PICO_OK, or a PICO_ERROR_* constant from the flash
+// (PICO_ERROR_IO if a record didn't read back as written).
+//
+int husb238_source_cache_store(husb238_source_cache_t * cache, uint32_t fingerprint, uint8_t pdo, uint32_t negotiation_us);
+
+// Forget every source.  Starts a fresh sector.
+int husb238_source_cache_clear(husb238_source_cache_t * cache);
+
+
+#endif // __HUSB238_SOURCE_CACHE_H__
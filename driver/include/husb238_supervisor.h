@@ -0,0 +1,123 @@
+#ifndef __HUSB238_SUPERVISOR_H__
+#define __HUSB238_SUPERVISOR_H__
+
+#include <hardware/i2c.h>
+
+#include "husb238.h"
+
+
+//
+// Contract supervisor: holds a target PDO and puts it back when the
+// contract drifts.
+//
+// Every interval_us, a check reads PD_STATUS0 and PD_STATUS1 in one
+// transfer.  The contract is lost if the HUSB238 stops answering, the
+// source detaches, the contract voltage is no longer the target's (a
+// source that resets drops to 5 V), or PD_RESPONSE changes to one of
+// the failure codes.  The supervisor then selects the target PDO again,
+// waiting backoff_min_us after a failed attempt and doubling that up to
+// backoff_max_us, until a check sees the target contract.  After a
+// detach it waits for the next attach before trying.
+//
+// Nothing blocks: husb238_supervisor_poll() does at most one check or
+// one step of a SELECT_PDO per call.  Callbacks run from it, and any of
+// them may be NULL.
+//
+// Time to detect is from the last check that saw the target contract
+// to the one that saw it gone, so at most interval_us plus a transfer;
+// time to restore is from there to the check that saw the target
+// contract again.  Loads that brown out set restore_budget_us, and get
+// budget_exceeded as soon as a restoration runs over it.
+//
+#define HUSB238_SUPERVISOR_INTERVAL_US (20 * 1000)
+#define HUSB238_SUPERVISOR_BACKOFF_MIN_US (10 * 1000)
+#define HUSB238_SUPERVISOR_BACKOFF_MAX_US (1000 * 1000)
+#define HUSB238_SUPERVISOR_POLL_US (1000)
+
+typedef struct {
+    uint32_t interval_us;        // Check period, 0 for the default.
+    uint32_t backoff_min_us;     // Wait after the first failed attempt, 0 for the default.
+    uint32_t backoff_max_us;     // Longest wait between attempts, 0 for the default.
+    uint32_t timeout_us;         // Per attempt, 0 means HUSB238_SELECT_PDO_TIMEOUT_US.
+    uint32_t restore_budget_us;  // 0 for no budget.
+} husb238_supervisor_config_t;
+
+typedef enum {
+    HUSB238_SUPERVISOR_IDLE,       // No target.
+    HUSB238_SUPERVISOR_HOLDING,    // The target contract is in place.
+    HUSB238_SUPERVISOR_RESTORING,  // Selecting the target PDO again.
+    HUSB238_SUPERVISOR_DETACHED,   // Waiting for a source, or for the HUSB238 to answer.
+} husb238_supervisor_state_t;
+
+// Why the contract was lost.
+typedef enum {
+    HUSB238_SUPERVISOR_LOST_NONE,
+    HUSB238_SUPERVISOR_LOST_NOT_RESPONDING,  // The HUSB238 didn't answer the check.
+    HUSB238_SUPERVISOR_LOST_DETACHED,        // ATTACH cleared.
+    HUSB238_SUPERVISOR_LOST_CONTRACT,        // The contract voltage isn't the target's.
+    HUSB238_SUPERVISOR_LOST_PD_RESPONSE,     // PD_RESPONSE changed to a failure code.
+} husb238_supervisor_reason_t;
+
+typedef struct {
+    void (*lost)(void * ctx, husb238_supervisor_reason_t reason, uint16_t mv, uint8_t pd_response);
+    void (*restored)(void * ctx, uint32_t detect_us, uint32_t restore_us);
+    void (*budget_exceeded)(void * ctx, uint32_t elapsed_us);
+    void * ctx;
+} husb238_supervisor_callbacks_t;
+
+typedef struct {
+    i2c_inst_t * i2c;
+    husb238_supervisor_config_t config;
+    husb238_supervisor_callbacks_t callbacks;
+
+    int target_pdo;   // HUSB238_SRC_PDO_*.
+    uint16_t target_mv;
+
+    husb238_supervisor_state_t state;
+    husb238_supervisor_reason_t reason;  // Of the loss being restored.
+    uint8_t pd_response;                 // As of the last check.
+    uint64_t next_us;                    // When the next poll has work to do.
+    uint32_t backoff_us;
+    husb238_select_t select;
+    uint64_t last_good_us;  // Last check that saw the target contract.
+    uint64_t lost_us;       // When the loss was detected, 0 while first establishing the target.
+    bool over_budget;       // budget_exceeded was called for this loss.
+
+    // Metrics.
+    uint32_t checks;
+    uint32_t losses;
+    uint32_t restores;
+    uint32_t attempts;          // SELECT_PDO round-trips.
+    uint32_t failures;          // Of those, ones that failed.
+    uint32_t over_budgets;      // Restorations that ran over restore_budget_us.
+    uint32_t last_detect_us;
+    uint32_t max_detect_us;
+    uint32_t last_restore_us;
+    uint32_t max_restore_us;
+} husb238_supervisor_t;
+
+//
+// Set up `sv` to supervise the HUSB238 on `i2c`, with no target yet.
+// NULL `config` means the defaults.
+//
+void husb238_supervisor_init(husb238_supervisor_t * sv, i2c_inst_t * i2c, husb238_supervisor_config_t const * config, husb238_supervisor_callbacks_t const * callbacks);
+
+//
+// Hold `pdo` (one of the HUSB238_SRC_PDO_* values), or nothing for
+// HUSB238_SRC_PDO_NONE.  The supervisor starts by establishing it, which
+// doesn't count as a loss or a restore.
+//
+// Returns PICO_OK, or PICO_ERROR_INVALID_ARG if `pdo` isn't a PDO.
+//
+int husb238_supervisor_set_target(husb238_supervisor_t * sv, int pdo);
+
+//
+// Call this as often as convenient; it only touches the bus once
+// sv->next_us has passed.
+//
+// Returns the state after the poll.
+//
+husb238_supervisor_state_t husb238_supervisor_poll(husb238_supervisor_t * sv);
+
+
+#endif // __HUSB238_SUPERVISOR_H__
@@ -0,0 +1,106 @@
+#ifndef __HUSB238_TRACE_H__
+#define __HUSB238_TRACE_H__
+
+#include <pico/types.h>
+
+
+//
+// Always-on tracing of driver I2C traffic, and latency histograms of
+// driver operations.
+//
+// Every I2C transfer the driver makes is recorded in a RAM ring of
+// HUSB238_TRACE_ENTRIES entries.  Recording costs two time_us() calls
+// and a few stores, and never prints or blocks.  When the ring is full
+// new entries are dropped (and counted) rather than overwriting ones
+// that haven't been drained yet, so one context may record (the core
+// running the driver) while another drains.
+//
+
+
+#ifndef HUSB238_TRACE_ENTRIES
+#define HUSB238_TRACE_ENTRIES (128)
+#endif
+
+#define HUSB238_TRACE_WRITE (0)
+#define HUSB238_TRACE_READ  (1)
+
+// `reg` of transfers that don't address a HUSB238 register: the probe
+// in husb238_connected(), and mux channel selects.
+#define HUSB238_TRACE_NO_REG (0xff)
+
+typedef struct {
+    uint32_t time_us;      // Start of the transfer, low 32 bits of time_us().
+    uint32_t duration_us;
+    uint8_t addr;          // I2C address: the HUSB238's, or a mux's.
+    uint8_t reg;           // First register addressed, or HUSB238_TRACE_NO_REG.
+    uint8_t dir;           // HUSB238_TRACE_WRITE or HUSB238_TRACE_READ.
+    uint8_t len;           // Bytes requested.
+    int16_t result;        // What the HAL returned: bytes, or PICO_ERROR_*.
+} husb238_trace_entry_t;
+
+// Turn recording on or off.  On by default.
+void husb238_trace_enable(bool enable);
+
+//
+// Copy up to `max` of the oldest entries to `entries`, oldest first,
+// and return how many were copied.  husb238_trace_drain() removes them
+// from the ring, husb238_trace_snapshot() leaves them there.
+//
+uint32_t husb238_trace_snapshot(husb238_trace_entry_t * entries, uint32_t max);
+uint32_t husb238_trace_drain(husb238_trace_entry_t * entries, uint32_t max);
+
+// Entries lost to a full ring since the last call.  Consumer side only.
+uint32_t husb238_trace_take_dropped(void);
+
+
+//
+// Latency histograms, one per operation.  Bucket 0 counts operations
+// that took 0 or 1 us, and bucket i > 0 those that took [2^i, 2^(i+1))
+// us; the last bucket also takes everything longer.
+//
+typedef enum {
+    HUSB238_OP_READ_REGISTER,  // husb238_read_register(), cache hits included.
+    HUSB238_OP_WRITE_REGISTER, // husb238_write_register().
+    HUSB238_OP_GET_PDOS,       // husb238_get_pdos().
+    HUSB238_OP_SELECT_PDO,     // SELECT_PDO until PD_RESPONSE, via husb238_poll().
+    HUSB238_OP_RESET,          // husb238_reset().
+    HUSB238_OP_COUNT
+} husb238_op_t;
+
+#define HUSB238_HISTOGRAM_BUCKETS (24)
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t buckets[HUSB238_HISTOGRAM_BUCKETS];
+} husb238_histogram_t;
+
+char const * husb238_op_name(husb238_op_t op);
+
+void husb238_get_histogram(husb238_op_t op, husb238_histogram_t * histogram);
+void husb238_clear_histograms(void);
+
+// Add one operation to a histogram, e.g. an application's own.
+void husb238_histogram_add(husb238_histogram_t * histogram, uint32_t duration_us);
+
+//
+// Upper bound, in us, of the bucket holding the `permille`th
+// per-mille operation (500 for the median, 990 for p99), or 0 if the
+// histogram is empty.
+//
+uint32_t husb238_histogram_percentile_us(husb238_histogram_t const * histogram, uint permille);
+
+// Print count, min, median, p99 and max of every non-empty histogram.
+void husb238_print_histograms(void);
+
+
+//
+// For the driver: record a transfer, or an operation's latency.
+//
+void husb238_trace_transfer(uint64_t start_us, uint32_t duration_us, uint8_t addr, uint8_t reg, uint8_t dir, size_t len, int result);
+void husb238_trace_op(husb238_op_t op, uint32_t duration_us);
+
+
+#endif // __HUSB238_TRACE_H__
@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/i2c.h>
+
+#include <pico/async_context_poll.h>
+#include <pico/stdlib.h>
+
+#include "husb238.h"
+#include "husb238_async.h"
+
+
+//
+// Drive the HUSB238 from an async_context on one core, next to a 1 kHz
+// control loop that must not be held up: read the contract every 100
+// ms, step to the next PDO the source offers every 5 s, and hard reset
+// every 30 s.  Every 5 s, print how late the control loop ran at worst,
+// along with the last negotiation and reset times.
+//
+
+#define TICK_US (1000)
+#define SNAPSHOT_MS (100)
+#define SELECT_MS (5 * 1000)
+#define RESET_MS (30 * 1000)
+
+
+static struct {
+    uint32_t ticks;
+    uint32_t max_late_us;
+    uint32_t snapshots;
+    uint32_t errors;
+    bool resetting;  // The HUSB238 drops off the bus for a while.
+    uint16_t mv;
+    uint16_t ma;
+} app;
+
+static husb238_registers_t regs;
+
+
+static void snapshot_done(husb238_async_t * op, int result) {
+    if (result != PICO_OK) {
+        app.errors++;
+        return;
+    }
+
+    husb238_pd_status0_t contract = husb238_decode_pd_status0(regs.pd_status0);
+    if (contract.mv != app.mv || contract.ma != app.ma) {
+        printf("contract: %u mV, %u mA\n", contract.mv, contract.ma);
+        app.mv = contract.mv;
+        app.ma = contract.ma;
+    }
+    app.snapshots++;
+}
+
+
+static void select_done(husb238_async_t * op, int result) {
+    printf("select PDO 0x%02x: %d after %llu us\n", op->select.pdo, result, (unsigned long long)op->select.latency_us);
+    if (result != PICO_OK) {
+        app.errors++;
+    }
+}
+
+
+static void reset_done(husb238_async_t * op, int result) {
+    app.resetting = false;
+    printf("reset: %d after %lu us\n", result, (unsigned long)op->reset.elapsed_us);
+    if (result != PICO_OK) {
+        app.errors++;
+    }
+}
+
+
+// The next PDO the source offers after the contract's, from the last
+// snapshot.
+static int next_pdo(void) {
+    husb238_pdo_fixed_t pdos[6];
+    husb238_snapshot_get_pdos_fixed(&regs, pdos);
+
+    int current = husb238_decode_src_pdo(husb238_encode_src_pdo_mv(app.mv));
+    for (int i = 1; i <= 6; ++i) {
+        int next = (current + i) % 6;
+        if (pdos[next].max_ma > 0) {
+            return pdos[next].id;
+        }
+    }
+    return HUSB238_SRC_PDO_NONE;
+}
+
+
+int main() {
+    stdio_init_all();
+
+
+    //
+    // Initialize i2c.
+    //
+
+    i2c_inst_t * i2c;
+
+    const uint sda_gpio = 16;  // pin 21
+    const uint scl_gpio = 17;  // pin 22
+
+    i2c = i2c0;
+    uint baudrate = i2c_init(i2c, 400*1000);  // run i2c at 400 kHz
+
+    gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
+
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+
+    // Repeated starts, so a register read has no gap to wait out in the
+    // middle.
+    husb238_config_t config = {
+        .baudrate = baudrate,
+        .gap_us = HUSB238_DEFAULT_GAP_US,
+        .repeated_start = true,
+    };
+    husb238_configure(i2c, &config);
+
+
+    async_context_poll_t poll;
+    if (!async_context_poll_init_with_defaults(&poll)) {
+        printf("failed to set up the async_context\n");
+        return 1;
+    }
+    async_context_t * context = &poll.core;
+
+    husb238_async_t snapshot = {};
+    husb238_async_t command = {};
+
+    uint64_t now = time_us_64();
+    uint64_t next_tick = now + TICK_US;
+    uint64_t next_snapshot = now;
+    uint64_t next_select = now + SELECT_MS * 1000;
+    uint64_t next_reset = now + RESET_MS * 1000;
+    uint64_t next_report = now + SELECT_MS * 1000;
+
+    while (1) {
+        async_context_wait_for_work_until(context, from_us_since_boot(next_tick));
+        async_context_poll(context);
+
+        now = time_us_64();
+        if (now < next_tick) {
+            continue;
+        }
+
+        // The control loop.
+        uint32_t late_us = now - next_tick;
+        if (late_us > app.max_late_us) {
+            app.max_late_us = late_us;
+        }
+        app.ticks++;
+        next_tick += TICK_US;
+
+        if (now >= next_snapshot && snapshot.result != HUSB238_IN_PROGRESS && !app.resetting) {
+            husb238_async_read_snapshot(context, &snapshot, i2c, &regs, snapshot_done);
+            next_snapshot = now + SNAPSHOT_MS * 1000;
+        }
+
+        // One command at a time.
+        if (command.result != HUSB238_IN_PROGRESS) {
+            if (now >= next_reset) {
+                app.resetting = husb238_async_reset(context, &command, i2c, NULL, reset_done) == PICO_OK;
+                next_reset = now + RESET_MS * 1000;
+            } else if (now >= next_select && app.snapshots > 0) {
+                int pdo = next_pdo();
+                if (pdo != HUSB238_SRC_PDO_NONE) {
+                    husb238_async_select_pdo(context, &command, i2c, pdo, select_done);
+                }
+                next_select = now + SELECT_MS * 1000;
+            }
+        }
+
+        if (now >= next_report) {
+            printf(
+                "ticks %lu, max late %lu us, snapshots %lu, errors %lu\n",
+                (unsigned long)app.ticks,
+                (unsigned long)app.max_late_us,
+                (unsigned long)app.snapshots,
+                (unsigned long)app.errors
+            );
+            app.max_late_us = 0;
+            next_report = now + SELECT_MS * 1000;
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/i2c.h>
+
+#include <pico/stdlib.h>
+
+#include "husb238.h"
+#include "husb238_supervisor.h"
+
+
+//
+// Hold a 15 V contract, and put it back whenever it's lost.  To have
+// something to restore, a hard reset is sent every 20 s; unplugging the
+// source, or a source that resets on its own, shows the same.  A hard
+// reset takes VBUS (and so, on most boards, the HUSB238) away for over
+// a second, hence the 2 s budget.  Every 20 s, print the time-to-detect
+// and time-to-restore figures.
+//
+
+#define TARGET_PDO HUSB238_SRC_PDO_15V
+#define RESET_MS (20 * 1000)
+
+
+static char const * reason_name(husb238_supervisor_reason_t reason) {
+    switch (reason) {
+        case HUSB238_SUPERVISOR_LOST_NOT_RESPONDING: return "not responding";
+        case HUSB238_SUPERVISOR_LOST_DETACHED:       return "detached";
+        case HUSB238_SUPERVISOR_LOST_CONTRACT:       return "contract";
+        case HUSB238_SUPERVISOR_LOST_PD_RESPONSE:    return "PD response";
+        default:                                     return "none";
+    }
+}
+
+
+static void on_lost(void * ctx, husb238_supervisor_reason_t reason, uint16_t mv, uint8_t pd_response) {
+    printf("lost: %s, %u mV, PD response %u\n", reason_name(reason), mv, pd_response);
+}
+
+
+static void on_restored(void * ctx, uint32_t detect_us, uint32_t restore_us) {
+    printf("restored: detected in %lu us, restored in %lu us\n", (unsigned long)detect_us, (unsigned long)restore_us);
+}
+
+
+static void on_budget_exceeded(void * ctx, uint32_t elapsed_us) {
+    printf("over budget: %lu us and not restored yet\n", (unsigned long)elapsed_us);
+}
+
+
+int main() {
+    stdio_init_all();
+
+
+    //
+    // Initialize i2c.
+    //
+
+    i2c_inst_t * i2c;
+
+    const uint sda_gpio = 16;  // pin 21
+    const uint scl_gpio = 17;  // pin 22
+
+    i2c = i2c0;
+    uint baudrate = i2c_init(i2c, 400*1000);  // run i2c at 400 kHz
+
+    gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
+
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+
+    husb238_config_t config = {
+        .baudrate = baudrate,
+        .gap_us = HUSB238_DEFAULT_GAP_US,
+        .repeated_start = true,
+    };
+    husb238_configure(i2c, &config);
+
+    husb238_supervisor_config_t sv_config = {
+        .interval_us = 10 * 1000,
+        .restore_budget_us = 2000 * 1000,
+    };
+    husb238_supervisor_callbacks_t callbacks = {
+        .lost = on_lost,
+        .restored = on_restored,
+        .budget_exceeded = on_budget_exceeded,
+        .ctx = NULL,
+    };
+    husb238_supervisor_t sv;
+    husb238_supervisor_init(&sv, i2c, &sv_config, &callbacks);
+    husb238_supervisor_set_target(&sv, TARGET_PDO);
+
+    husb238_reset_t reset = {};
+    uint64_t next_reset = time_us_64() + RESET_MS * 1000;
+
+    while (1) {
+        husb238_supervisor_poll(&sv);
+
+        uint64_t now = time_us_64();
+        if (reset.busy && now >= reset.next_us) {
+            husb238_reset_poll(i2c, &reset);
+        }
+        if (now >= next_reset && !reset.busy) {
+            printf(
+                "checks %lu, losses %lu, restores %lu, attempts %lu (%lu failed), over budget %lu, "
+                "detect %lu us (max %lu), restore %lu us (max %lu)\n",
+                (unsigned long)sv.checks,
+                (unsigned long)sv.losses,
+                (unsigned long)sv.restores,
+                (unsigned long)sv.attempts,
+                (unsigned long)sv.failures,
+                (unsigned long)sv.over_budgets,
+                (unsigned long)sv.last_detect_us,
+                (unsigned long)sv.max_detect_us,
+                (unsigned long)sv.last_restore_us,
+                (unsigned long)sv.max_restore_us
+            );
+            husb238_reset_begin(i2c, &reset, NULL);
+            next_reset = now + RESET_MS * 1000;
+        }
+
+        sleep_ms(1);
+    }
+}
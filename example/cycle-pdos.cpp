@@ -7,6 +7,7 @@
 #include <pico/stdlib.h>
 
 #include "husb238.h"
+#include "husb238_trace.h"
 
 
 int main() {
@@ -23,7 +24,7 @@ int main() {
     const uint scl_gpio = 17;  // pin 22
 
     i2c = i2c0;
-    i2c_init(i2c, 400*1000);  // run i2c at 400 kHz
+    uint baudrate = i2c_init(i2c, 400*1000);  // run i2c at 400 kHz
 
     gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
     gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
@@ -31,6 +32,13 @@ int main() {
     gpio_pull_up(sda_gpio);
     gpio_pull_up(scl_gpio);
 
+    // Let the driver know how fast the bus runs, so it can size its
+    // timeouts to match.
+    husb238_config_t config = {
+        .baudrate = baudrate,
+        .gap_us = HUSB238_DEFAULT_GAP_US
+    };
+    husb238_configure(i2c, &config);
 
     while (1) {
         if (!husb238_connected(i2c)) {
@@ -72,6 +80,10 @@ int main() {
                     sleep_ms(3 * 1000);
                 }
             }
+
+            // Where the bus time went.
+            printf("\n");
+            husb238_print_histograms();
         }
 
         sleep_ms(1000);
@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/i2c.h>
+
+#include <pico/stdlib.h>
+
+#include "husb238.h"
+#include "husb238_dma_i2c.h"
+
+
+//
+// How much CPU the driver's I2C traffic costs, with blocking transfers
+// and with DMA and interrupt driven ones.
+//
+// Each run reads a register snapshot every PERIOD_US for RUN_US, and
+// spends the rest of its time doing units of background work.  The CPU
+// left over for the application is the work done, relative to a run
+// that only does work.  Prints CSV.
+//
+
+#define PERIOD_US (2 * 1000)
+#define RUN_US (1000 * 1000)
+
+
+typedef struct {
+    char const * mode;
+    uint32_t reads;
+    uint32_t errors;
+    uint64_t work;
+} run_t;
+
+
+// One unit of stand-in application work.
+static void work(void) {
+    static volatile uint32_t x;
+    for (int i = 0; i < 64; ++i) {
+        x = x * 1664525u + 1013904223u;
+    }
+}
+
+
+static void run_idle(run_t * run) {
+    uint64_t end = time_us_64() + RUN_US;
+
+    run->mode = "idle";
+    while (time_us_64() < end) {
+        work();
+        run->work++;
+    }
+}
+
+
+static void run_blocking(i2c_inst_t * i2c, run_t * run) {
+    uint64_t start = time_us_64();
+    uint64_t next = start;
+
+    run->mode = "blocking";
+    while (time_us_64() < start + RUN_US) {
+        if (time_us_64() >= next) {
+            husb238_registers_t regs;
+            if (husb238_read_snapshot(i2c, &regs) != PICO_OK) {
+                run->errors++;
+            }
+            run->reads++;
+            next += PERIOD_US;
+        }
+        work();
+        run->work++;
+    }
+}
+
+
+static void run_dma(husb238_dma_i2c_t * bus, run_t * run) {
+    uint64_t start = time_us_64();
+    uint64_t next = start;
+    husb238_dma_op_t op;
+    husb238_registers_t regs;
+    bool pending = false;
+
+    run->mode = "dma";
+    while (time_us_64() < start + RUN_US) {
+        if (pending && husb238_dma_i2c_result(bus) != HUSB238_IN_PROGRESS) {
+            if (husb238_dma_i2c_result(bus) != PICO_OK) {
+                run->errors++;
+            }
+            pending = false;
+        }
+        if (!pending && time_us_64() >= next) {
+            if (husb238_dma_read_snapshot(bus, &op, &regs) == PICO_OK) {
+                pending = true;
+            } else {
+                run->errors++;
+            }
+            run->reads++;
+            next += PERIOD_US;
+        }
+        work();
+        run->work++;
+    }
+
+    if (pending && husb238_dma_i2c_wait(bus, 10 * 1000) != PICO_OK) {
+        run->errors++;
+    }
+}
+
+
+static void print_run(run_t const * run, run_t const * idle) {
+    printf(
+        "%s,%lu,%lu,%llu,%.1f\n",
+        run->mode,
+        (unsigned long)run->reads,
+        (unsigned long)run->errors,
+        (unsigned long long)run->work,
+        100.0 * run->work / idle->work
+    );
+}
+
+
+int main() {
+    stdio_init_all();
+
+
+    //
+    // Initialize i2c.
+    //
+
+    i2c_inst_t * i2c;
+
+    const uint sda_gpio = 16;  // pin 21
+    const uint scl_gpio = 17;  // pin 22
+
+    i2c = i2c0;
+    uint baudrate = i2c_init(i2c, 100*1000);  // run i2c at 100 kHz
+
+    gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
+
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+
+    husb238_config_t config = {
+        .baudrate = baudrate,
+        .gap_us = HUSB238_DEFAULT_GAP_US
+    };
+    husb238_configure(i2c, &config);
+
+
+    while (1) {
+        run_t idle = {}, blocking = {}, dma = {};
+        husb238_dma_i2c_t bus;
+
+        run_idle(&idle);
+        run_blocking(i2c, &blocking);
+
+        // The DMA transport takes over the bus (and its interrupt) only
+        // for its own run.
+        if (husb238_dma_i2c_init(&bus, i2c) != PICO_OK) {
+            printf("failed to set up DMA i2c\n");
+            sleep_ms(1000);
+            continue;
+        }
+        run_dma(&bus, &dma);
+        husb238_dma_i2c_deinit(&bus);
+
+        printf("mode,reads,errors,work,cpu_free_pct\n");
+        print_run(&idle, &idle);
+        print_run(&blocking, &idle);
+        print_run(&dma, &idle);
+        printf("\n");
+
+        sleep_ms(1000);
+    }
+}
@@ -0,0 +1,211 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/i2c.h>
+
+#include <pico/stdlib.h>
+
+#include "husb238.h"
+#include "husb238_trace.h"
+
+
+//
+// Throughput and latency of each public driver operation, at each I2C
+// clock rate, as CSV: one line per operation and rate.
+//
+// Latencies are measured around each call.  Bus bytes (address bytes
+// included) and transfers come from the driver's I2C trace, drained
+// after every call.
+//
+
+#define ITERATIONS (2000)
+
+// Negotiations and resets take hundreds of milliseconds each.
+#define SLOW_ITERATIONS (10)
+
+
+typedef int (*bench_fn_t)(i2c_inst_t * i2c);
+
+// The PDO bench_select_pdo() asks for: the one in use when the bench
+// started, so the contract doesn't change under the load.
+static int bench_pdo = HUSB238_SRC_PDO_5V;
+
+
+static int bench_connected(i2c_inst_t * i2c) {
+    return husb238_connected(i2c) ? PICO_OK : PICO_ERROR_IO;
+}
+
+
+static int bench_read_register(i2c_inst_t * i2c) {
+    uint8_t val;
+    return husb238_read_register(i2c, HUSB238_I2C_REG_PD_STATUS1, &val);
+}
+
+
+static int bench_get_pdos(i2c_inst_t * i2c) {
+    husb238_pdo_t pdos[6];
+    return husb238_get_pdos(i2c, pdos);
+}
+
+
+static int bench_get_current_pdo(i2c_inst_t * i2c) {
+    int pdo;
+    return husb238_get_current_pdo(i2c, &pdo);
+}
+
+
+static int bench_get_contract(i2c_inst_t * i2c) {
+    int volts;
+    float max_current;
+    return husb238_get_contract(i2c, volts, max_current);
+}
+
+
+static int bench_select_pdo(i2c_inst_t * i2c) {
+    return husb238_select_pdo(i2c, bench_pdo);
+}
+
+
+static int bench_reset(i2c_inst_t * i2c) {
+    return husb238_reset(i2c);
+}
+
+
+static struct {
+    char const * name;
+    bench_fn_t fn;
+    uint iterations;
+} const benches[] = {
+    { "connected",       bench_connected,       ITERATIONS },
+    { "read_register",   bench_read_register,   ITERATIONS },
+    { "get_pdos",        bench_get_pdos,        ITERATIONS },
+    { "get_current_pdo", bench_get_current_pdo, ITERATIONS },
+    { "get_contract",    bench_get_contract,    ITERATIONS },
+    { "select_pdo",      bench_select_pdo,      SLOW_ITERATIONS },
+    { "reset",           bench_reset,           SLOW_ITERATIONS },
+};
+
+static uint const baudrates[] = { 100 * 1000, 400 * 1000, 1000 * 1000 };
+
+
+static uint32_t latencies[ITERATIONS];
+
+
+static int compare_u32(void const * a, void const * b) {
+    uint32_t x = *(uint32_t const *)a;
+    uint32_t y = *(uint32_t const *)b;
+    return (x > y) - (x < y);
+}
+
+
+// Drain the trace, adding up the bytes and transfers in it.  Transfers
+// dropped from a full ring are counted, but their bytes aren't known.
+static void drain_trace(uint64_t * bytes, uint64_t * transfers) {
+    husb238_trace_entry_t entries[16];
+    uint32_t n;
+
+    while ((n = husb238_trace_drain(entries, 16)) > 0) {
+        for (uint32_t i = 0; i < n; ++i) {
+            *bytes += 1 + (entries[i].result > 0 ? entries[i].result : 0);
+        }
+        *transfers += n;
+    }
+    *transfers += husb238_trace_take_dropped();
+}
+
+
+static void run_bench(i2c_inst_t * i2c, uint baudrate, int index) {
+    uint iterations = benches[index].iterations;
+    uint32_t errors = 0;
+    uint64_t total_us = 0;
+    uint64_t bytes = 0;
+    uint64_t transfers = 0;
+
+    drain_trace(&bytes, &transfers);
+    bytes = 0;
+    transfers = 0;
+
+    for (uint i = 0; i < iterations; ++i) {
+        uint64_t start = time_us_64();
+        int r = benches[index].fn(i2c);
+        latencies[i] = time_us_64() - start;
+
+        total_us += latencies[i];
+        if (r != PICO_OK) {
+            errors++;
+        }
+        drain_trace(&bytes, &transfers);
+    }
+
+    qsort(latencies, iterations, sizeof(latencies[0]), compare_u32);
+
+    printf(
+        "%u,%s,%u,%lu,%.1f,%lu,%lu,%lu,%lu,%.1f,%.2f\n",
+        baudrate,
+        benches[index].name,
+        iterations,
+        (unsigned long)errors,
+        total_us ? iterations * 1e6 / total_us : 0.0,
+        (unsigned long)latencies[0],
+        (unsigned long)latencies[iterations / 2],
+        (unsigned long)latencies[(iterations * 99) / 100],
+        (unsigned long)latencies[iterations - 1],
+        (double)bytes / iterations,
+        (double)transfers / iterations
+    );
+}
+
+
+int main() {
+    stdio_init_all();
+
+
+    //
+    // Initialize i2c.
+    //
+
+    i2c_inst_t * i2c;
+
+    const uint sda_gpio = 16;  // pin 21
+    const uint scl_gpio = 17;  // pin 22
+
+    i2c = i2c0;
+    i2c_init(i2c, baudrates[0]);
+
+    gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
+
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+
+
+    while (1) {
+        sleep_ms(1000);
+
+        if (!husb238_connected(i2c)) {
+            printf("HUSB238 not found\n");
+            continue;
+        }
+        int pdo;
+        if (husb238_get_current_pdo(i2c, &pdo) == PICO_OK && pdo != HUSB238_SRC_PDO_NONE) {
+            bench_pdo = pdo;
+        }
+
+        printf("baudrate,op,iterations,errors,ops_per_sec,min_us,median_us,p99_us,max_us,bytes_per_op,transfers_per_op\n");
+
+        for (size_t b = 0; b < sizeof(baudrates) / sizeof(baudrates[0]); ++b) {
+            husb238_config_t config = {
+                .baudrate = i2c_set_baudrate(i2c, baudrates[b]),
+                .gap_us = HUSB238_DEFAULT_GAP_US
+            };
+            husb238_configure(i2c, &config);
+
+            for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+                run_bench(i2c, baudrates[b], i);
+            }
+        }
+
+        printf("\n");
+    }
+}
@@ -7,9 +7,218 @@
 #include <pico/stdlib.h>
 
 #include "husb238.h"
+#include "husb238_log.h"
+#include "husb238_trace.h"
 
 
-#define DEBUG 0
+//
+// Soak test: run a mix of read, select and reset workloads against the
+// HUSB238 at every combination of I2C clock rate and inter-transfer gap
+// below, and report, per combination, the error rate, the mean time
+// between failures and latency histograms.
+//
+// The report is CSV, one "soak" line per combination followed by one
+// "hist" line per workload, with the counts of the driver's log2
+// latency buckets (bucket 0 is 0-1 us, bucket i is [2^i, 2^(i+1)) us).
+// After each sweep a "best" line names the fastest clock rate, and the
+// shortest gap at it, that saw no errors.
+//
+
+static uint const soak_baudrates[] = { 100 * 1000, 400 * 1000, 1000 * 1000 };
+static uint const soak_gaps_us[] = { 0, 20, 100 };
+
+// Workloads per combination.
+#define SOAK_OPS (1000)
+
+// Mix of workloads, as parts of SOAK_MIX_READ + SOAK_MIX_SELECT +
+// SOAK_MIX_RESET.  A read gets the PDOs, the current PDO and the
+// contract.  A select re-selects the contract's PDO (or, with
+// SOAK_CYCLE_PDOS, the next one the source offers).  A reset is a
+// USB-PD hard reset.
+#define SOAK_MIX_READ (97)
+#define SOAK_MIX_SELECT (2)
+#define SOAK_MIX_RESET (1)
+#define SOAK_CYCLE_PDOS (0)
+
+
+typedef enum {
+    WORKLOAD_READ,
+    WORKLOAD_SELECT,
+    WORKLOAD_RESET,
+    WORKLOAD_COUNT
+} workload_t;
+
+static char const * const workload_names[WORKLOAD_COUNT] = { "read", "select", "reset" };
+
+typedef struct {
+    uint baudrate;
+    uint gap_us;
+    uint32_t ops[WORKLOAD_COUNT];
+    uint32_t errors[WORKLOAD_COUNT];
+    uint32_t disconnects;
+    uint64_t elapsed_us;
+    husb238_histogram_t latency[WORKLOAD_COUNT];
+    husb238_bus_stats_t bus_stats;
+} soak_result_t;
+
+
+static workload_t soak_workload(uint op) {
+    uint slot = op % (SOAK_MIX_READ + SOAK_MIX_SELECT + SOAK_MIX_RESET);
+    if (slot < SOAK_MIX_READ) {
+        return WORKLOAD_READ;
+    }
+    if (slot < SOAK_MIX_READ + SOAK_MIX_SELECT) {
+        return WORKLOAD_SELECT;
+    }
+    return WORKLOAD_RESET;
+}
+
+
+static int soak_read(i2c_inst_t * i2c) {
+    int r;
+
+    husb238_pdo_t pdos[6];
+    r = husb238_get_pdos(i2c, pdos);
+    if (r != PICO_OK) return r;
+
+    int current_pdo;
+    r = husb238_get_current_pdo(i2c, &current_pdo);
+    if (r != PICO_OK) return r;
+
+    int volts;
+    float max_current;
+    return husb238_get_contract(i2c, volts, max_current);
+}
+
+
+static int soak_select(i2c_inst_t * i2c) {
+    int r;
+
+    // The PDO of the contract in place: SRC_PDO only says what was last
+    // asked for, and is cleared by a reset.
+    uint16_t mv, ma;
+    r = husb238_get_contract_mv_ma(i2c, &mv, &ma);
+    if (r != PICO_OK) return r;
+    int pdo = husb238_encode_src_pdo_mv(mv);
+
+#if SOAK_CYCLE_PDOS
+    husb238_pdo_fixed_t pdos[6];
+    r = husb238_get_pdos_fixed(i2c, pdos);
+    if (r != PICO_OK) return r;
+
+    int current = husb238_decode_src_pdo(pdo);
+    for (int i = 1; i <= 6; ++i) {
+        int next = (current + i) % 6;
+        if (pdos[next].max_ma > 0) {
+            pdo = pdos[next].id;
+            break;
+        }
+    }
+#endif
+
+    if (pdo == HUSB238_SRC_PDO_NONE) {
+        return PICO_ERROR_NO_DATA;
+    }
+    return husb238_select_pdo(i2c, pdo);
+}
+
+
+static void soak_run(i2c_inst_t * i2c, uint trigger_gpio, soak_result_t * result) {
+    husb238_config_t config;
+    husb238_get_config(i2c, &config);
+    config.baudrate = i2c_set_baudrate(i2c, result->baudrate);
+    config.gap_us = result->gap_us;
+    husb238_configure(i2c, &config);
+    husb238_bus_stats_t before;
+    husb238_get_bus_stats(i2c, &before);
+
+    uint64_t start = time_us_64();
+    for (uint op = 0; op < SOAK_OPS; ++op) {
+        workload_t w = soak_workload(op);
+        int r;
+
+        gpio_put(trigger_gpio, false);
+        uint64_t op_start = time_us_64();
+        switch (w) {
+            case WORKLOAD_READ:   r = soak_read(i2c); break;
+            case WORKLOAD_SELECT: r = soak_select(i2c); break;
+            default:              r = husb238_reset(i2c); break;
+        }
+        husb238_histogram_add(&result->latency[w], time_us_64() - op_start);
+        result->ops[w]++;
+
+        if (r != PICO_OK) {
+            // Set the trigger GPIO for the scope.
+            gpio_put(trigger_gpio, true);
+            result->errors[w]++;
+            if (!husb238_connected(i2c)) {
+                result->disconnects++;
+                sleep_ms(1);
+            }
+        }
+    }
+    result->elapsed_us = time_us_64() - start;
+
+    husb238_get_bus_stats(i2c, &result->bus_stats);
+    result->bus_stats.retries -= before.retries;
+    result->bus_stats.recoveries -= before.recoveries;
+    result->bus_stats.recovery_failures -= before.recovery_failures;
+}
+
+
+static uint32_t soak_errors(soak_result_t const * result) {
+    uint32_t errors = 0;
+    for (int w = 0; w < WORKLOAD_COUNT; ++w) {
+        errors += result->errors[w];
+    }
+    return errors;
+}
+
+
+static void soak_report(soak_result_t const * result) {
+    uint32_t ops = 0;
+    for (int w = 0; w < WORKLOAD_COUNT; ++w) {
+        ops += result->ops[w];
+    }
+    uint32_t errors = soak_errors(result);
+
+    // MTBF is empty when nothing failed.
+    char mtbf[24] = "";
+    if (errors > 0) {
+        snprintf(mtbf, sizeof(mtbf), "%llu", (unsigned long long)(result->elapsed_us / errors / 1000));
+    }
+
+    printf(
+        "soak,%u,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+        result->baudrate,
+        result->gap_us,
+        (unsigned long)result->ops[WORKLOAD_READ],
+        (unsigned long)result->ops[WORKLOAD_SELECT],
+        (unsigned long)result->ops[WORKLOAD_RESET],
+        (unsigned long)errors,
+        (unsigned long)((uint64_t)errors * 1000000 / ops),
+        (unsigned long)result->disconnects,
+        (unsigned long)(result->elapsed_us / 1000),
+        mtbf,
+        (unsigned long)result->bus_stats.retries,
+        (unsigned long)result->bus_stats.recoveries,
+        (unsigned long)result->bus_stats.recovery_failures,
+        (unsigned long)husb238_histogram_percentile_us(&result->latency[WORKLOAD_READ], 500),
+        (unsigned long)husb238_histogram_percentile_us(&result->latency[WORKLOAD_READ], 990),
+        (unsigned long)husb238_histogram_percentile_us(&result->latency[WORKLOAD_SELECT], 500),
+        (unsigned long)husb238_histogram_percentile_us(&result->latency[WORKLOAD_SELECT], 990),
+        (unsigned long)husb238_histogram_percentile_us(&result->latency[WORKLOAD_RESET], 500),
+        (unsigned long)husb238_histogram_percentile_us(&result->latency[WORKLOAD_RESET], 990)
+    );
+
+    for (int w = 0; w < WORKLOAD_COUNT; ++w) {
+        printf("hist,%u,%u,%s", result->baudrate, result->gap_us, workload_names[w]);
+        for (int i = 0; i < HUSB238_HISTOGRAM_BUCKETS; ++i) {
+            printf(",%lu", (unsigned long)result->latency[w].buckets[i]);
+        }
+        printf("\n");
+    }
+}
 
 
 int main() {
@@ -17,7 +226,7 @@ int main() {
 
 
     //
-    // Initialize i2c.
+    // Initialize i2c.  The soak sets the clock rate of each run.
     //
 
     i2c_inst_t * i2c;
@@ -26,9 +235,7 @@ int main() {
     const uint scl_gpio = 17;  // pin 22
 
     i2c = i2c0;
-    uint i2c_freq = 100*1000;  // run i2c at 400 kHz
-
-    i2c_init(i2c, i2c_freq);
+    uint baudrate = i2c_init(i2c, soak_baudrates[0]);
 
     gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
     gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
@@ -36,6 +243,18 @@ int main() {
     gpio_pull_up(sda_gpio);
     gpio_pull_up(scl_gpio);
 
+    // Let the driver retry failed transactions, and clock out the bus if
+    // the HUSB238 is left holding SDA low.
+    husb238_config_t config = {
+        .baudrate = baudrate,
+        .gap_us = HUSB238_DEFAULT_GAP_US,
+        .retries = 2,
+        .bus_recovery = true,
+        .sda_gpio = sda_gpio,
+        .scl_gpio = scl_gpio,
+    };
+    husb238_configure(i2c, &config);
+
 
     // Set GPIO 0 (pin 1) high to indicate i2c error, for the scope to
     // trigger on.
@@ -45,109 +264,50 @@ int main() {
     gpio_set_dir(trigger_gpio, true);
 
 
-    int comm_errors = 0;
-    int passes = 0;
-    int disconnects = 0;
-    bool connected = false;
-
     while (1) {
-        gpio_put(trigger_gpio, false);
         if (!husb238_connected(i2c)) {
             printf("HUSB238 not connected, check I2C wiring and USB-C connection.\n");
-            if (connected) {
-                gpio_put(trigger_gpio, true);
-                disconnects++;
-                comm_errors = 0;
-                passes = 0;
-                sleep_ms(1);
-            }
-            connected = false;
-
-#if 0
-            // This does not reset the HUSB238 out of its crash and disconnect :-(
-            i2c_deinit(i2c);
-            sleep_ms(10);
-            i2c_init(i2c, i2c_freq);
-            sleep_ms(10);
-#endif
-        } else {
-            int r;
+            sleep_ms(1000);
+            continue;
+        }
 
-            // printf("\x1b[2J");  // VT100: clear screen
-            // printf("HUSB238 connected!\n");
+        printf(
+            "soak,baudrate,gap_us,reads,selects,resets,errors,errors_ppm,disconnects,"
+            "elapsed_ms,mtbf_ms,retries,recoveries,recovery_failures,"
+            "read_p50_us,read_p99_us,select_p50_us,select_p99_us,reset_p50_us,reset_p99_us\n"
+        );
+        printf("hist,baudrate,gap_us,workload,buckets...\n");
 
-            connected = true;
-            passes ++;
+        soak_result_t const * best = NULL;
+        for (size_t b = 0; b < sizeof(soak_baudrates) / sizeof(soak_baudrates[0]); ++b) {
+            for (size_t g = 0; g < sizeof(soak_gaps_us) / sizeof(soak_gaps_us[0]); ++g) {
+                static soak_result_t result;
+                static soak_result_t best_result;
 
-#if 0
-            r = husb238_dump_registers(i2c);
-            if (r != PICO_OK) {
-                printf("failed to dump registers\n");
-                comm_errors++;
-                continue;
-            }
-#endif
+                result = {};
+                result.baudrate = soak_baudrates[b];
+                result.gap_us = soak_gaps_us[g];
+                soak_run(i2c, trigger_gpio, &result);
+                soak_report(&result);
 
-#if 1
-            // Get available PDOs.
-            husb238_pdo_t pdos[6];
-            r =  husb238_get_pdos(i2c, pdos);
-            if (r != PICO_OK) {
-                gpio_put(trigger_gpio, true);
-                printf("failed to get PDOs\n");
-                comm_errors++;
-                sleep_ms(1);
-                continue;
-            }
-#if DEBUG
-            printf("available PDOs:\n");
-            for (int i = 0; i < 6; ++i) {
-                if (pdos[i].max_current > 0.0) {
-                    printf("%f V, %04.2fA\n", pdos[i].volts, pdos[i].max_current);
-                } else {
-                    printf("%f V (not available from this USB-PD source)\n", pdos[i].volts);
+                // Faster clocks win, then shorter gaps.
+                if (soak_errors(&result) == 0 && (best == NULL
+                    || result.baudrate > best->baudrate
+                    || (result.baudrate == best->baudrate && result.gap_us < best->gap_us))) {
+                    best_result = result;
+                    best = &best_result;
                 }
-            }
-#endif
-#endif
 
-#if 1
-            // Get current PDO.
-            int current_pdo;
-            r =  husb238_get_current_pdo(i2c, &current_pdo);
-            if (r != PICO_OK) {
-                gpio_put(trigger_gpio, true);
-                printf("failed to get current PDO\n");
-                comm_errors++;
-                sleep_ms(1);
-                continue;
-            }
-#if DEBUG
-            printf("current PDO: 0x%02x\n", current_pdo);
-#endif
-#endif
-
-#if 1
-            // Get current contract.
-            {
-                int volts;
-                float max_current;
-                r =  husb238_get_contract(i2c, volts, max_current);
-                if (r != PICO_OK) {
-                    gpio_put(trigger_gpio, true);
-                    printf("failed to get contract\n");
-                    comm_errors++;
-                    sleep_ms(1);
-                    continue;
-                }
-#if DEBUG
-                printf("current contract: %d V, %.2f max current\n", volts, max_current);
-#endif
+                // Now that the bus is idle, print what the driver logged.
+                husb238_log_flush();
             }
-#endif
         }
 
-        printf("%d disconnects, %d passes and %d comm errors on this connection\n", disconnects, passes, comm_errors);
-        // sleep_ms(100);
+        if (best != NULL) {
+            printf("best,%u,%u\n", best->baudrate, best->gap_us);
+        } else {
+            printf("best,none\n");
+        }
+        printf("\n");
     }
 }
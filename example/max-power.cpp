@@ -0,0 +1,135 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/i2c.h>
+
+#include <pico/stdlib.h>
+
+#include "husb238.h"
+#include "husb238_events.h"
+#include "husb238_flash.h"
+#include "husb238_policy.h"
+#include "husb238_source_cache.h"
+
+
+//
+// Negotiate the most power the source offers at 9 to 20 V and at least
+// 2 A, as soon as a source is attached, preferring 15 V if it's there.
+// Sources seen before are remembered in the last sectors of flash, and
+// asked for the PDO that worked last time straight away.
+//
+
+
+// Set by the first contract after attach, which means the source's
+// PDOs are in; cleared on detach.
+static bool negotiate_pending = false;
+static bool negotiated = false;
+
+
+static void on_detached(void * ctx) {
+    printf("detached\n");
+    negotiate_pending = false;
+    negotiated = false;
+}
+
+
+static void on_contract_changed(void * ctx, uint16_t mv, uint16_t ma) {
+    printf("contract: %u mV %u mA\n", mv, ma);
+    if (!negotiated) {
+        negotiate_pending = true;
+    }
+}
+
+
+int main() {
+    stdio_init_all();
+
+
+    //
+    // Initialize i2c.
+    //
+
+    i2c_inst_t * i2c;
+
+    const uint sda_gpio = 16;  // pin 21
+    const uint scl_gpio = 17;  // pin 22
+
+    i2c = i2c0;
+    uint baudrate = i2c_init(i2c, 400*1000);  // run i2c at 400 kHz
+
+    gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
+
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+
+    husb238_config_t config = {
+        .baudrate = baudrate,
+        .gap_us = HUSB238_DEFAULT_GAP_US
+    };
+    husb238_configure(i2c, &config);
+
+    husb238_policy_t policy = {
+        .min_mv = 9000,
+        .max_mv = 20000,
+        .min_ma = 2000,
+        .preferred_mv = { 15000 },
+        .max_attempts = 3,
+    };
+
+    husb238_flash_t flash;
+    husb238_source_cache_t cache;
+    int r = husb238_flash_pico_init(&flash, HUSB238_FLASH_PICO_SECTORS);
+    if (r == PICO_OK) {
+        r = husb238_source_cache_mount(&cache, &flash);
+    }
+    if (r != PICO_OK) {
+        printf("failed to mount the source cache: %d\n", r);
+        return 1;
+    }
+    printf("source cache: %u sources\n", cache.count);
+
+    husb238_event_callbacks_t callbacks = {
+        .attached = NULL,
+        .detached = on_detached,
+        .contract_changed = on_contract_changed,
+        .negotiation_failed = NULL,
+        .ctx = NULL,
+    };
+    husb238_events_t events;
+    husb238_events_init(&events, i2c, 0, 0, &callbacks);
+
+    while (1) {
+        husb238_events_poll(&events);
+
+        if (negotiate_pending) {
+            negotiate_pending = false;
+            negotiated = true;
+
+            husb238_negotiation_t result;
+            r = husb238_negotiate_cached(i2c, &policy, &cache, &result);
+            if (r != PICO_OK) {
+                printf(
+                    "negotiation failed: %d (%u candidates, %u attempts, last error %d)\n",
+                    r,
+                    result.candidates,
+                    result.attempts,
+                    result.last_error
+                );
+            } else {
+                printf(
+                    "negotiated %u mV %u mA (%lu mW) in %llu us, %u attempts%s\n",
+                    result.pdo.mv,
+                    result.pdo.max_ma,
+                    (unsigned long)husb238_pdo_mw(&result.pdo),
+                    (unsigned long long)result.time_to_contract_us,
+                    result.attempts,
+                    result.cached ? " (cached)" : ""
+                );
+            }
+        }
+
+        sleep_ms(1);
+    }
+}
@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/pio.h>
+
+#include <pico/stdlib.h>
+
+#include "husb238.h"
+#include "husb238_pio_i2c.h"
+
+
+// A HUSB238 on each of six PIO-driven I2C buses (the most there are DMA
+// channels for), three per PIO block: bus i has SDA on GPIO 2*i and SCL
+// on GPIO 2*i + 1.
+#define NUM_BUSES (HUSB238_PIO_I2C_MAX_BUSES)
+#define SWEEP_TIMEOUT_US (5000)
+
+
+int main() {
+    stdio_init_all();
+
+
+    //
+    // Initialize the PIO i2c buses.
+    //
+
+    static husb238_pio_i2c_t buses[NUM_BUSES];
+    husb238_pio_i2c_t * bus_list[NUM_BUSES];
+
+    for (int i = 0; i < NUM_BUSES; ++i) {
+        PIO pio = (i < NUM_BUSES / 2) ? pio0 : pio1;
+        int r = husb238_pio_i2c_init(&buses[i], pio, 2 * i, 100*1000);  // run i2c at 100 kHz
+        if (r != PICO_OK) {
+            printf("failed to set up PIO i2c bus %d: %d\n", i, r);
+            while (1) {
+                sleep_ms(1000);
+            }
+        }
+        bus_list[i] = &buses[i];
+    }
+
+
+    while (1) {
+        husb238_registers_t regs[NUM_BUSES];
+        int results[NUM_BUSES];
+
+        // All buses at once.
+        uint64_t start = time_us_64();
+        husb238_pio_sweep(bus_list, NUM_BUSES, regs, results, SWEEP_TIMEOUT_US);
+        uint64_t sweep_us = time_us_64() - start;
+
+        // The same reads one bus at a time, through the driver.
+        start = time_us_64();
+        for (int i = 0; i < NUM_BUSES; ++i) {
+            husb238_registers_t r;
+            husb238_read_snapshot(husb238_pio_i2c_inst(&buses[i]), &r);
+        }
+        uint64_t serial_us = time_us_64() - start;
+
+        printf("\x1b[2J");  // VT100: clear screen
+        printf("bus  contract\n");
+        for (int i = 0; i < NUM_BUSES; ++i) {
+            printf("%d    ", i);
+            if (results[i] != PICO_OK) {
+                printf("not responding (%d)\n", results[i]);
+                continue;
+            }
+            uint16_t mv, ma;
+            husb238_snapshot_get_contract_mv_ma(&regs[i], &mv, &ma);
+            if (!husb238_attached(regs[i].pd_status1) || mv == 0) {
+                printf("no PD contract\n");
+                continue;
+            }
+            printf("%2u.%02u V %u.%02u A\n", mv / 1000, (mv % 1000) / 10, ma / 1000, (ma % 1000) / 10);
+        }
+
+        printf(
+            "swept %d buses in %llu us, %llu us one at a time\n",
+            NUM_BUSES,
+            (unsigned long long)sweep_us,
+            (unsigned long long)serial_us
+        );
+
+        sleep_ms(1000);
+    }
+}
@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/i2c.h>
+
+#include <pico/stdlib.h>
+
+#include "husb238.h"
+
+
+// A TCA9548A mux at its default address, with a HUSB238 on each of its
+// eight channels.
+#define MUX_ADDR (0x70)
+#define NUM_PORTS (8)
+
+
+int main() {
+    stdio_init_all();
+
+
+    //
+    // Initialize i2c.
+    //
+
+    i2c_inst_t * i2c;
+
+    const uint sda_gpio = 16;  // pin 21
+    const uint scl_gpio = 17;  // pin 22
+
+    i2c = i2c0;
+    uint baudrate = i2c_init(i2c, 400*1000);  // run i2c at 400 kHz
+
+    gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
+
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+
+    husb238_port_t ports[NUM_PORTS];
+    for (int i = 0; i < NUM_PORTS; ++i) {
+        ports[i] = { i2c, MUX_ADDR, (uint8_t)i };
+
+        husb238_config_t config = {
+            .baudrate = baudrate,
+            .gap_us = HUSB238_DEFAULT_GAP_US
+        };
+        husb238_port_select(&ports[i]);
+        husb238_configure(i2c, &config);
+    }
+
+
+    while (1) {
+        husb238_port_status_t status[NUM_PORTS];
+        husb238_scan_stats_t stats;
+
+        husb238_scan(ports, NUM_PORTS, status, &stats);
+
+        printf("\x1b[2J");  // VT100: clear screen
+        printf("port  contract          PDOs\n");
+        for (int i = 0; i < NUM_PORTS; ++i) {
+            husb238_port_status_t const * st = &status[i];
+
+            printf("%d     ", i);
+            if (st->result != PICO_OK) {
+                printf("not responding (%d)\n", st->result);
+                continue;
+            }
+            if (!st->attached || st->mv == 0) {
+                printf("no PD contract\n");
+                continue;
+            }
+            printf("%2u.%02u V %u.%02u A   ", st->mv / 1000, (st->mv % 1000) / 10, st->ma / 1000, (st->ma % 1000) / 10);
+            for (int j = 0; j < 6; ++j) {
+                if (st->pdos[j].max_ma > 0) {
+                    printf(" %uV", st->pdos[j].mv / 1000);
+                }
+            }
+            printf("\n");
+        }
+
+        printf(
+            "swept %lu ports in %llu us, %lu mux switches taking %llu us\n",
+            (unsigned long)stats.ports,
+            (unsigned long long)stats.sweep_us,
+            (unsigned long)stats.mux_switches,
+            (unsigned long long)stats.mux_us
+        );
+
+        sleep_ms(1000);
+    }
+}
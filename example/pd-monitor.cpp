@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/i2c.h>
+
+#include <pico/stdlib.h>
+
+#include "husb238.h"
+#include "husb238_monitor.h"
+
+
+static husb238_monitor_t monitor;
+
+
+static char const * event_name(husb238_event_type_t type) {
+    switch (type) {
+        case HUSB238_EVENT_ATTACHED:         return "attached";
+        case HUSB238_EVENT_DETACHED:         return "detached";
+        case HUSB238_EVENT_CONTRACT_CHANGED: return "contract changed";
+        case HUSB238_EVENT_PDOS_CHANGED:     return "PDOs changed";
+    }
+    return "unknown";
+}
+
+
+int main() {
+    stdio_init_all();
+
+
+    //
+    // Initialize i2c.
+    //
+
+    i2c_inst_t * i2c;
+
+    const uint sda_gpio = 16;  // pin 21
+    const uint scl_gpio = 17;  // pin 22
+
+    i2c = i2c0;
+    uint baudrate = i2c_init(i2c, 400*1000);  // run i2c at 400 kHz
+
+    gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
+
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+
+    husb238_config_t config = {
+        .baudrate = baudrate,
+        .gap_us = HUSB238_DEFAULT_GAP_US
+    };
+    husb238_configure(i2c, &config);
+
+
+    // From here on only core1 touches the HUSB238.
+    husb238_monitor_start(&monitor, i2c);
+
+    uint64_t next_status_us = 0;
+    while (1) {
+        husb238_event_t event;
+        while (husb238_monitor_get_event(&monitor, &event)) {
+            printf(
+                "%10llu us: %s, contract %u mV %u mA\n",
+                (unsigned long long)event.time_us,
+                event_name(event.type),
+                event.mv,
+                event.ma
+            );
+        }
+
+        if (time_us_64() >= next_status_us) {
+            husb238_status_t status;
+            husb238_monitor_get_status(&monitor, &status);
+            printf(
+                "status at %llu us: %s, %s, %u mV %u mA (%lu events dropped)\n",
+                (unsigned long long)status.time_us,
+                status.connected ? "connected" : "not connected",
+                status.attached ? "attached" : "detached",
+                status.mv,
+                status.ma,
+                (unsigned long)monitor.dropped_events.load()
+            );
+            next_status_us = time_us_64() + 1000 * 1000;
+        }
+
+        sleep_ms(1);
+    }
+}
@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/i2c.h>
+
+#include <pico/stdlib.h>
+
+#include "husb238.h"
+#include "husb238_arbiter.h"
+#include "husb238_monitor.h"
+
+
+//
+// Share the HUSB238's bus with an INA219 current sensor that must be
+// sampled every millisecond.  Core1 monitors the HUSB238 as fast as it
+// can, in the background class; core0 samples the INA219 in the
+// critical class, with a window reserved for each sample so that a
+// HUSB238 transaction never runs into it.  Every second, print how late
+// the samples started at worst, and how the bus was shared.
+//
+
+#define INA219_ADDR (0x40)
+#define INA219_REG_SHUNT_VOLTAGE (0x01)
+
+#define SAMPLE_US (1000)
+#define WINDOW_US (200)  // A sample takes about 120 us at 400 kHz.
+
+
+static husb238_arbiter_t arbiter;
+static husb238_monitor_t monitor;
+
+
+// Read the shunt voltage, in units of 10 uV.
+static int ina219_sample(i2c_inst_t * i2c, int16_t * shunt) {
+    uint8_t reg = INA219_REG_SHUNT_VOLTAGE;
+    uint8_t data[2];
+
+    if (i2c_write_timeout_us(i2c, INA219_ADDR, &reg, 1, true, 1000) != 1) {
+        return PICO_ERROR_GENERIC;
+    }
+    if (i2c_read_timeout_us(i2c, INA219_ADDR, data, 2, false, 1000) != 2) {
+        return PICO_ERROR_GENERIC;
+    }
+    *shunt = (int16_t)((data[0] << 8) | data[1]);
+    return PICO_OK;
+}
+
+
+static void print_class(char const * name, husb238_arbiter_class_stats_t const * c) {
+    printf(
+        "  %-10s %6lu acquisitions, %5lu waited (max %lu us), %5lu deferred, hold max %lu us, %lu overruns\n",
+        name,
+        (unsigned long)c->acquisitions,
+        (unsigned long)c->waits,
+        (unsigned long)c->wait_us_max,
+        (unsigned long)c->deferrals,
+        (unsigned long)c->hold_us_max,
+        (unsigned long)c->overruns
+    );
+}
+
+
+int main() {
+    stdio_init_all();
+
+
+    //
+    // Initialize i2c.
+    //
+
+    i2c_inst_t * i2c;
+
+    const uint sda_gpio = 16;  // pin 21
+    const uint scl_gpio = 17;  // pin 22
+
+    i2c = i2c0;
+    uint baudrate = i2c_init(i2c, 400*1000);  // run i2c at 400 kHz
+
+    gpio_set_function(sda_gpio, GPIO_FUNC_I2C);
+    gpio_set_function(scl_gpio, GPIO_FUNC_I2C);
+
+    gpio_pull_up(sda_gpio);
+    gpio_pull_up(scl_gpio);
+
+    // Repeated starts keep the HUSB238's transactions short.
+    husb238_config_t config = {
+        .baudrate = baudrate,
+        .gap_us = HUSB238_DEFAULT_GAP_US,
+        .repeated_start = true,
+    };
+    husb238_configure(i2c, &config);
+
+    husb238_arbiter_init(&arbiter);
+    husb238_set_bus_arbiter(i2c, &arbiter, HUSB238_BUS_PRIORITY_BACKGROUND);
+
+    monitor.interval_us = 1000;
+    husb238_monitor_start(&monitor, i2c);
+
+    uint64_t next_sample = time_us_64() + SAMPLE_US;
+    uint64_t next_report = next_sample + 1000 * 1000;
+    husb238_arbiter_reserve(&arbiter, HUSB238_BUS_PRIORITY_CRITICAL, next_sample, WINDOW_US, SAMPLE_US);
+
+    uint32_t samples = 0;
+    uint32_t errors = 0;
+    uint32_t max_late_us = 0;
+    int16_t shunt = 0;
+
+    while (1) {
+        while (time_us_64() < next_sample) {
+            tight_loop_contents();
+        }
+
+        husb238_arbiter_acquire(&arbiter, HUSB238_BUS_PRIORITY_CRITICAL, WINDOW_US);
+        uint32_t late_us = time_us_64() - next_sample;
+        if (ina219_sample(i2c, &shunt) != PICO_OK) {
+            errors++;
+        }
+        husb238_arbiter_release(&arbiter);
+
+        samples++;
+        if (late_us > max_late_us) {
+            max_late_us = late_us;
+        }
+        next_sample += SAMPLE_US;
+
+        if (next_sample >= next_report) {
+            husb238_arbiter_stats_t stats;
+            husb238_arbiter_get_stats(&arbiter, &stats);
+            husb238_status_t status;
+            husb238_monitor_get_status(&monitor, &status);
+
+            uint64_t elapsed_us = time_us_64() - stats.since_us;
+            printf(
+                "%lu samples (%lu errors, last %d uV), max late %lu us; contract %u mV %u mA; bus %llu%% busy\n",
+                (unsigned long)samples,
+                (unsigned long)errors,
+                shunt * 10,
+                (unsigned long)max_late_us,
+                status.mv,
+                status.ma,
+                (unsigned long long)(elapsed_us ? stats.busy_us * 100 / elapsed_us : 0)
+            );
+            print_class("critical", &stats.classes[HUSB238_BUS_PRIORITY_CRITICAL]);
+            print_class("background", &stats.classes[HUSB238_BUS_PRIORITY_BACKGROUND]);
+
+            husb238_arbiter_clear_stats(&arbiter);
+            samples = 0;
+            errors = 0;
+            max_late_us = 0;
+            next_report += 1000 * 1000;
+        }
+    }
+}
@@ -0,0 +1,160 @@
+#include "pico/async_context_poll.h"
+
+
+bool async_context_poll_init_with_defaults(async_context_poll_t * self) {
+    self->core = {};
+    return true;
+}
+
+
+void async_context_deinit(async_context_t * context) {
+    *context = {};
+}
+
+
+void async_context_acquire_lock_blocking(async_context_t * context) {
+    context->lock_count++;
+}
+
+
+void async_context_release_lock(async_context_t * context) {
+    context->lock_count--;
+}
+
+
+void async_context_lock_check(async_context_t * context) {
+}
+
+
+uint async_context_core_num(async_context_t const * context) {
+    return 0;
+}
+
+
+// The at-time list is kept sorted by next_time, earliest first.
+bool async_context_add_at_time_worker(async_context_t * context, async_at_time_worker_t * worker) {
+    async_context_remove_at_time_worker(context, worker);
+
+    async_at_time_worker_t ** p = &context->at_time_list;
+    while (*p != NULL && (*p)->next_time <= worker->next_time) {
+        p = &(*p)->next;
+    }
+    worker->next = *p;
+    *p = worker;
+    return true;
+}
+
+
+bool async_context_add_at_time_worker_at(async_context_t * context, async_at_time_worker_t * worker, absolute_time_t at) {
+    worker->next_time = at;
+    return async_context_add_at_time_worker(context, worker);
+}
+
+
+bool async_context_add_at_time_worker_in_ms(async_context_t * context, async_at_time_worker_t * worker, uint32_t ms) {
+    return async_context_add_at_time_worker_at(context, worker, make_timeout_time_ms(ms));
+}
+
+
+bool async_context_remove_at_time_worker(async_context_t * context, async_at_time_worker_t * worker) {
+    for (async_at_time_worker_t ** p = &context->at_time_list; *p != NULL; p = &(*p)->next) {
+        if (*p == worker) {
+            *p = worker->next;
+            worker->next = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool async_context_add_when_pending_worker(async_context_t * context, async_when_pending_worker_t * worker) {
+    for (async_when_pending_worker_t * w = context->when_pending_list; w != NULL; w = w->next) {
+        if (w == worker) {
+            return true;
+        }
+    }
+    worker->next = context->when_pending_list;
+    context->when_pending_list = worker;
+    return true;
+}
+
+
+bool async_context_remove_when_pending_worker(async_context_t * context, async_when_pending_worker_t * worker) {
+    for (async_when_pending_worker_t ** p = &context->when_pending_list; *p != NULL; p = &(*p)->next) {
+        if (*p == worker) {
+            *p = worker->next;
+            worker->next = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void async_context_set_work_pending(async_context_t * context, async_when_pending_worker_t * worker) {
+    worker->work_pending = true;
+}
+
+
+// Run everything that's due.  Workers are taken off the list before
+// they run, so they may add themselves back.
+void async_context_poll(async_context_t * context) {
+    async_context_acquire_lock_blocking(context);
+
+    for (async_when_pending_worker_t * w = context->when_pending_list; w != NULL; w = w->next) {
+        if (w->work_pending) {
+            w->work_pending = false;
+            w->do_work(context, w);
+        }
+    }
+
+    // Only the workers due on entry run, so one that adds itself back
+    // for right away runs on the next poll, not in an endless loop.
+    async_at_time_worker_t * due = NULL;
+    async_at_time_worker_t ** tail = &due;
+    absolute_time_t now = get_absolute_time();
+    while (context->at_time_list != NULL && context->at_time_list->next_time <= now) {
+        *tail = context->at_time_list;
+        context->at_time_list = (*tail)->next;
+        tail = &(*tail)->next;
+    }
+    *tail = NULL;
+
+    while (due != NULL) {
+        async_at_time_worker_t * worker = due;
+        due = worker->next;
+        worker->next = NULL;
+        worker->do_work(context, worker);
+    }
+
+    async_context_release_lock(context);
+}
+
+
+void async_context_wait_until(async_context_t * context, absolute_time_t until) {
+    absolute_time_t now = get_absolute_time();
+    if (until > now) {
+        sleep_us(until - now);
+    }
+}
+
+
+// Sleep until `until`, or until the next at-time worker is due if
+// that's sooner.  Pending work means there's no waiting at all.
+void async_context_wait_for_work_until(async_context_t * context, absolute_time_t until) {
+    for (async_when_pending_worker_t * w = context->when_pending_list; w != NULL; w = w->next) {
+        if (w->work_pending) {
+            return;
+        }
+    }
+    if (context->at_time_list != NULL && context->at_time_list->next_time < until) {
+        until = context->at_time_list->next_time;
+    }
+    async_context_wait_until(context, until);
+}
+
+
+void async_context_wait_for_work_ms(async_context_t * context, uint32_t ms) {
+    async_context_wait_for_work_until(context, make_timeout_time_ms(ms));
+}
@@ -0,0 +1,110 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/i2c.h>
+
+#include <pico/stdlib.h>
+
+#include "husb238.h"
+#include "husb238_events.h"
+#include "husb238_sim.h"
+
+
+//
+// The event engine against the simulated HUSB238, through a source
+// attach and PDO changes that leave PD_STATUS1 as it was.  Each step
+// checks that the callbacks reported the contract the simulated chip
+// ended up with, in time.  Exits with status 1 if any check fails.
+//
+
+
+static husb238_sim sim;
+
+static struct {
+    uint32_t attached;
+    uint32_t contract_changes;
+    uint16_t mv;
+} seen;
+
+static uint32_t failures = 0;
+
+
+static void on_attached(void * ctx, husb238_registers_t const * regs) {
+    seen.attached++;
+}
+
+static void on_contract_changed(void * ctx, uint16_t mv, uint16_t ma) {
+    seen.contract_changes++;
+    seen.mv = mv;
+}
+
+
+// Poll the engine every millisecond for `ms`.
+static void run(husb238_events_t * ev, uint32_t ms) {
+    for (uint32_t i = 0; i < ms; ++i) {
+        husb238_events_poll(ev);
+        sleep_ms(1);
+    }
+}
+
+
+static void check(char const * step, bool ok) {
+    printf("%-50s %s\n", step, ok ? "ok" : "FAILED");
+    if (!ok) {
+        failures++;
+    }
+}
+
+
+// The contract the simulated chip has, from PD_STATUS0.
+static uint16_t sim_mv(void) {
+    return husb238_decode_pd_status0(sim.regs[HUSB238_I2C_REG_PD_STATUS0]).mv;
+}
+
+
+int main() {
+    int const caps[6] = { 10, 10, 10, 10, -1, 10 };
+    sim.set_source_caps(caps);
+    host_i2c_attach(i2c0, 0x08, &sim);
+    i2c_init(i2c0, 400 * 1000);
+
+    husb238_event_callbacks_t callbacks = {
+        .attached = on_attached,
+        .contract_changed = on_contract_changed,
+    };
+    husb238_events_t ev;
+    husb238_events_init(&ev, i2c0, 0, 0, &callbacks);
+
+    sim.attach();
+    run(&ev, 500);
+    check("attach reports 5 V", seen.attached == 1 && seen.mv == 5000 && ev.mv == 5000);
+
+    // SELECT_PDO while the engine polls: PD_RESPONSE reads NONE for a
+    // poll or so, and SUCCESS before and after.
+    uint32_t changes = seen.contract_changes;
+    husb238_select_t op = {};
+    husb238_select_pdo_begin(i2c0, &op, HUSB238_SRC_PDO_9V);
+    for (int i = 0; i < 100 && op.busy; ++i) {
+        husb238_events_poll(&ev);
+        sleep_ms(1);
+        husb238_poll(i2c0, &op);
+    }
+    run(&ev, 100);
+    check("SELECT_PDO seen by a poll reports 9 V", sim_mv() == 9000 && seen.mv == 9000 && seen.contract_changes == changes + 1);
+
+    // SELECT_PDO entirely between two polls.
+    changes = seen.contract_changes;
+    husb238_select_pdo(i2c0, HUSB238_SRC_PDO_20V);
+    run(&ev, HUSB238_EVENTS_CONTRACT_CHECK_US / 1000 + 100);
+    check("SELECT_PDO between polls reports 20 V", sim_mv() == 20000 && seen.mv == 20000 && seen.contract_changes == changes + 1);
+
+    // Back to the PDO the engine last saw, with nothing in between.
+    changes = seen.contract_changes;
+    husb238_select_pdo(i2c0, HUSB238_SRC_PDO_20V);
+    run(&ev, HUSB238_EVENTS_CONTRACT_CHECK_US / 1000 + 100);
+    check("reselecting 20 V reports nothing", seen.mv == 20000 && seen.contract_changes == changes);
+
+    printf("%lu polls, %lu full reads, %lu contract checks\n", (unsigned long)ev.polls, (unsigned long)ev.fetches, (unsigned long)ev.contract_checks);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,334 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <hardware/i2c.h>
+
+#include <pico/stdlib.h>
+
+#include "host_i2c.h"
+#include "husb238.h"
+
+
+//
+// Bus traffic and simulated latency of each driver call, at 100 kHz,
+// 400 kHz and 1 MHz, against the simulated HUSB238 on i2c0.
+//
+//     husb238-host-bench                  print the results as CSV
+//     husb238-host-bench --write FILE     save them as the baseline
+//     husb238-host-bench --check FILE     compare with the baseline
+//
+// With --check, exits with status 1 if any call makes more transfers,
+// moves more bytes, keeps the bus busy longer or takes longer than its
+// baseline.  Time is simulated, so the results are exact and the same
+// on every machine.
+//
+
+
+#define ITERATIONS (100)
+#define SLOW_ITERATIONS (4)
+
+// Slack for the averaged figures, in parts per thousand.
+#define TOLERANCE_PERMILLE (5)
+
+
+typedef int (*bench_fn_t)(i2c_inst_t * i2c);
+
+static int bench_connected(i2c_inst_t * i2c) {
+    return husb238_connected(i2c) ? PICO_OK : PICO_ERROR_IO;
+}
+
+static int bench_read_register(i2c_inst_t * i2c) {
+    uint8_t val;
+    return husb238_read_register(i2c, HUSB238_I2C_REG_PD_STATUS1, &val);
+}
+
+static int bench_read_snapshot(i2c_inst_t * i2c) {
+    husb238_registers_t regs;
+    return husb238_read_snapshot(i2c, &regs);
+}
+
+static int bench_get_pdos(i2c_inst_t * i2c) {
+    husb238_pdo_t pdos[6];
+    return husb238_get_pdos(i2c, pdos);
+}
+
+static int bench_get_pdos_fixed(i2c_inst_t * i2c) {
+    husb238_pdo_fixed_t pdos[6];
+    return husb238_get_pdos_fixed(i2c, pdos);
+}
+
+static int bench_get_current_pdo(i2c_inst_t * i2c) {
+    int pdo;
+    return husb238_get_current_pdo(i2c, &pdo);
+}
+
+static int bench_get_contract(i2c_inst_t * i2c) {
+    int volts;
+    float max_current;
+    return husb238_get_contract(i2c, volts, max_current);
+}
+
+static int bench_get_contract_mv_ma(i2c_inst_t * i2c) {
+    uint16_t mv, ma;
+    return husb238_get_contract_mv_ma(i2c, &mv, &ma);
+}
+
+static int bench_select_pdo(i2c_inst_t * i2c) {
+    return husb238_select_pdo(i2c, HUSB238_SRC_PDO_9V);
+}
+
+static int bench_reset(i2c_inst_t * i2c) {
+    return husb238_reset(i2c);
+}
+
+
+static struct {
+    char const * name;
+    bench_fn_t fn;
+    uint iterations;
+} const benches[] = {
+    { "connected",          bench_connected,          ITERATIONS },
+    { "read_register",      bench_read_register,      ITERATIONS },
+    { "read_snapshot",      bench_read_snapshot,      ITERATIONS },
+    { "get_pdos",           bench_get_pdos,           ITERATIONS },
+    { "get_pdos_fixed",     bench_get_pdos_fixed,     ITERATIONS },
+    { "get_current_pdo",    bench_get_current_pdo,    ITERATIONS },
+    { "get_contract",       bench_get_contract,       ITERATIONS },
+    { "get_contract_mv_ma", bench_get_contract_mv_ma, ITERATIONS },
+    { "select_pdo",         bench_select_pdo,         SLOW_ITERATIONS },
+    { "reset",              bench_reset,              SLOW_ITERATIONS },
+};
+
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static uint const baudrates[] = { 100 * 1000, 400 * 1000, 1000 * 1000 };
+
+#define NUM_BAUDRATES (sizeof(baudrates) / sizeof(baudrates[0]))
+
+
+// Per-call averages, in hundredths so they compare exactly.
+typedef struct {
+    uint baudrate;
+    char name[32];
+    uint64_t transfers;
+    uint64_t bytes;
+    uint64_t bus_us;
+    uint64_t latency_us;
+    uint32_t errors;
+} result_t;
+
+#define NUM_RESULTS (NUM_BENCHES * NUM_BAUDRATES)
+
+
+static void run_bench(i2c_inst_t * i2c, size_t index, result_t * result) {
+    uint iterations = benches[index].iterations;
+    host_i2c_stats_t stats;
+
+    host_i2c_reset_stats(i2c);
+    uint64_t start = time_us_64();
+    for (uint i = 0; i < iterations; ++i) {
+        if (benches[index].fn(i2c) != PICO_OK) {
+            result->errors++;
+        }
+    }
+    uint64_t elapsed_us = time_us_64() - start;
+    host_i2c_get_stats(i2c, &stats);
+
+    strncpy(result->name, benches[index].name, sizeof(result->name) - 1);
+    result->transfers = stats.transfers * 100 / iterations;
+    result->bytes = stats.bytes * 100 / iterations;
+    result->bus_us = stats.busy_us * 100 / iterations;
+    result->latency_us = elapsed_us * 100 / iterations;
+}
+
+
+static void print_result(FILE * f, result_t const * r) {
+    fprintf(
+        f, "%u,%s,%llu.%02llu,%llu.%02llu,%llu.%02llu,%llu.%02llu\n",
+        r->baudrate, r->name,
+        (unsigned long long)r->transfers / 100, (unsigned long long)r->transfers % 100,
+        (unsigned long long)r->bytes / 100, (unsigned long long)r->bytes % 100,
+        (unsigned long long)r->bus_us / 100, (unsigned long long)r->bus_us % 100,
+        (unsigned long long)r->latency_us / 100, (unsigned long long)r->latency_us % 100
+    );
+}
+
+
+static char const header[] = "baudrate,call,transfers,bytes,bus_us,latency_us";
+
+
+// Parse one hundredths value, "123.45".
+static bool parse_fixed(char const ** p, uint64_t * val) {
+    char * end;
+    unsigned long long whole = strtoull(*p, &end, 10);
+    if (end == *p || *end != '.') return false;
+    char const * frac = end + 1;
+    unsigned long long hundredths = strtoull(frac, &end, 10);
+    if (end != frac + 2) return false;
+    *val = whole * 100 + hundredths;
+    *p = (*end == ',') ? end + 1 : end;
+    return true;
+}
+
+
+static int load_baseline(char const * path, result_t * baseline, size_t max) {
+    FILE * f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    char line[256];
+    size_t n = 0;
+    while (fgets(line, sizeof(line), f) != NULL && n < max) {
+        result_t * r = &baseline[n];
+        char const * p = line;
+        char * end;
+
+        *r = {};
+        r->baudrate = strtoul(p, &end, 10);
+        if (end == p || *end != ',') continue;  // The header, or junk.
+        p = end + 1;
+        char const * comma = strchr(p, ',');
+        if (comma == NULL || (size_t)(comma - p) >= sizeof(r->name)) continue;
+        memcpy(r->name, p, comma - p);
+        p = comma + 1;
+        if (!parse_fixed(&p, &r->transfers) || !parse_fixed(&p, &r->bytes)
+            || !parse_fixed(&p, &r->bus_us) || !parse_fixed(&p, &r->latency_us)) {
+            fprintf(stderr, "%s: can't parse: %s", path, line);
+            continue;
+        }
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+
+static bool regressed(uint64_t now, uint64_t then) {
+    return now * 1000 > then * (1000 + TOLERANCE_PERMILLE);
+}
+
+
+static bool improved(uint64_t now, uint64_t then) {
+    return now * (1000 + TOLERANCE_PERMILLE) < then * 1000;
+}
+
+
+// Compare `results` with `baseline`, report every difference, and
+// return the number of regressions.
+static int check(result_t const * results, size_t n, result_t const * baseline, size_t n_baseline) {
+    int regressions = 0;
+    int improvements = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        result_t const * r = &results[i];
+        result_t const * b = NULL;
+        for (size_t j = 0; j < n_baseline; ++j) {
+            if (baseline[j].baudrate == r->baudrate && strcmp(baseline[j].name, r->name) == 0) {
+                b = &baseline[j];
+                break;
+            }
+        }
+        if (b == NULL) {
+            printf("new:       %u %s\n", r->baudrate, r->name);
+            continue;
+        }
+
+        struct { char const * what; uint64_t now, then; } const metrics[] = {
+            { "transfers",  r->transfers,  b->transfers },
+            { "bytes",      r->bytes,      b->bytes },
+            { "bus_us",     r->bus_us,     b->bus_us },
+            { "latency_us", r->latency_us, b->latency_us },
+        };
+        for (auto const & m : metrics) {
+            char const * verdict = NULL;
+            if (regressed(m.now, m.then)) {
+                verdict = "REGRESSED";
+                regressions++;
+            } else if (improved(m.now, m.then)) {
+                verdict = "improved ";
+                improvements++;
+            }
+            if (verdict != NULL) {
+                printf(
+                    "%s: %u %s %s %llu.%02llu -> %llu.%02llu\n",
+                    verdict, r->baudrate, r->name, m.what,
+                    (unsigned long long)m.then / 100, (unsigned long long)m.then % 100,
+                    (unsigned long long)m.now / 100, (unsigned long long)m.now % 100
+                );
+            }
+        }
+    }
+
+    printf("%d regressions, %d improvements\n", regressions, improvements);
+    if (regressions == 0 && improvements > 0) {
+        printf("update the baseline with --write to lock in the improvements\n");
+    }
+    return regressions;
+}
+
+
+int main(int argc, char ** argv) {
+    char const * write_path = NULL;
+    char const * check_path = NULL;
+
+    if (argc == 3 && strcmp(argv[1], "--write") == 0) {
+        write_path = argv[2];
+    } else if (argc == 3 && strcmp(argv[1], "--check") == 0) {
+        check_path = argv[2];
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: %s [--write FILE | --check FILE]\n", argv[0]);
+        return 2;
+    }
+
+    i2c_inst_t * i2c = i2c0;
+    static result_t results[NUM_RESULTS];
+    size_t n = 0;
+    uint32_t errors = 0;
+
+    for (size_t b = 0; b < NUM_BAUDRATES; ++b) {
+        husb238_config_t config = {
+            .baudrate = i2c_init(i2c, baudrates[b]),
+            .gap_us = HUSB238_DEFAULT_GAP_US
+        };
+        husb238_configure(i2c, &config);
+
+        for (size_t i = 0; i < NUM_BENCHES; ++i) {
+            result_t * r = &results[n++];
+            r->baudrate = baudrates[b];
+            run_bench(i2c, i, r);
+            if (r->errors != 0) {
+                fprintf(stderr, "%u %s: %lu calls failed\n", r->baudrate, r->name, (unsigned long)r->errors);
+                errors += r->errors;
+            }
+        }
+    }
+
+    if (check_path != NULL) {
+        static result_t baseline[NUM_RESULTS * 2];
+        int n_baseline = load_baseline(check_path, baseline, NUM_RESULTS * 2);
+        if (n_baseline < 0) {
+            return 2;
+        }
+        return (check(results, n, baseline, n_baseline) == 0 && errors == 0) ? 0 : 1;
+    }
+
+    FILE * f = stdout;
+    if (write_path != NULL) {
+        f = fopen(write_path, "w");
+        if (f == NULL) {
+            perror(write_path);
+            return 2;
+        }
+    }
+    fprintf(f, "%s\n", header);
+    for (size_t i = 0; i < n; ++i) {
+        print_result(f, &results[i]);
+    }
+    if (f != stdout) {
+        fclose(f);
+    }
+    return errors == 0 ? 0 : 1;
+}
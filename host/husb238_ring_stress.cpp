@@ -0,0 +1,166 @@
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+
+#include "husb238_monitor.h"
+
+
+//
+// The monitor's event ring and status seqlock, between two real
+// threads: one publishes as the monitor core does, the other consumes
+// as the application core does.
+//
+//     husb238-ring-stress [EVENTS]
+//
+// Checks that events arrive in order and intact, that the drop count
+// accounts for exactly the events that didn't arrive, and that no
+// status read is torn.  Exits with status 1 if any check fails.
+//
+
+
+#define EVENTS (2 * 1000 * 1000)
+
+
+static husb238_monitor_t monitor;
+static std::atomic<bool> producer_done{false};
+
+
+// Fill every field from `n`, so that a mix of two values shows.  The
+// padding is zeroed too, as the checks compare whole structs.
+static void make_event(husb238_event_t * event, uint64_t n) {
+    memset(event, 0, sizeof(*event));
+    event->type = (husb238_event_type_t)(n % 4);
+    event->time_us = n;
+    event->mv = (uint16_t)n;
+    event->ma = (uint16_t)~n;
+    memset(event->src_pdos, (uint8_t)n, sizeof(event->src_pdos));
+}
+
+static void make_status(husb238_status_t * status, uint64_t n) {
+    memset(status, 0, sizeof(*status));
+    status->time_us = n;
+    status->connected = n & 1;
+    status->attached = n & 2;
+    status->mv = (uint16_t)n;
+    status->ma = (uint16_t)~n;
+    status->current_pdo = (int)(n & 0x7fffffff);
+    memset(&status->regs, (uint8_t)n, sizeof(status->regs));
+}
+
+
+static void producer(uint64_t events) {
+    for (uint64_t n = 1; n <= events; ++n) {
+        husb238_event_t event;
+        make_event(&event, n);
+        if (!monitor.events.push(event)) {
+            monitor.dropped_events.store(monitor.dropped_events.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        husb238_status_t status;
+        make_status(&status, n);
+        monitor.status.write(status);
+
+        // Publish in bursts of about half the ring, so that most events
+        // get through but the ring still overflows.
+        if (n % (HUSB238_MONITOR_EVENTS / 2) == 0) {
+            std::this_thread::yield();
+        }
+    }
+    producer_done.store(true, std::memory_order_release);
+}
+
+
+int main(int argc, char ** argv) {
+    uint64_t events = argc > 1 ? strtoull(argv[1], NULL, 0) : EVENTS;
+
+    uint64_t received = 0;
+    uint64_t missing = 0;
+    uint64_t out_of_order = 0;
+    uint64_t corrupt = 0;
+    uint64_t status_reads = 0;
+    uint64_t torn = 0;
+    uint64_t status_backwards = 0;
+    uint64_t last_event = 0;
+    uint64_t last_status = 0;
+
+    std::thread thread(producer, events);
+
+    bool done = false;
+    while (!done) {
+        // Only stop once the ring has been drained after the producer
+        // finished.
+        done = producer_done.load(std::memory_order_acquire);
+
+        // Stop taking events now and then, so the ring fills up.
+        bool stalled = !done && status_reads % 64 < 4;
+
+        husb238_event_t event;
+        while (!stalled && husb238_monitor_get_event(&monitor, &event)) {
+            husb238_event_t expected;
+            make_event(&expected, event.time_us);
+            if (memcmp(&event, &expected, sizeof(event)) != 0) {
+                corrupt++;
+            }
+            if (event.time_us <= last_event) {
+                out_of_order++;
+            } else {
+                missing += event.time_us - last_event - 1;
+            }
+            last_event = event.time_us;
+            received++;
+        }
+
+        husb238_status_t status;
+        husb238_monitor_get_status(&monitor, &status);
+        husb238_status_t expected;
+        make_status(&expected, status.time_us);
+        // time_us 0 is the status before the first write.
+        if (status.time_us != 0 && memcmp(&status, &expected, sizeof(status)) != 0) {
+            torn++;
+        }
+        if (status.time_us < last_status) {
+            status_backwards++;
+        }
+        last_status = status.time_us;
+        status_reads++;
+
+        std::this_thread::yield();
+    }
+    thread.join();
+    missing += events - last_event;
+
+    uint32_t dropped = monitor.dropped_events.load(std::memory_order_relaxed);
+    printf(
+        "%llu events: %llu received, %lu dropped, %llu missing, %llu out of order, %llu corrupt\n",
+        (unsigned long long)events,
+        (unsigned long long)received,
+        (unsigned long)dropped,
+        (unsigned long long)missing,
+        (unsigned long long)out_of_order,
+        (unsigned long long)corrupt
+    );
+    printf(
+        "%llu status reads: %llu torn, %llu went backwards; %lu writes\n",
+        (unsigned long long)status_reads,
+        (unsigned long long)torn,
+        (unsigned long long)status_backwards,
+        (unsigned long)monitor.status.writes()
+    );
+
+    bool ok = out_of_order == 0
+        && corrupt == 0
+        && missing == dropped
+        && received + dropped == events
+        && torn == 0
+        && status_backwards == 0
+        && last_status == events
+        && monitor.status.writes() == (uint32_t)events;
+    if (!ok) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+#include <string.h>
+
+#include "husb238_sim.h"
+
+
+#define REG_PD_STATUS0  (0x00)
+#define REG_PD_STATUS1  (0x01)
+#define REG_SRC_PDO_5V  (0x02)
+#define REG_SRC_PDO     (0x08)
+#define REG_GO_COMMAND  (0x09)
+
+#define CMD_SELECT_PDO  (0x01)
+#define CMD_GET_SRC_CAP (0x04)
+#define CMD_HARD_RESET  (0x10)
+
+#define PD_STATUS1_CC_DIR      (0x80)
+#define PD_STATUS1_ATTACH      (0x40)
+#define PD_STATUS1_PD_RESPONSE (0x38)
+#define PD_STATUS1_5V_VOLTAGE  (0x04)
+#define PD_STATUS1_5V_3A       (0x03)
+
+#define PD_RESPONSE_NONE             (0)
+#define PD_RESPONSE_SUCCESS          (1)
+#define PD_RESPONSE_INVALID          (3)
+#define PD_RESPONSE_TRANSACTION_FAIL (5)
+
+
+// SRC_PDO select code (upper nibble of the SRC_PDO register) for each
+// of the six PDOs, in SRC_PDO_5V..SRC_PDO_20V order.
+static uint8_t const pdo_select_code[6] = { 0x1, 0x2, 0x3, 0x8, 0x9, 0xa };
+
+
+husb238_sim::husb238_sim() {
+    memset(regs, 0, sizeof(regs));
+    for (int i = 0; i < 6; ++i) {
+        source_caps[i] = -1;
+    }
+}
+
+
+void husb238_sim::set_source_caps(int const caps[6]) {
+    for (int i = 0; i < 6; ++i) {
+        source_caps[i] = caps[i];
+    }
+}
+
+
+void husb238_sim::attach(bool cc2) {
+    update();
+    is_attached = true;
+    this->cc2 = cc2;
+    memset(regs, 0, sizeof(regs));
+    regs[REG_PD_STATUS1] = PD_STATUS1_ATTACH | (cc2 ? PD_STATUS1_CC_DIR : 0) | PD_STATUS1_5V_VOLTAGE | PD_STATUS1_5V_3A;
+    pending = PENDING_ATTACH;
+    pending_done_us = time_us_64() + attach_us;
+}
+
+
+void husb238_sim::detach(void) {
+    update();
+    is_attached = false;
+    memset(regs, 0, sizeof(regs));
+    pending = PENDING_NONE;
+}
+
+
+bool husb238_sim::on_bus(void) const {
+    if (!vbus_powered) {
+        return true;
+    }
+    return is_attached && !(pending == PENDING_HARD_RESET && time_us_64() >= vbus_off_us);
+}
+
+
+bool husb238_sim::too_soon(bool nostop) {
+    uint64_t now = time_us_64();
+    bool r = !restart && last_transfer_us != 0 && now - last_transfer_us < min_transfer_interval_us;
+    last_transfer_us = now;
+    restart = nostop && !r;
+    return r;
+}
+
+
+void husb238_sim::set_pd_response(uint8_t response) {
+    regs[REG_PD_STATUS1] = (regs[REG_PD_STATUS1] & ~PD_STATUS1_PD_RESPONSE) | (response << 3);
+}
+
+
+// Establish a contract for PDO `pdo_index` (0 = 5V .. 5 = 20V).
+void husb238_sim::set_contract(int pdo_index) {
+    uint8_t current = regs[REG_SRC_PDO_5V + pdo_index] & 0x0f;
+    regs[REG_PD_STATUS0] = ((pdo_index + 1) << 4) | current;
+}
+
+
+void husb238_sim::publish_source_caps(void) {
+    for (int i = 0; i < 6; ++i) {
+        if (source_caps[i] < 0) {
+            regs[REG_SRC_PDO_5V + i] = 0x00;
+        } else {
+            regs[REG_SRC_PDO_5V + i] = 0x80 | (source_caps[i] & 0x0f);
+        }
+    }
+}
+
+
+// Complete the pending command, if its time has come.
+void husb238_sim::update(void) {
+    if (pending == PENDING_HARD_RESET && !vbus_powered && time_us_64() >= vbus_off_us) {
+        // Still powered, but the source is gone for now.
+        regs[REG_PD_STATUS0] = 0;
+        regs[REG_PD_STATUS1] &= ~PD_STATUS1_ATTACH;
+    }
+    if (pending == PENDING_NONE || time_us_64() < pending_done_us) {
+        return;
+    }
+
+    pending_t done = pending;
+    pending = PENDING_NONE;
+
+    switch (done) {
+        case PENDING_ATTACH:
+            publish_source_caps();
+            set_contract(0);
+            break;
+
+        case PENDING_HARD_RESET:
+            memset(regs, 0, sizeof(regs));
+            if (is_attached) {
+                regs[REG_PD_STATUS1] = PD_STATUS1_ATTACH | (cc2 ? PD_STATUS1_CC_DIR : 0) | PD_STATUS1_5V_VOLTAGE | PD_STATUS1_5V_3A;
+                publish_source_caps();
+                set_contract(0);
+            }
+            break;
+
+        case PENDING_GET_SRC_CAP:
+            publish_source_caps();
+            set_pd_response(PD_RESPONSE_SUCCESS);
+            break;
+
+        case PENDING_SELECT_PDO: {
+            int index = -1;
+            for (int i = 0; i < 6; ++i) {
+                if (pdo_select_code[i] == (regs[REG_SRC_PDO] >> 4)) {
+                    index = i;
+                }
+            }
+            if (index < 0 || !(regs[REG_SRC_PDO_5V + index] & 0x80)) {
+                set_pd_response(PD_RESPONSE_INVALID);
+            } else if (refused_pdos & (1 << index)) {
+                set_pd_response(PD_RESPONSE_TRANSACTION_FAIL);
+            } else {
+                set_contract(index);
+                set_pd_response(PD_RESPONSE_SUCCESS);
+            }
+            break;
+        }
+
+        case PENDING_NONE:
+            break;
+    }
+}
+
+
+void husb238_sim::go_command(uint8_t cmd) {
+    commands++;
+
+    switch (cmd & 0x1f) {
+        case CMD_SELECT_PDO:
+            set_pd_response(PD_RESPONSE_NONE);
+            if (!is_attached || pending == PENDING_ATTACH) {
+                set_pd_response(PD_RESPONSE_TRANSACTION_FAIL);
+                return;
+            }
+            pending = PENDING_SELECT_PDO;
+            pending_done_us = time_us_64() + select_pdo_us;
+            break;
+
+        case CMD_GET_SRC_CAP:
+            set_pd_response(PD_RESPONSE_NONE);
+            if (!is_attached || pending == PENDING_ATTACH) {
+                set_pd_response(PD_RESPONSE_TRANSACTION_FAIL);
+                return;
+            }
+            pending = PENDING_GET_SRC_CAP;
+            pending_done_us = time_us_64() + get_src_cap_us;
+            break;
+
+        case CMD_HARD_RESET:
+            pending = PENDING_HARD_RESET;
+            vbus_off_us = time_us_64() + hard_reset_drop_us;
+            pending_done_us = time_us_64() + hard_reset_us;
+            break;
+
+        default:
+            set_pd_response(PD_RESPONSE_INVALID);
+            break;
+    }
+}
+
+
+int husb238_sim::write(uint8_t const * src, size_t len, bool nostop) {
+    update();
+    if (!on_bus() || too_soon(nostop)) {
+        return PICO_ERROR_GENERIC;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    pointer = src[0];
+    for (size_t i = 1; i < len; ++i) {
+        if (pointer == REG_SRC_PDO) {
+            regs[REG_SRC_PDO] = src[i] & 0xf0;
+        } else if (pointer == REG_GO_COMMAND) {
+            go_command(src[i]);
+        }
+        // Everything else is read-only, writes are Acked and ignored.
+        pointer++;
+    }
+    return len;
+}
+
+
+int husb238_sim::read(uint8_t * dst, size_t len, bool nostop) {
+    update();
+    if (!on_bus() || too_soon(nostop)) {
+        return PICO_ERROR_GENERIC;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = pointer < sizeof(regs) ? regs[pointer] : 0x00;
+        pointer++;
+    }
+    return len;
+}
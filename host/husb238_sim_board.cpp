@@ -0,0 +1,23 @@
+#include "husb238_sim.h"
+#include "ina219_sim.h"
+
+
+//
+// The board the example programs see when built for the host: a
+// HUSB238 on i2c0 at address 0x08, attached to a 60 W USB-PD source
+// offering 5, 9, 12, 15 and 20 V at 3 A, sharing the bus with an
+// INA219 current sensor at 0x40.
+//
+
+static husb238_sim husb238_sim_board_i2c0;
+static ina219_sim ina219_sim_board_i2c0;
+
+static struct husb238_sim_board {
+    husb238_sim_board() {
+        int const caps[6] = { 10, 10, 10, 10, -1, 10 };
+        husb238_sim_board_i2c0.set_source_caps(caps);
+        host_i2c_attach(i2c0, 0x08, &husb238_sim_board_i2c0);
+        husb238_sim_board_i2c0.attach();
+        host_i2c_attach(i2c0, 0x40, &ina219_sim_board_i2c0);
+    }
+} husb238_sim_board;
@@ -0,0 +1,29 @@
+#include "husb238_sim.h"
+#include "tca9548a_sim.h"
+
+
+//
+// The board multi-port-scan sees when built for the host: a TCA9548A
+// at 0x70 on i2c0, with a HUSB238 on each of its eight channels.  Odd
+// channels have a 45 W source (5/9/15 V at 3 A) plugged in, even
+// channels a 100 W source (5-20 V at 5 A), and channel 6 nothing.
+//
+
+static tca9548a_sim mux;
+static husb238_sim husb238s[8];
+
+static struct husb238_sim_mux_board {
+    husb238_sim_mux_board() {
+        int const caps_45w[6] = { 10, 10, -1, 10, -1, -1 };
+        int const caps_100w[6] = { 10, 10, 10, 15, -1, 15 };
+
+        host_i2c_attach_bridge(i2c0, 0x70, &mux);
+        for (int i = 0; i < 8; ++i) {
+            husb238s[i].set_source_caps(i % 2 ? caps_45w : caps_100w);
+            mux.attach(i, 0x08, &husb238s[i]);
+            if (i != 6) {
+                husb238s[i].attach();
+            }
+        }
+    }
+} husb238_sim_mux_board;
@@ -0,0 +1,35 @@
+#include "ina219_sim.h"
+
+
+ina219_sim::ina219_sim() {
+    regs[0] = 0x399f;  // CONFIG at power-on.
+    regs[1] = 1000;    // SHUNT_VOLTAGE: 10 mV.
+    regs[2] = 0x5d98;  // BUS_VOLTAGE: 12 V, conversion ready.
+    regs[3] = 0;
+    regs[4] = 0;
+    regs[5] = 0;
+}
+
+
+int ina219_sim::write(uint8_t const * src, size_t len, bool nostop) {
+    if (len == 0) {
+        return 0;
+    }
+    if (src[0] > 5) {
+        return PICO_ERROR_GENERIC;
+    }
+    pointer = src[0];
+    if (len >= 3) {
+        regs[pointer] = (src[1] << 8) | src[2];
+    }
+    return len;
+}
+
+
+int ina219_sim::read(uint8_t * dst, size_t len, bool nostop) {
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = i % 2 == 0 ? regs[pointer] >> 8 : regs[pointer] & 0xff;
+    }
+    reads++;
+    return len;
+}
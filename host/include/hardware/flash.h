@@ -0,0 +1,26 @@
+#ifndef _HARDWARE_FLASH_H
+#define _HARDWARE_FLASH_H
+
+//
+// Host stand-in for the Pico SDK "hardware/flash.h".  The flash is an
+// in-memory image, mapped at XIP_BASE, which starts out erased.  Like
+// NOR flash, programming can only clear bits.
+//
+
+#include "pico/types.h"
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#endif
+
+extern uint8_t host_flash_image[PICO_FLASH_SIZE_BYTES];
+
+#define XIP_BASE ((uintptr_t)host_flash_image)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t * data, size_t count);
+
+#endif // _HARDWARE_FLASH_H
@@ -0,0 +1,34 @@
+#ifndef _HARDWARE_I2C_H
+#define _HARDWARE_I2C_H
+
+//
+// Host stand-in for the Pico SDK "hardware/i2c.h".
+//
+// Each i2c_inst_t is a simulated bus.  Transfers are routed to whatever
+// host_i2c_device has been attached at the target address (see
+// "host_i2c.h"), and advance the simulated clock by the time the
+// transfer would have taken on the wire at the bus's baud rate.
+//
+
+#include "pico/types.h"
+#include "pico/error.h"
+#include "pico/time.h"
+
+typedef struct i2c_inst i2c_inst_t;
+
+extern i2c_inst_t i2c0_inst;
+extern i2c_inst_t i2c1_inst;
+
+#define i2c0 (&i2c0_inst)
+#define i2c1 (&i2c1_inst)
+
+uint i2c_init(i2c_inst_t * i2c, uint baudrate);
+void i2c_deinit(i2c_inst_t * i2c);
+uint i2c_set_baudrate(i2c_inst_t * i2c, uint baudrate);
+
+int i2c_write_timeout_us(i2c_inst_t * i2c, uint8_t addr, const uint8_t * src, size_t len, bool nostop, uint timeout_us);
+int i2c_read_timeout_us(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, uint timeout_us);
+int i2c_write_blocking(i2c_inst_t * i2c, uint8_t addr, const uint8_t * src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop);
+
+#endif // _HARDWARE_I2C_H
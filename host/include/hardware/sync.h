@@ -0,0 +1,19 @@
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+//
+// Host stand-in for the Pico SDK "hardware/sync.h".  There are no
+// interrupts to disable.
+//
+
+#include "pico/types.h"
+
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {
+    (void)status;
+}
+
+#endif // _HARDWARE_SYNC_H
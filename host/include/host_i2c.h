@@ -0,0 +1,66 @@
+#ifndef __HOST_I2C_H__
+#define __HOST_I2C_H__
+
+//
+// Host-only extensions to the simulated "hardware/i2c.h": attaching
+// simulated target devices to a bus, and bus traffic accounting.
+//
+
+#include <hardware/i2c.h>
+
+
+//
+// A simulated I2C target.  The bus calls write() or read() once per
+// transfer addressed to the device.  Both return the number of bytes
+// the device Acked (for write) or supplied (for read), or
+// PICO_ERROR_GENERIC to Nack the address byte.
+//
+class host_i2c_device {
+public:
+    virtual ~host_i2c_device() {}
+    virtual int write(uint8_t const * src, size_t len, bool nostop) = 0;
+    virtual int read(uint8_t * dst, size_t len, bool nostop) = 0;
+};
+
+
+//
+// A simulated device that also forwards transfers to devices behind it,
+// like an I2C mux.  For transfers to addresses with no device attached
+// directly to the bus, the bus asks each bridge for a downstream device
+// to route to.
+//
+class host_i2c_bridge : public host_i2c_device {
+public:
+    virtual host_i2c_device * downstream(uint8_t addr) = 0;
+};
+
+
+void host_i2c_attach(i2c_inst_t * i2c, uint8_t addr, host_i2c_device * dev);
+void host_i2c_attach_bridge(i2c_inst_t * i2c, uint8_t addr, host_i2c_bridge * bridge);
+void host_i2c_detach(i2c_inst_t * i2c, uint8_t addr);
+
+
+typedef struct {
+    uint64_t transfers;  // Number of i2c_{read,write}_*() calls.
+    uint64_t bytes;      // Bytes on the wire, including address bytes.
+    uint64_t nacks;      // Transfers that were Nacked.
+    uint64_t timeouts;   // Transfers that exceeded their timeout.
+    uint64_t busy_us;    // Simulated time the bus was occupied.
+} host_i2c_stats_t;
+
+void host_i2c_get_stats(i2c_inst_t * i2c, host_i2c_stats_t * stats);
+void host_i2c_reset_stats(i2c_inst_t * i2c);
+
+uint host_i2c_get_baudrate(i2c_inst_t * i2c);
+
+
+//
+// Fault injection: a target on `i2c` holds SDA low, as one does when a
+// transfer was cut off mid-byte, until SCL has been clocked `clocks`
+// times on the bus's SCL pin under GPIO control.  Meanwhile every
+// transfer times out and gpio_get() on the bus's SDA pins reads low.
+//
+void host_i2c_hang(i2c_inst_t * i2c, uint clocks);
+bool host_i2c_hung(i2c_inst_t * i2c);
+
+#endif // __HOST_I2C_H__
@@ -0,0 +1,118 @@
+#ifndef __HUSB238_SIM_H__
+#define __HUSB238_SIM_H__
+
+#include "host_i2c.h"
+
+
+//
+// A software model of the HUSB238 register file and its USB-PD
+// behavior, for attaching to a simulated I2C bus with
+// host_i2c_attach(i2c, 0x08, &sim).
+//
+// The model covers:
+//
+//     * PD_STATUS0 and PD_STATUS1, including ATTACH, CC_DIR, the 5V
+//       contract fields, and PD_RESPONSE.
+//
+//     * SRC_PDO_5V through SRC_PDO_20V, published from the source's
+//       capabilities on attach, after GET_SRC_CAP, and after
+//       HARD_RESET.
+//
+//     * SRC_PDO and the GO_COMMAND semantics of SELECT_PDO,
+//       GET_SRC_CAP and HARD_RESET.  Commands clear PD_RESPONSE
+//       immediately and complete after a configurable latency.
+//
+//     * Register address auto-increment for multi-byte reads and
+//       writes.
+//
+// All timing is against the simulated clock, time_us_64().
+//
+class husb238_sim : public host_i2c_device {
+public:
+    husb238_sim();
+
+    //
+    // Set the capabilities of the (simulated) USB-PD source.  Each
+    // entry is the 4-bit PDO current code for 5, 9, 12, 15, 18 and
+    // 20 V respectively, or -1 if the source doesn't offer that
+    // voltage.  Like on a real HUSB238, the SRC_PDO registers only
+    // reflect the new capabilities after the next attach, GET_SRC_CAP
+    // or HARD_RESET.
+    //
+    void set_source_caps(int const caps[6]);
+
+    // Plug in or unplug the USB-PD source.
+    void attach(bool cc2 = false);
+    void detach(void);
+
+    bool attached(void) const { return is_attached; }
+
+    //
+    // Timing model, in microseconds.
+    //
+    uint32_t attach_us = 150 * 1000;        // Attach until capabilities are published.
+    uint32_t select_pdo_us = 3 * 1000;      // SELECT_PDO until PD_RESPONSE.
+    uint32_t get_src_cap_us = 2 * 1000;     // GET_SRC_CAP until PD_RESPONSE.
+    uint32_t hard_reset_us = 1200 * 1000;   // HARD_RESET until the chip is back.
+    uint32_t hard_reset_drop_us = 30 * 1000; // HARD_RESET until the source drops VBUS.
+
+    //
+    // Transfers that start less than this long after the start of the
+    // previous one are Nacked, to model a chip that needs the bus to
+    // rest between transfers.  A transfer after a repeated START is part
+    // of the same transaction, and always allowed.
+    //
+    uint32_t min_transfer_interval_us = 0;
+
+    //
+    // If true (as on most breakout boards), the HUSB238 is powered from
+    // VBUS: it disappears from the bus while detached and while VBUS is
+    // off during a hard reset.
+    //
+    bool vbus_powered = true;
+
+    //
+    // Bit i set makes the source refuse SELECT_PDO for PDO index i (5,
+    // 9, 12, 15, 18, 20 V), even though it advertises it.
+    //
+    uint8_t refused_pdos = 0;
+
+    // The simulated register file, PD_STATUS0 through GO_COMMAND.
+    uint8_t regs[10];
+
+    // Number of GO_COMMAND writes the model has executed.
+    uint32_t commands = 0;
+
+    int write(uint8_t const * src, size_t len, bool nostop) override;
+    int read(uint8_t * dst, size_t len, bool nostop) override;
+
+private:
+    enum pending_t {
+        PENDING_NONE,
+        PENDING_ATTACH,
+        PENDING_SELECT_PDO,
+        PENDING_GET_SRC_CAP,
+        PENDING_HARD_RESET,
+    };
+
+    void update(void);
+    bool on_bus(void) const;
+    bool too_soon(bool nostop);
+    void go_command(uint8_t cmd);
+    void publish_source_caps(void);
+    void set_pd_response(uint8_t response);
+    void set_contract(int pdo_index);
+
+    int source_caps[6];
+    bool is_attached = false;
+    bool cc2 = false;
+    uint8_t pointer = 0;
+    uint64_t last_transfer_us = 0;
+    bool restart = false;  // The last transfer ended without a STOP.
+    pending_t pending = PENDING_NONE;
+    uint64_t pending_done_us = 0;
+    uint64_t vbus_off_us = 0;  // When a pending HARD_RESET drops VBUS.
+};
+
+
+#endif // __HUSB238_SIM_H__
@@ -0,0 +1,31 @@
+#ifndef __INA219_SIM_H__
+#define __INA219_SIM_H__
+
+#include "host_i2c.h"
+
+
+//
+// A model of an INA219 current sensor, enough to sample it: a register
+// pointer set by the first byte of a write, 16-bit big-endian
+// registers, and a shunt voltage that can be set from the test.
+// Attach it to a bus with host_i2c_attach(i2c, 0x40, &ina).
+//
+class ina219_sim : public host_i2c_device {
+public:
+    ina219_sim();
+
+    // The registers, CONFIG (0x00) through CALIBRATION (0x05).
+    uint16_t regs[6];
+
+    // Number of reads the model has answered.
+    uint32_t reads = 0;
+
+    int write(uint8_t const * src, size_t len, bool nostop) override;
+    int read(uint8_t * dst, size_t len, bool nostop) override;
+
+private:
+    uint8_t pointer = 0;
+};
+
+
+#endif // __INA219_SIM_H__
@@ -0,0 +1,57 @@
+#ifndef _PICO_ASYNC_CONTEXT_H
+#define _PICO_ASYNC_CONTEXT_H
+
+//
+// Host stand-in for the Pico SDK "pico/async_context.h": at-time and
+// when-pending workers, run from async_context_poll() and
+// async_context_wait_for_work_until().  Only the poll flavor exists
+// (see "pico/async_context_poll.h"), and there's one thread, so the
+// lock only counts.
+//
+
+#include "pico/types.h"
+#include "pico/time.h"
+
+typedef struct async_context async_context_t;
+
+typedef struct async_work_on_timeout {
+    struct async_work_on_timeout * next;
+    void (*do_work)(async_context_t * context, struct async_work_on_timeout * timeout);
+    absolute_time_t next_time;
+    void * user_data;
+} async_at_time_worker_t;
+
+typedef struct async_when_pending_worker {
+    struct async_when_pending_worker * next;
+    void (*do_work)(async_context_t * context, struct async_when_pending_worker * worker);
+    bool work_pending;
+    void * user_data;
+} async_when_pending_worker_t;
+
+struct async_context {
+    async_at_time_worker_t * at_time_list;
+    async_when_pending_worker_t * when_pending_list;
+    uint lock_count;
+};
+
+void async_context_acquire_lock_blocking(async_context_t * context);
+void async_context_release_lock(async_context_t * context);
+void async_context_lock_check(async_context_t * context);
+
+bool async_context_add_at_time_worker(async_context_t * context, async_at_time_worker_t * worker);
+bool async_context_add_at_time_worker_at(async_context_t * context, async_at_time_worker_t * worker, absolute_time_t at);
+bool async_context_add_at_time_worker_in_ms(async_context_t * context, async_at_time_worker_t * worker, uint32_t ms);
+bool async_context_remove_at_time_worker(async_context_t * context, async_at_time_worker_t * worker);
+
+bool async_context_add_when_pending_worker(async_context_t * context, async_when_pending_worker_t * worker);
+bool async_context_remove_when_pending_worker(async_context_t * context, async_when_pending_worker_t * worker);
+void async_context_set_work_pending(async_context_t * context, async_when_pending_worker_t * worker);
+
+void async_context_poll(async_context_t * context);
+void async_context_wait_until(async_context_t * context, absolute_time_t until);
+void async_context_wait_for_work_until(async_context_t * context, absolute_time_t until);
+void async_context_wait_for_work_ms(async_context_t * context, uint32_t ms);
+uint async_context_core_num(async_context_t const * context);
+void async_context_deinit(async_context_t * context);
+
+#endif // _PICO_ASYNC_CONTEXT_H
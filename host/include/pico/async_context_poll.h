@@ -0,0 +1,18 @@
+#ifndef _PICO_ASYNC_CONTEXT_POLL_H
+#define _PICO_ASYNC_CONTEXT_POLL_H
+
+//
+// Host stand-in for the Pico SDK "pico/async_context_poll.h".  Waiting
+// for work sleeps on the simulated clock (see "pico/time.h") until the
+// next at-time worker is due.
+//
+
+#include "pico/async_context.h"
+
+typedef struct async_context_poll {
+    async_context_t core;
+} async_context_poll_t;
+
+bool async_context_poll_init_with_defaults(async_context_poll_t * self);
+
+#endif // _PICO_ASYNC_CONTEXT_POLL_H
@@ -0,0 +1,23 @@
+#ifndef _PICO_CRITICAL_SECTION_H
+#define _PICO_CRITICAL_SECTION_H
+
+//
+// Host stand-in for the Pico SDK "pico/critical_section.h".  A
+// critical section is a mutex, which keeps out core1's thread; there
+// are no interrupts to disable.
+//
+
+#include "pico/types.h"
+
+struct host_mutex;
+
+typedef struct {
+    struct host_mutex * mutex;
+} critical_section_t;
+
+void critical_section_init(critical_section_t * crit_sec);
+void critical_section_enter_blocking(critical_section_t * crit_sec);
+void critical_section_exit(critical_section_t * crit_sec);
+void critical_section_deinit(critical_section_t * crit_sec);
+
+#endif // _PICO_CRITICAL_SECTION_H
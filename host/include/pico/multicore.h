@@ -0,0 +1,15 @@
+#ifndef _PICO_MULTICORE_H
+#define _PICO_MULTICORE_H
+
+//
+// Host stand-in for the Pico SDK "pico/multicore.h".  Core1 is a
+// thread.  While it runs, the simulated clock follows the wall clock
+// (see "pico/time.h").
+//
+
+#include "pico/types.h"
+
+void multicore_launch_core1(void (*entry)(void));
+void multicore_reset_core1(void);
+
+#endif // _PICO_MULTICORE_H
@@ -0,0 +1,19 @@
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+//
+// Host stand-in for the Pico SDK "pico/stdlib.h".
+//
+
+#include "pico/types.h"
+#include "pico/error.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+
+bool stdio_init_all(void);
+
+// Gives the other core's thread a turn, which on a host with fewer CPUs
+// than cores is what a spinning loop is waiting for.
+void tight_loop_contents(void);
+
+#endif // _PICO_STDLIB_H
@@ -0,0 +1,59 @@
+#ifndef _PICO_TIME_H
+#define _PICO_TIME_H
+
+//
+// Host stand-in for the Pico SDK "pico/time.h".
+//
+// Time on the host is simulated: it starts at 0, and only moves forward
+// when something sleeps or when a transfer occupies the simulated I2C
+// bus.  That makes runs deterministic and lets a 1.5 second HUSB238
+// reset complete instantly.
+//
+// While core1 (a thread, see "pico/multicore.h") is running, time
+// follows the wall clock instead, and sleeps really sleep.
+//
+
+#include "pico/types.h"
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+void busy_wait_us(uint64_t us);
+
+static inline absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+static inline absolute_time_t from_us_since_boot(uint64_t us) {
+    return us;
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t) {
+    return (uint32_t)(t / 1000);
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us) {
+    return time_us_64() + us;
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return time_us_64() + (uint64_t)ms * 1000;
+}
+
+//
+// Host-only: advance the simulated clock without it being a "sleep".
+// Used by the simulated I2C bus to account for time on the wire.
+//
+void host_time_advance_us(uint64_t us);
+
+#endif // _PICO_TIME_H
@@ -0,0 +1,16 @@
+#ifndef _PICO_TYPES_H
+#define _PICO_TYPES_H
+
+//
+// Host stand-in for the Pico SDK "pico/types.h".
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+typedef uint64_t absolute_time_t;
+
+#endif // _PICO_TYPES_H
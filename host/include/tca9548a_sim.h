@@ -0,0 +1,33 @@
+#ifndef __TCA9548A_SIM_H__
+#define __TCA9548A_SIM_H__
+
+#include "host_i2c.h"
+
+
+//
+// A model of a TCA9548A 8-channel I2C mux.  Attach it to a bus with
+// host_i2c_attach_bridge(i2c, 0x70, &mux), and devices to its channels
+// with mux.attach().  Writing the control register enables any set of
+// channels; transfers to other addresses reach the devices on the
+// enabled channels.
+//
+class tca9548a_sim : public host_i2c_bridge {
+public:
+    void attach(int channel, uint8_t addr, host_i2c_device * dev);
+
+    // The control register, one enable bit per channel.
+    uint8_t control = 0x00;
+
+    // Number of control register writes.
+    uint32_t writes = 0;
+
+    int write(uint8_t const * src, size_t len, bool nostop) override;
+    int read(uint8_t * dst, size_t len, bool nostop) override;
+    host_i2c_device * downstream(uint8_t addr) override;
+
+private:
+    host_i2c_device * devices[8][128] = {};
+};
+
+
+#endif // __TCA9548A_SIM_H__
@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <pico/stdlib.h>
+#include <pico/critical_section.h>
+#include <pico/multicore.h>
+#include <hardware/flash.h>
+#include <hardware/i2c.h>
+
+#include "host_i2c.h"
+
+
+//
+// Simulated time.
+//
+
+static std::atomic<uint64_t> host_now_us{0};
+
+// While core1 runs, two threads would race each other through simulated
+// time, so the clock follows the wall clock instead, starting from
+// wherever simulated time had got to.
+static std::atomic<bool> host_realtime{false};
+static std::chrono::steady_clock::time_point host_realtime_start;
+static uint64_t host_realtime_base_us;
+
+
+static void host_set_realtime(bool realtime) {
+    if (realtime == host_realtime.load()) {
+        return;
+    }
+    if (realtime) {
+        host_realtime_base_us = host_now_us.load();
+        host_realtime_start = std::chrono::steady_clock::now();
+        host_realtime.store(true);
+    } else {
+        host_now_us.store(time_us_64());
+        host_realtime.store(false);
+    }
+}
+
+
+// HUSB238_HOST_RUNTIME_MS lets the (infinitely looping) example programs
+// run for a bounded amount of simulated time, e.g. in CI.
+static uint64_t host_runtime_limit_us(void) {
+    static uint64_t const limit_us = [] {
+        char const * limit = getenv("HUSB238_HOST_RUNTIME_MS");
+        return limit ? strtoull(limit, NULL, 0) * 1000 : UINT64_MAX;
+    }();
+    return limit_us;
+}
+
+
+void host_time_advance_us(uint64_t us) {
+    uint64_t now;
+
+    if (host_realtime.load()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+        now = time_us_64();
+    } else {
+        now = host_now_us.fetch_add(us) + us;
+    }
+
+    if (now >= host_runtime_limit_us()) {
+        fflush(stdout);
+        exit(0);
+    }
+}
+
+
+uint64_t time_us_64(void) {
+    if (host_realtime.load()) {
+        auto elapsed = std::chrono::steady_clock::now() - host_realtime_start;
+        return host_realtime_base_us + std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    }
+    return host_now_us.load();
+}
+
+
+uint32_t time_us_32(void) {
+    return (uint32_t)time_us_64();
+}
+
+
+void sleep_us(uint64_t us) {
+    host_time_advance_us(us);
+}
+
+
+void sleep_ms(uint32_t ms) {
+    host_time_advance_us((uint64_t)ms * 1000);
+}
+
+
+void busy_wait_us(uint64_t us) {
+    host_time_advance_us(us);
+}
+
+
+void tight_loop_contents(void) {
+    std::this_thread::yield();
+}
+
+
+bool stdio_init_all(void) {
+    return true;
+}
+
+
+//
+// Multicore.
+//
+
+// Never destroyed, so exiting with core1 still running doesn't abort.
+static std::thread * host_core1 = NULL;
+
+
+void multicore_launch_core1(void (*entry)(void)) {
+    multicore_reset_core1();
+    host_set_realtime(true);
+    host_core1 = new std::thread(entry);
+}
+
+
+void multicore_reset_core1(void) {
+    // There's no way to stop a thread from outside, so this waits for
+    // core1's entry function to return.
+    if (host_core1 != NULL) {
+        host_core1->join();
+        delete host_core1;
+        host_core1 = NULL;
+    }
+    host_set_realtime(false);
+}
+
+
+//
+// Critical sections.
+//
+
+struct host_mutex {
+    std::mutex mutex;
+};
+
+
+void critical_section_init(critical_section_t * crit_sec) {
+    crit_sec->mutex = new host_mutex;
+}
+
+
+void critical_section_enter_blocking(critical_section_t * crit_sec) {
+    crit_sec->mutex->mutex.lock();
+}
+
+
+void critical_section_exit(critical_section_t * crit_sec) {
+    crit_sec->mutex->mutex.unlock();
+}
+
+
+void critical_section_deinit(critical_section_t * crit_sec) {
+    delete crit_sec->mutex;
+    crit_sec->mutex = NULL;
+}
+
+
+//
+// GPIO.
+//
+
+static struct {
+    gpio_function_t function;
+    bool out;
+    bool value;
+    bool pull_up;
+} host_gpio[NUM_BANK0_GPIOS];
+
+
+// Hung-bus hooks, defined with the I2C model below.  On the RP2040 each
+// pin belongs to one I2C instance: even pins are SDA, odd pins SCL.
+static bool host_i2c_pin_held(uint gpio);
+static void host_i2c_pin_clocked(uint gpio);
+
+
+static bool host_gpio_level(uint gpio) {
+    if (host_gpio[gpio].out) {
+        return host_gpio[gpio].value;
+    }
+    return host_gpio[gpio].pull_up && !host_i2c_pin_held(gpio);
+}
+
+
+// Note rising edges, which is what clocks a hung target.
+static void host_gpio_changed(uint gpio, bool was) {
+    if (!was && host_gpio_level(gpio) && host_gpio[gpio].function == GPIO_FUNC_SIO) {
+        host_i2c_pin_clocked(gpio);
+    }
+}
+
+
+void gpio_init(uint gpio) {
+    host_gpio[gpio].function = GPIO_FUNC_SIO;
+    host_gpio[gpio].out = false;
+    host_gpio[gpio].value = false;
+}
+
+
+void gpio_set_function(uint gpio, gpio_function_t fn) {
+    host_gpio[gpio].function = fn;
+}
+
+
+gpio_function_t gpio_get_function(uint gpio) {
+    return host_gpio[gpio].function;
+}
+
+
+void gpio_pull_up(uint gpio) {
+    host_gpio[gpio].pull_up = true;
+}
+
+
+void gpio_disable_pulls(uint gpio) {
+    host_gpio[gpio].pull_up = false;
+}
+
+
+void gpio_set_dir(uint gpio, bool out) {
+    bool was = host_gpio_level(gpio);
+    host_gpio[gpio].out = out;
+    host_gpio_changed(gpio, was);
+}
+
+
+void gpio_put(uint gpio, bool value) {
+    bool was = host_gpio_level(gpio);
+    host_gpio[gpio].value = value;
+    host_gpio_changed(gpio, was);
+}
+
+
+bool gpio_get(uint gpio) {
+    return host_gpio_level(gpio);
+}
+
+
+//
+// Flash.
+//
+
+// Typical W25Q16JV figures, so that time spent erasing and programming
+// shows up on the simulated clock.
+#define HOST_FLASH_ERASE_US (45 * 1000)
+#define HOST_FLASH_PROGRAM_US (400)
+
+uint8_t host_flash_image[PICO_FLASH_SIZE_BYTES];
+
+// Reads go straight to the image, so it's erased before main().
+__attribute__((constructor))
+static void host_flash_init(void) {
+    memset(host_flash_image, 0xff, sizeof(host_flash_image));
+}
+
+
+static void host_flash_check(uint32_t flash_offs, size_t count, uint32_t align) {
+    if (flash_offs % align != 0 || count % align != 0 || flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        fprintf(stderr, "flash: bad range 0x%lx+0x%lx\n", (unsigned long)flash_offs, (unsigned long)count);
+        abort();
+    }
+}
+
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    host_flash_check(flash_offs, count, FLASH_SECTOR_SIZE);
+    memset(&host_flash_image[flash_offs], 0xff, count);
+    host_time_advance_us(count / FLASH_SECTOR_SIZE * HOST_FLASH_ERASE_US);
+}
+
+
+void flash_range_program(uint32_t flash_offs, const uint8_t * data, size_t count) {
+    host_flash_check(flash_offs, count, FLASH_PAGE_SIZE);
+    for (size_t i = 0; i < count; ++i) {
+        host_flash_image[flash_offs + i] &= data[i];
+    }
+    host_time_advance_us(count / FLASH_PAGE_SIZE * HOST_FLASH_PROGRAM_US);
+}
+
+
+//
+// I2C.
+//
+
+struct i2c_inst {
+    uint baudrate;
+    host_i2c_device * devices[128];
+    host_i2c_bridge * bridges[128];
+    host_i2c_stats_t stats;
+    uint hang_clocks;
+};
+
+i2c_inst_t i2c0_inst;
+i2c_inst_t i2c1_inst;
+
+
+static i2c_inst_t * host_i2c_pin_bus(uint gpio) {
+    return (gpio / 2) % 2 ? &i2c1_inst : &i2c0_inst;
+}
+
+
+static bool host_i2c_pin_held(uint gpio) {
+    return gpio % 2 == 0 && host_i2c_pin_bus(gpio)->hang_clocks != 0;
+}
+
+
+static void host_i2c_pin_clocked(uint gpio) {
+    i2c_inst_t * i2c = host_i2c_pin_bus(gpio);
+    if (gpio % 2 == 1 && i2c->hang_clocks != 0) {
+        i2c->hang_clocks--;
+    }
+}
+
+
+void host_i2c_hang(i2c_inst_t * i2c, uint clocks) {
+    i2c->hang_clocks = clocks;
+}
+
+
+bool host_i2c_hung(i2c_inst_t * i2c) {
+    return i2c->hang_clocks != 0;
+}
+
+
+uint i2c_init(i2c_inst_t * i2c, uint baudrate) {
+    return i2c_set_baudrate(i2c, baudrate);
+}
+
+
+void i2c_deinit(i2c_inst_t * i2c) {
+    i2c->baudrate = 0;
+}
+
+
+uint i2c_set_baudrate(i2c_inst_t * i2c, uint baudrate) {
+    i2c->baudrate = baudrate;
+    return baudrate;
+}
+
+
+uint host_i2c_get_baudrate(i2c_inst_t * i2c) {
+    return i2c->baudrate;
+}
+
+
+void host_i2c_attach(i2c_inst_t * i2c, uint8_t addr, host_i2c_device * dev) {
+    i2c->devices[addr & 0x7f] = dev;
+}
+
+
+void host_i2c_attach_bridge(i2c_inst_t * i2c, uint8_t addr, host_i2c_bridge * bridge) {
+    i2c->devices[addr & 0x7f] = bridge;
+    i2c->bridges[addr & 0x7f] = bridge;
+}
+
+
+void host_i2c_detach(i2c_inst_t * i2c, uint8_t addr) {
+    i2c->devices[addr & 0x7f] = NULL;
+    i2c->bridges[addr & 0x7f] = NULL;
+}
+
+
+void host_i2c_get_stats(i2c_inst_t * i2c, host_i2c_stats_t * stats) {
+    *stats = i2c->stats;
+}
+
+
+void host_i2c_reset_stats(i2c_inst_t * i2c) {
+    i2c->stats = {};
+}
+
+
+// Time on the wire for a transfer that clocked `bytes` bytes (including
+// the address byte): 9 bit times per byte (8 data bits plus Ack), plus
+// one bit time each for the start and stop conditions.  A transfer that
+// ends in a repeated start has no stop.
+static uint64_t host_i2c_wire_time_us(i2c_inst_t * i2c, size_t bytes, bool nostop) {
+    uint baudrate = i2c->baudrate ? i2c->baudrate : 100 * 1000;
+    uint64_t bits = bytes * 9 + (nostop ? 1 : 2);
+    return (bits * 1000 * 1000 + baudrate - 1) / baudrate;
+}
+
+
+// Run one transfer against the attached device, account for it, and
+// return what the Pico SDK would have returned.
+static int host_i2c_transfer(i2c_inst_t * i2c, uint8_t addr, uint8_t * buf, size_t len, bool nostop, bool read, uint timeout_us) {
+    host_i2c_device * dev = i2c->devices[addr & 0x7f];
+    int r;
+
+    for (int i = 0; dev == NULL && i < 128; ++i) {
+        if (i2c->bridges[i] != NULL) {
+            dev = i2c->bridges[i]->downstream(addr & 0x7f);
+        }
+    }
+
+    if (i2c->baudrate == 0 || i2c->hang_clocks != 0) {
+        // Peripheral not initialized or SDA held low: nothing happens on
+        // the wire and the SDK call never completes.
+        r = PICO_ERROR_TIMEOUT;
+        i2c->stats.timeouts++;
+        host_time_advance_us(timeout_us);
+        return r;
+    }
+
+    if (dev == NULL) {
+        r = PICO_ERROR_GENERIC;
+    } else if (read) {
+        r = dev->read(buf, len, nostop);
+    } else {
+        r = dev->write(buf, len, nostop);
+    }
+
+    // A Nacked address still clocks the address byte.
+    size_t clocked = 1 + (r > 0 ? r : 0);
+    uint64_t wire_us = host_i2c_wire_time_us(i2c, clocked, nostop);
+
+    i2c->stats.transfers++;
+    if (timeout_us != 0 && wire_us > timeout_us) {
+        wire_us = timeout_us;
+        r = PICO_ERROR_TIMEOUT;
+        i2c->stats.timeouts++;
+    } else if (r < 0) {
+        i2c->stats.nacks++;
+    }
+    i2c->stats.bytes += clocked;
+    i2c->stats.busy_us += wire_us;
+
+    host_time_advance_us(wire_us);
+    return r;
+}
+
+
+int i2c_write_timeout_us(i2c_inst_t * i2c, uint8_t addr, const uint8_t * src, size_t len, bool nostop, uint timeout_us) {
+    return host_i2c_transfer(i2c, addr, (uint8_t *)src, len, nostop, false, timeout_us);
+}
+
+
+int i2c_read_timeout_us(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop, uint timeout_us) {
+    return host_i2c_transfer(i2c, addr, dst, len, nostop, true, timeout_us);
+}
+
+
+int i2c_write_blocking(i2c_inst_t * i2c, uint8_t addr, const uint8_t * src, size_t len, bool nostop) {
+    return host_i2c_transfer(i2c, addr, (uint8_t *)src, len, nostop, false, 0);
+}
+
+
+int i2c_read_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop) {
+    return host_i2c_transfer(i2c, addr, dst, len, nostop, true, 0);
+}
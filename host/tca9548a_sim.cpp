@@ -0,0 +1,35 @@
+#include "tca9548a_sim.h"
+
+
+void tca9548a_sim::attach(int channel, uint8_t addr, host_i2c_device * dev) {
+    devices[channel][addr & 0x7f] = dev;
+}
+
+
+int tca9548a_sim::write(uint8_t const * src, size_t len, bool nostop) {
+    if (len > 0) {
+        control = src[len - 1];
+        writes++;
+    }
+    return len;
+}
+
+
+int tca9548a_sim::read(uint8_t * dst, size_t len, bool nostop) {
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = control;
+    }
+    return len;
+}
+
+
+host_i2c_device * tca9548a_sim::downstream(uint8_t addr) {
+    // With more than one channel enabled, devices at the same address
+    // would fight over the bus; the lowest channel wins here.
+    for (int channel = 0; channel < 8; ++channel) {
+        if ((control & (1 << channel)) && devices[channel][addr] != NULL) {
+            return devices[channel][addr];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+
+#
+# Decode the deferred log records that husb238_log_dump() prints.
+#
+# Reads a capture of the device's stdio (a file, or stdin), picks out
+# the "husb238-log:<hex>" lines and prints them formatted, using the
+# message table in driver/include/husb238_log.h.  Other lines are
+# passed through unchanged, unless --only-log is given.
+#
+#     ./tools/husb238_log_decode.py capture.txt
+#     picocom /dev/ttyACM0 | ./tools/husb238_log_decode.py
+#
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+
+DEFAULT_HEADER = os.path.join(os.path.dirname(__file__), '..', 'driver', 'include', 'husb238_log.h')
+
+PREFIX = 'husb238-log:'
+
+# Matches husb238_log_record_t: time_us, id, 3 reserved bytes, 4 args,
+# little endian like the RP2040.
+RECORD = struct.Struct('<IB3x4I')
+
+CONVERSION = re.compile(r'%[-+ #0]*\d*(?:\.\d+)?(?:hh|h|ll|l|z)?([diuxXc%])')
+
+
+def load_messages(header):
+    with open(header) as f:
+        text = f.read()
+    return [
+        (m.group(1), m.group(2), m.group(3).encode().decode('unicode_escape'))
+        for m in re.finditer(r'X\((\w+),\s*(\w+),\s*"((?:[^"\\]|\\.)*)"\)', text)
+    ]
+
+
+def c_format(fmt, args):
+    # Format like the device's printf would, with every argument a
+    # 32-bit value.
+    args = list(args)
+    out = []
+    pos = 0
+    for m in CONVERSION.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        conv = m.group(1)
+        if conv == '%':
+            out.append('%')
+            continue
+        value = args.pop(0) if args else 0
+        if conv in 'di' and value & 0x80000000:
+            value -= 1 << 32
+        spec = re.sub(r'(hh|h|ll|l|z)', '', m.group(0))
+        if conv in 'u':
+            spec = spec[:-1] + 'd'
+        out.append(spec % value)
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def decode(line, messages):
+    data = bytes.fromhex(line[len(PREFIX):].strip())
+    if len(data) != RECORD.size:
+        return 'husb238: bad log record: %s' % line.strip()
+    time_us, msg_id, *args = RECORD.unpack(data)
+    if msg_id >= len(messages):
+        return 'husb238 %10u: unknown log message %d %s' % (time_us, msg_id, args)
+    name, level, fmt = messages[msg_id]
+    return 'husb238 %10u: %-5s %s' % (time_us, level, c_format(fmt, args))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode HUSB238 driver log records.')
+    parser.add_argument('input', nargs='?', help='capture to decode (default: stdin)')
+    parser.add_argument('--header', default=DEFAULT_HEADER, help='husb238_log.h to take the messages from')
+    parser.add_argument('--only-log', action='store_true', help='drop lines that are not log records')
+    args = parser.parse_args()
+
+    messages = load_messages(args.header)
+    src = open(args.input) if args.input else sys.stdin
+    for line in src:
+        i = line.find(PREFIX)
+        if i >= 0:
+            print(decode(line[i:], messages))
+            sys.stdout.flush()
+        elif not args.only_log:
+            sys.stdout.write(line)
+
+
+if __name__ == '__main__':
+    main()